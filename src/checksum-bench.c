@@ -0,0 +1,102 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+// Measures what checksumming costs per megabyte of CD audio, so we can
+// tell whether verifying a rip is ever what holds it up.
+
+#include "checksum.h"
+
+#include <glib.h>
+#include <stdio.h>
+
+#define BENCH_SIZE (64 * 1024 * 1024)
+#define BENCH_ROUNDS 8
+
+typedef void (*BenchFunc)(const guint8 *data, gsize length, gpointer result);
+
+static void crc_bench(const guint8 *data, gsize length, gpointer result)
+{
+    *(guint32*)result = rippit_crc32_update(0, data, length);
+}
+
+static void arScalar_bench(const guint8 *data, gsize length, gpointer result)
+{
+    guint32 v1 = 0;
+    guint32 v2 = 0;
+    rippit_accuraterip_update_scalar((const guint32*)data, length / 4, 1, &v1, &v2);
+    *(guint32*)result = v1 ^ v2;
+}
+
+static void arVector_bench(const guint8 *data, gsize length, gpointer result)
+{
+    guint32 v1 = 0;
+    guint32 v2 = 0;
+    rippit_accuraterip_update((const guint32*)data, length / 4, 1, &v1, &v2);
+    *(guint32*)result = v1 ^ v2;
+}
+
+static void track_bench(const guint8 *data, gsize length, gpointer result)
+{
+    RippitTrackChecksum sum;
+    gsize offset;
+    rippit_track_checksum_init(&sum, length / 4, TRUE, TRUE);
+    // Feed it in buffers the size cdparanoiasrc hands out
+    for (offset = 0; offset < length; offset += CD_SAMPLES_PER_SECTOR * 4)
+        rippit_track_checksum_update(&sum, data + offset, MIN(CD_SAMPLES_PER_SECTOR * 4, length - offset));
+    *(guint32*)result = sum.crc ^ sum.arV1 ^ sum.arV2;
+}
+
+static void runBench(const gchar *name, BenchFunc func, const guint8 *data, gsize length)
+{
+    GTimer *timer = g_timer_new();
+    gdouble best = G_MAXDOUBLE;
+    gdouble mb = (gdouble)length / (1024 * 1024);
+    guint32 result = 0;
+    int i;
+
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        g_timer_start(timer);
+        func(data, length, &result);
+        g_timer_stop(timer);
+        best = MIN(best, g_timer_elapsed(timer, NULL));
+    }
+    g_timer_destroy(timer);
+
+    printf("%-24s %10.1f us/MB %10.1f MB/s  (%08x)\n", name, best * 1e6 / mb, mb / best, result);
+}
+
+int main(int argc, char *argv[])
+{
+    guint8 *data = g_malloc(BENCH_SIZE);
+    GRand *rand = g_rand_new_with_seed(2352);
+    gsize i;
+
+    for (i = 0; i < BENCH_SIZE / 4; i++)
+        ((guint32*)data)[i] = g_rand_int(rand);
+    g_rand_free(rand);
+
+    printf("Checksumming %d MB of audio, best of %d\n", BENCH_SIZE / (1024 * 1024), BENCH_ROUNDS);
+    runBench("crc32", crc_bench, data, BENCH_SIZE);
+    runBench("accuraterip (scalar)", arScalar_bench, data, BENCH_SIZE);
+    runBench("accuraterip", arVector_bench, data, BENCH_SIZE);
+    runBench("whole track", track_bench, data, BENCH_SIZE);
+
+    g_free(data);
+    return 0;
+}
@@ -0,0 +1,150 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "checksum.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Slicing-by-8: eight table lookups per eight bytes instead of one per byte.
+// The real CRC instructions on x86 only do CRC-32C, which isn't the CRC
+// anyone compares rips with.
+static guint32 crcTable[8][256];
+
+static gpointer buildTable(gpointer data)
+{
+    guint32 i, j, c;
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crcTable[0][i] = c;
+    }
+    for (i = 0; i < 256; i++) {
+        c = crcTable[0][i];
+        for (j = 1; j < 8; j++) {
+            c = crcTable[0][c & 0xff] ^ (c >> 8);
+            crcTable[j][i] = c;
+        }
+    }
+    return NULL;
+}
+
+guint32 rippit_crc32_update(guint32 crc, const guint8 *data, gsize length)
+{
+    static GOnce once = G_ONCE_INIT;
+    g_once(&once, buildTable, NULL);
+
+    crc = ~crc;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    while (length >= 8) {
+        guint32 lo, hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = crcTable[7][lo & 0xff] ^ crcTable[6][(lo >> 8) & 0xff] ^
+              crcTable[5][(lo >> 16) & 0xff] ^ crcTable[4][lo >> 24] ^
+              crcTable[3][hi & 0xff] ^ crcTable[2][(hi >> 8) & 0xff] ^
+              crcTable[1][(hi >> 16) & 0xff] ^ crcTable[0][hi >> 24];
+        data += 8;
+        length -= 8;
+    }
+#endif
+    while (length--)
+        crc = crcTable[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void rippit_accuraterip_update_scalar(const guint32 *samples, gsize count, guint32 mult, guint32 *v1, guint32 *v2)
+{
+    guint32 lo = 0;
+    guint32 hi = 0;
+    gsize i;
+
+    for (i = 0; i < count; i++) {
+        guint64 product = (guint64)GUINT32_FROM_LE(samples[i]) * mult++;
+        lo += (guint32)product;
+        hi += (guint32)(product >> 32);
+    }
+    *v1 += lo;
+    *v2 += lo + hi;
+}
+
+void rippit_accuraterip_update(const guint32 *samples, gsize count, guint32 mult, guint32 *v1, guint32 *v2)
+{
+#if defined(__SSE2__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+    // Four samples at a time. _mm_mul_epu32 only multiplies the even lanes,
+    // so the odd ones get shifted down and done separately. Each 64 bit
+    // product lands as its low half in an even lane and its high half in an
+    // odd one, and 32 bit adds wrap the way AccurateRip wants them to.
+    __m128i multipliers = _mm_setr_epi32(mult, mult + 1, mult + 2, mult + 3);
+    __m128i four = _mm_set1_epi32(4);
+    __m128i evenSum = _mm_setzero_si128();
+    __m128i oddSum = _mm_setzero_si128();
+    guint32 lanes[4];
+    guint32 lo, hi;
+    gsize blocks = count / 4;
+    gsize i;
+
+    for (i = 0; i < blocks; i++) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(samples + i * 4));
+        evenSum = _mm_add_epi32(evenSum, _mm_mul_epu32(s, multipliers));
+        oddSum = _mm_add_epi32(oddSum, _mm_mul_epu32(_mm_srli_epi64(s, 32), _mm_srli_epi64(multipliers, 32)));
+        multipliers = _mm_add_epi32(multipliers, four);
+    }
+    evenSum = _mm_add_epi32(evenSum, oddSum);
+    _mm_storeu_si128((__m128i*)lanes, evenSum);
+    lo = lanes[0] + lanes[2];
+    hi = lanes[1] + lanes[3];
+    *v1 += lo;
+    *v2 += lo + hi;
+
+    rippit_accuraterip_update_scalar(samples + blocks * 4, count - blocks * 4, mult + blocks * 4, v1, v2);
+#else
+    rippit_accuraterip_update_scalar(samples, count, mult, v1, v2);
+#endif
+}
+
+void rippit_track_checksum_init(RippitTrackChecksum *sum, guint64 totalSamples, gboolean firstTrack, gboolean lastTrack)
+{
+    memset(sum, 0, sizeof(*sum));
+    sum->checkFrom = firstTrack ? 5 * CD_SAMPLES_PER_SECTOR : 0;
+    sum->checkTo = totalSamples > 0 ? totalSamples : G_MAXUINT64;
+    if (lastTrack && totalSamples > 5 * CD_SAMPLES_PER_SECTOR)
+        sum->checkTo = totalSamples - 5 * CD_SAMPLES_PER_SECTOR;
+}
+
+void rippit_track_checksum_update(RippitTrackChecksum *sum, const guint8 *data, gsize length)
+{
+    // AccurateRip multipliers count from 1, and the sample with multiplier
+    // checkFrom is the first one in, checkTo the last one.
+    guint64 first = sum->position + 1;
+    guint64 count = length / 4;
+    guint64 from = MAX(first, sum->checkFrom);
+    guint64 to = MIN(first + count, sum->checkTo + 1);
+
+    sum->crc = rippit_crc32_update(sum->crc, data, length);
+    if (from < to) {
+        rippit_accuraterip_update((const guint32*)data + (from - first), to - from, from, &sum->arV1, &sum->arV2);
+    }
+    sum->position += count;
+}
@@ -0,0 +1,54 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <glib.h>
+
+// Samples (one left/right pair) in a CD sector
+#define CD_SAMPLES_PER_SECTOR 588
+
+// Everything we checksum a track with, built up as the audio streams past.
+// The AccurateRip sums leave out the first five sectors of the first track
+// and the last five of the last one, so they need to know where they are.
+typedef struct {
+    guint32 crc;
+    guint32 arV1;
+    guint32 arV2;
+    guint64 position;
+    guint64 checkFrom;
+    guint64 checkTo;
+} RippitTrackChecksum;
+
+// Plain CRC-32 (the zlib/EAC one). Start with crc = 0.
+guint32 rippit_crc32_update(guint32 crc, const guint8 *data, gsize length);
+
+// totalSamples may be 0 if the track length isn't known, as long as it
+// isn't the last track.
+void rippit_track_checksum_init(RippitTrackChecksum *sum, guint64 totalSamples, gboolean firstTrack, gboolean lastTrack);
+// Takes raw 16 bit little endian stereo CDDA, in whole samples
+void rippit_track_checksum_update(RippitTrackChecksum *sum, const guint8 *data, gsize length);
+
+// The kernels behind rippit_track_checksum_update, exposed for benchmarking.
+// mult is the AccurateRip multiplier of the first sample.
+void rippit_accuraterip_update_scalar(const guint32 *samples, gsize count, guint32 mult, guint32 *v1, guint32 *v2);
+void rippit_accuraterip_update(const guint32 *samples, gsize count, guint32 mult, guint32 *v1, guint32 *v2);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,75 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "cuesheet.h"
+
+// CUE sheets count in minutes, seconds and frames, 75 frames to the second
+static void appendTime(GString *cue, gint64 sectors)
+{
+    g_string_append_printf(cue, "%02d:%02d:%02d", (int)(sectors / (75 * 60)), (int)(sectors / 75 % 60), (int)(sectors % 75));
+}
+
+// There's no escaping quotes in a CUE sheet, so they just get swapped out
+static void appendQuoted(GString *cue, const gchar *key, const gchar *value, const gchar *suffix)
+{
+    gchar *safe = g_strdup(value);
+    g_strdelimit(safe, "\"", '\'');
+    g_string_append_printf(cue, "%s \"%s\"%s\n", key, safe, suffix);
+    g_free(safe);
+}
+
+gboolean rippit_cue_sheet_write(const gchar *location, const gchar *imageName, const gchar *discID, RippitDiscInfo *info, const gint64 *trackStarts, gint trackCount, GError **error)
+{
+    GString *cue = g_string_new(NULL);
+    gboolean ret;
+    gint i;
+
+    g_string_append_printf(cue, "REM MUSICBRAINZ_DISCID %s\n", discID);
+    g_string_append_printf(cue, "REM COMMENT \"rippit %s\"\n", RIPPIT_VERSION_STRING);
+    if (info) {
+        appendQuoted(cue, "PERFORMER", info->artist, "");
+        appendQuoted(cue, "TITLE", info->album, "");
+    }
+    appendQuoted(cue, "FILE", imageName, " WAVE");
+
+    for (i = 0; i < trackCount; i++) {
+        g_string_append_printf(cue, "  TRACK %02d AUDIO\n", i + 1);
+        if (info) {
+            g_string_append(cue, "    ");
+            appendQuoted(cue, "TITLE", rippit_disc_info_track_title(info, i + 1), "");
+            g_string_append(cue, "    ");
+            appendQuoted(cue, "PERFORMER", rippit_disc_info_track_artist(info, i + 1), "");
+        }
+        // Audio before the first track isn't something cdparanoiasrc will
+        // read, so all we can do is say that it's there
+        if (i == 0 && trackStarts[0] > 0) {
+            g_string_append(cue, "    PREGAP ");
+            appendTime(cue, trackStarts[0]);
+            g_string_append(cue, "\n");
+        }
+        g_string_append(cue, "    INDEX 01 ");
+        appendTime(cue, trackStarts[i] - trackStarts[0]);
+        g_string_append(cue, "\n");
+    }
+
+    ret = g_file_set_contents(location, cue->str, cue->len, error);
+    g_string_free(cue, TRUE);
+    return ret;
+}
@@ -0,0 +1,30 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef CUESHEET_H
+#define CUESHEET_H
+
+#include "metadata.h"
+
+// Writes the CUE sheet for a single file image of a CD. trackStarts holds
+// the sector each track starts at, as the TOC has it; the image itself
+// starts with the first track. info may be NULL if we don't know the disc.
+gboolean rippit_cue_sheet_write(const gchar *location, const gchar *imageName, const gchar *discID, RippitDiscInfo *info, const gint64 *trackStarts, gint trackCount, GError **error);
+
+#endif // CUESHEET_H
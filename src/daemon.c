@@ -0,0 +1,271 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "daemon.h"
+#include "util.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <linux/cdrom.h>
+
+// How often drives get asked whether there's a disc in them. It's one
+// ioctl on a file that stays open, so this can be often.
+#define DRIVE_POLL_SECONDS 2
+
+struct _RippitDaemon {
+    const RippitJobOptions *options;
+    RippitTelemetry *telemetry;
+    gint maxImageJobs;
+    gint runningImages;
+    // Images waiting their turn, and every image we've ever queued so a
+    // second event for one doesn't rip it twice
+    GQueue *images;
+    GHashTable *seen;
+    GList *drives;
+    // inotify watch descriptor -> directory
+    GHashTable *directories;
+    int inotifyFd;
+};
+
+typedef struct {
+    RippitDaemon *daemon;
+    gchar *device;
+    int fd;
+    RippitJob *job;
+    // The disc in the tray has been ripped, or couldn't be; wait for it
+    // to go away before looking at the drive again
+    gboolean ripped;
+} WatchedDrive;
+
+typedef struct {
+    RippitDaemon *daemon;
+    RippitJob *job;
+    gchar *device;
+    // NULL for images
+    WatchedDrive *drive;
+    gboolean success;
+} RunningJob;
+
+static void startQueuedImages(RippitDaemon *daemon);
+
+static void message_cb(RippitJob *job, const gchar *message, gpointer data)
+{
+    RunningJob *running = data;
+    g_print("%s: %s\n", running->device, message);
+}
+
+static void eject(WatchedDrive *drive)
+{
+    if (ioctl(drive->fd, CDROMEJECT, 0) != 0)
+        g_print("%s: Could not eject: %s\n", drive->device, g_strerror(errno));
+}
+
+// Jobs can't be freed from their own callbacks, so the cleanup waits
+// until they're out of them
+static gboolean jobDone_idle(gpointer data)
+{
+    RunningJob *running = data;
+    RippitDaemon *daemon = running->daemon;
+
+    g_print("%s: %s\n", running->device, running->success ? "Done" : "Gave up");
+    rippit_job_free(running->job);
+    if (running->drive) {
+        running->drive->job = NULL;
+        running->drive->ripped = TRUE;
+        eject(running->drive);
+    } else {
+        daemon->runningImages--;
+        startQueuedImages(daemon);
+    }
+    g_free(running->device);
+    g_free(running);
+    return FALSE;
+}
+
+static void done_cb(RippitJob *job, gboolean success, gpointer data)
+{
+    RunningJob *running = data;
+    running->success = success;
+    if (running->daemon->telemetry)
+        rippit_telemetry_remove_job(running->daemon->telemetry, job);
+    g_idle_add(jobDone_idle, running);
+}
+
+static RunningJob *startJob(RippitDaemon *daemon, const gchar *device, WatchedDrive *drive)
+{
+    static const RippitJobCallbacks callbacks = { message_cb, NULL, done_cb };
+    RunningJob *running = g_new0(RunningJob, 1);
+    GError *error = NULL;
+
+    running->daemon = daemon;
+    running->device = g_strdup(device);
+    running->drive = drive;
+    running->job = rippit_job_new(device, daemon->options, &error);
+    if (running->job) {
+        rippit_job_set_callbacks(running->job, &callbacks, running);
+        if (daemon->telemetry)
+            rippit_telemetry_add_job(daemon->telemetry, running->job);
+        if (rippit_job_start(running->job, &error))
+            return running;
+        if (daemon->telemetry)
+            rippit_telemetry_remove_job(daemon->telemetry, running->job);
+    }
+
+    g_print("%s: %s\n", device, error->message);
+    g_error_free(error);
+    g_idle_add(jobDone_idle, running);
+    return running;
+}
+
+static void startQueuedImages(RippitDaemon *daemon)
+{
+    while (daemon->runningImages < daemon->maxImageJobs && !g_queue_is_empty(daemon->images)) {
+        gchar *image = g_queue_pop_head(daemon->images);
+        daemon->runningImages++;
+        startJob(daemon, image, NULL);
+        g_free(image);
+    }
+}
+
+static void queueImage(RippitDaemon *daemon, const gchar *path)
+{
+    if (!g_str_has_suffix(path, ".cue") && !g_str_has_suffix(path, ".iso"))
+        return;
+    if (g_hash_table_lookup(daemon->seen, path))
+        return;
+    g_hash_table_insert(daemon->seen, g_strdup(path), GINT_TO_POINTER(TRUE));
+    g_print("%s: Queued\n", path);
+    g_queue_push_tail(daemon->images, g_strdup(path));
+    startQueuedImages(daemon);
+}
+
+static gboolean pollDrives(gpointer data)
+{
+    RippitDaemon *daemon = data;
+    GList *cur;
+
+    for (cur = daemon->drives; cur; cur = cur->next) {
+        WatchedDrive *drive = cur->data;
+        gboolean present = ioctl(drive->fd, CDROM_DRIVE_STATUS, CDSL_CURRENT) == CDS_DISC_OK;
+
+        if (!present)
+            drive->ripped = FALSE;
+        else if (!drive->job && !drive->ripped)
+            drive->job = startJob(daemon, drive->device, drive)->job;
+    }
+    return TRUE;
+}
+
+static gboolean inotify_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    RippitDaemon *daemon = data;
+    gchar buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length = read(daemon->inotifyFd, buffer, sizeof(buffer));
+    ssize_t pos = 0;
+
+    while (length > 0 && pos < length) {
+        struct inotify_event *event = (struct inotify_event*)(buffer + pos);
+        const gchar *directory = g_hash_table_lookup(daemon->directories, GINT_TO_POINTER(event->wd));
+
+        if (directory && event->len > 0) {
+            gchar *path = g_build_filename(directory, event->name, NULL);
+            queueImage(daemon, path);
+            g_free(path);
+        }
+        pos += sizeof(struct inotify_event) + event->len;
+    }
+    return TRUE;
+}
+
+RippitDaemon *rippit_daemon_new(const RippitJobOptions *options, gint maxImageJobs, RippitTelemetry *telemetry)
+{
+    RippitDaemon *daemon = g_new0(RippitDaemon, 1);
+    daemon->options = options;
+    daemon->telemetry = telemetry;
+    daemon->maxImageJobs = MAX(1, maxImageJobs);
+    daemon->images = g_queue_new();
+    daemon->seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    daemon->directories = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    daemon->inotifyFd = -1;
+    g_timeout_add_seconds(DRIVE_POLL_SECONDS, pollDrives, daemon);
+    return daemon;
+}
+
+gboolean rippit_daemon_watch_drive(RippitDaemon *daemon, const gchar *device, GError **error)
+{
+    int fd = rippit_open_drive(device, error);
+    WatchedDrive *drive;
+
+    if (fd < 0)
+        return FALSE;
+    drive = g_new0(WatchedDrive, 1);
+    drive->daemon = daemon;
+    drive->device = g_strdup(device);
+    drive->fd = fd;
+    daemon->drives = g_list_append(daemon->drives, drive);
+    g_print("%s: Waiting for a disc\n", device);
+    return TRUE;
+}
+
+gboolean rippit_daemon_watch_directory(RippitDaemon *daemon, const gchar *directory, GError **error)
+{
+    GDir *dir;
+    const gchar *name;
+    int wd;
+
+    if (daemon->inotifyFd < 0) {
+        GIOChannel *channel;
+
+        daemon->inotifyFd = inotify_init();
+        if (daemon->inotifyFd < 0) {
+            g_set_error(error, RIPPIT_ERROR, 0, "Could not watch for new images: %s", g_strerror(errno));
+            return FALSE;
+        }
+        channel = g_io_channel_unix_new(daemon->inotifyFd);
+        g_io_add_watch(channel, G_IO_IN, inotify_cb, daemon);
+        g_io_channel_unref(channel);
+    }
+
+    // Only images that are all there; a .cue should be the last thing put in
+    // the directory, after its .bin
+    wd = inotify_add_watch(daemon->inotifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not watch %s: %s", directory, g_strerror(errno));
+        return FALSE;
+    }
+    g_hash_table_insert(daemon->directories, GINT_TO_POINTER(wd), g_strdup(directory));
+    g_print("%s: Waiting for images\n", directory);
+
+    // Whatever's there already goes first
+    dir = g_dir_open(directory, 0, NULL);
+    while (dir && (name = g_dir_read_name(dir))) {
+        gchar *path = g_build_filename(directory, name, NULL);
+        queueImage(daemon, path);
+        g_free(path);
+    }
+    if (dir)
+        g_dir_close(dir);
+    return TRUE;
+}
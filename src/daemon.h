@@ -0,0 +1,39 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "librippit.h"
+#include "telemetry.h"
+
+// rippit --daemon: rips whatever turns up, for as long as it runs. Drives
+// get a job as soon as a disc is in them and are ejected once it's done;
+// CD images (.cue) and DVD images (.iso) that land in a watched directory
+// get queued up and ripped a few at a time. Everything happens in the one
+// process, so GStreamer's registry and plugins are only ever loaded once.
+typedef struct _RippitDaemon RippitDaemon;
+
+// options has to stay around as long as the daemon does. telemetry can be
+// NULL.
+RippitDaemon *rippit_daemon_new(const RippitJobOptions *options, gint maxImageJobs, RippitTelemetry *telemetry);
+gboolean rippit_daemon_watch_drive(RippitDaemon *daemon, const gchar *device, GError **error);
+gboolean rippit_daemon_watch_directory(RippitDaemon *daemon, const gchar *directory, GError **error);
+
+#endif // DAEMON_H
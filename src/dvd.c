@@ -0,0 +1,675 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "dvd.h"
+#include "dvdsplit.h"
+
+#include <dvdread/dvd_reader.h>
+#include <dvdread/ifo_read.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+struct _RippitTitlePool {
+    GMutex *lock;
+    guint pending;
+    GThreadPool *encoders;
+    RippitDvdBuildFunc build;
+    RippitTitleDoneFunc done;
+    gpointer doneData;
+    RippitProfile *profile;
+    gboolean split;
+    guint64 writeBuffer;
+    RippitWriteStats *writeStats;
+};
+
+typedef struct {
+    RippitTitlePool *pool;
+    gchar *copy;
+    gchar *location;
+    RippitDvdTitle *title;
+    gboolean success;
+} TitleJob;
+
+static void linkDecodebin(GstElement *decodebin, gpointer data)
+{
+    gst_element_link(decodebin, GST_ELEMENT(data));
+    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(GST_ELEMENT_PARENT(decodebin)), GST_DEBUG_GRAPH_SHOW_ALL, "decodebin2-link");
+}
+
+GstElement *rippit_dvd_encoder_add(GstElement *pipe, GstElement *source)
+{
+    GstElement *dvdDemux = gst_element_factory_make("dvddemux", NULL);
+    GstElement *videoDecoder = gst_element_factory_make("decodebin2", NULL);
+    GstElement *dvdSpu = gst_element_factory_make("dvdspu", NULL);
+    GstElement *dvdSubparse = gst_element_factory_make("dvdsubparse", NULL);
+
+    GstElement *videoQueue = gst_element_factory_make("queue", NULL);
+    GstElement *audioQueue = gst_element_factory_make("queue", NULL);
+    GstElement *audioOutQueue = gst_element_factory_make("queue", NULL);
+
+    GstElement *videoEncoder = gst_element_factory_make("x264enc", NULL);
+    GstElement *audioEncoder = gst_element_factory_make("ffenc_ac3", NULL);
+    GstElement *audioDecoder = gst_element_factory_make("decodebin2", NULL);
+    GstElement *muxer = gst_element_factory_make("matroskamux", NULL);
+    GstElement *output = gst_element_factory_make("filesink", NULL);
+
+    if (!videoEncoder || !audioEncoder || !dvdDemux)
+        return NULL;
+
+    // high10 profile
+    //g_object_set(G_OBJECT(videoEncoder), "profile", 4, NULL);
+    // two-pass encoding
+    //g_object_set(G_OBJECT(videoEncoder), "pass", 18, NULL);
+    g_object_set(G_OBJECT(videoEncoder), "quantizer", 40, NULL);
+
+    g_object_set(G_OBJECT(output), "location", "/dev/null", NULL);
+    g_object_set(G_OBJECT(muxer), "writing-app", "Rippit " RIPPIT_VERSION_STRING, NULL);
+
+    gst_bin_add_many(GST_BIN(pipe), audioOutQueue, audioQueue, videoQueue, videoDecoder, dvdSubparse, dvdSpu, dvdDemux, videoEncoder, audioDecoder, audioEncoder, muxer, output, NULL);
+
+    gst_element_link(source, dvdDemux);
+    gst_element_link_pads(dvdDemux, "current_subpicture", dvdSubparse, "sink");
+    gst_element_link_pads(dvdSubparse, "src", dvdSpu, "subpicture");
+    gst_element_link(dvdSpu, videoQueue);
+    gst_element_link(videoQueue, videoEncoder);
+    gst_element_link(videoEncoder, muxer);
+
+    gst_element_link_pads(dvdDemux, "current_video", videoDecoder, "sink");
+    g_signal_connect(G_OBJECT(videoDecoder), "no-more-pads", G_CALLBACK(linkDecodebin), dvdSpu);
+
+    gst_element_link_pads(dvdDemux, "current_audio", audioQueue, "sink");
+    gst_element_link(audioQueue, audioDecoder);
+    g_signal_connect(G_OBJECT(audioDecoder), "no-more-pads", G_CALLBACK(linkDecodebin), audioEncoder);
+    gst_element_link(audioEncoder, audioOutQueue);
+    gst_element_link(audioOutQueue, muxer);
+
+    gst_element_link(muxer, output);
+
+    return output;
+}
+
+// LPCM only comes out of decodebin2 as raw samples, which matroska takes
+// as they are, once they're in a width it knows
+static GstPad *convertRaw(GstElement *muxer, GstPad *pad)
+{
+    GstElement *convert = gst_element_factory_make("audioconvert", NULL);
+    GstPad *sinkpad;
+
+    if (!convert)
+        return NULL;
+    gst_bin_add(GST_BIN(GST_ELEMENT_PARENT(muxer)), convert);
+    sinkpad = gst_element_get_static_pad(convert, "sink");
+    gst_pad_link(pad, sinkpad);
+    gst_object_unref(sinkpad);
+    gst_element_sync_state_with_parent(convert);
+    return gst_element_get_static_pad(convert, "src");
+}
+
+static void linkToMuxer(GstElement *element, GstPad *pad, gpointer data)
+{
+    GstElement *muxer = GST_ELEMENT(data);
+    GstCaps *caps = gst_pad_get_caps(pad);
+    GstPad *srcpad = NULL;
+    GstPad *sinkpad;
+
+    if (g_str_equal(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "audio/x-raw-int"))
+        srcpad = convertRaw(muxer, pad);
+    sinkpad = gst_element_get_compatible_pad(muxer, srcpad ? srcpad : pad, NULL);
+
+    if (sinkpad) {
+        gst_pad_link(srcpad ? srcpad : pad, sinkpad);
+        gst_object_unref(sinkpad);
+    } else {
+        // Not much of an archive without it, so say so
+        gchar *description = gst_caps_to_string(caps);
+        g_warning("Can't put %s into matroska, leaving it out", description);
+        g_free(description);
+    }
+    if (srcpad)
+        gst_object_unref(srcpad);
+    gst_caps_unref(caps);
+}
+
+// What the parsers turn the demuxer's streams into. decodebin2 stops
+// plugging things in once it gets here, so it never gets to a decoder,
+// apart from LPCM, which only gets unpacked into the same samples.
+#define REMUX_CAPS "video/mpeg, mpegversion=(int)2, systemstream=(boolean)false; " \
+                   "audio/x-ac3, framed=(boolean)true; " \
+                   "audio/x-dts, framed=(boolean)true; " \
+                   "audio/mpeg, parsed=(boolean)true; " \
+                   "audio/x-raw-int"
+
+static void addParser(GstElement *pipe, GstElement *demux, const gchar *padName, GstElement *muxer)
+{
+    GstElement *queue = gst_element_factory_make("queue", NULL);
+    GstElement *parser = gst_element_factory_make("decodebin2", NULL);
+    GstCaps *caps = gst_caps_from_string(REMUX_CAPS);
+
+    g_object_set(G_OBJECT(parser), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(pipe), queue, parser, NULL);
+    gst_element_link_pads(demux, padName, queue, "sink");
+    gst_element_link(queue, parser);
+    g_signal_connect(G_OBJECT(parser), "pad-added", G_CALLBACK(linkToMuxer), muxer);
+}
+
+GstElement *rippit_dvd_remux_add(GstElement *pipe, GstElement *source)
+{
+    GstElement *dvdDemux = gst_element_factory_make("dvddemux", NULL);
+    GstElement *subpictureQueue = gst_element_factory_make("queue", NULL);
+    GstElement *muxer = gst_element_factory_make("matroskamux", NULL);
+    GstElement *output = gst_element_factory_make("filesink", NULL);
+
+    if (!dvdDemux || !muxer)
+        return NULL;
+
+    g_object_set(G_OBJECT(output), "location", "/dev/null", NULL);
+    g_object_set(G_OBJECT(muxer), "writing-app", "Rippit " RIPPIT_VERSION_STRING, NULL);
+
+    gst_bin_add_many(GST_BIN(pipe), dvdDemux, subpictureQueue, muxer, output, NULL);
+    gst_element_link(source, dvdDemux);
+
+    // At most a parser goes in front of the muxer, to frame the audio and
+    // give it caps matroska can use
+    addParser(pipe, dvdDemux, "current_video", muxer);
+    addParser(pipe, dvdDemux, "current_audio", muxer);
+
+    // Subpictures already come out of the demuxer as matroska wants them
+    gst_element_link_pads(dvdDemux, "current_subpicture", subpictureQueue, "sink");
+    gst_element_link_pads(subpictureQueue, "src", muxer, "subtitle_%d");
+
+    gst_element_link(muxer, output);
+
+    return output;
+}
+
+#define BCD(x) (((x) >> 4) * 10 + ((x) & 0x0f))
+
+static GstClockTime dvdTime(const dvd_time_t *time)
+{
+    // The top two bits of the frame count say which frame rate it's in
+    gint fps = (time->frame_u >> 6) == 1 ? 25 : 30;
+    guint64 seconds = BCD(time->hour) * 3600 + BCD(time->minute) * 60 + BCD(time->second);
+    return seconds * GST_SECOND + gst_util_uint64_scale_int(BCD(time->frame_u & 0x3f), GST_SECOND, fps);
+}
+
+static const gchar *audioFormat(guint8 format)
+{
+    switch (format) {
+        case 0:
+            return "ac3";
+        case 2:
+        case 3:
+            return "mpeg";
+        case 4:
+            return "lpcm";
+        case 6:
+            return "dts";
+    }
+    return "unknown";
+}
+
+static void setLanguage(gchar *language, guint16 code)
+{
+    language[0] = code >> 8;
+    language[1] = code & 0xff;
+    language[2] = '\0';
+}
+
+// Within an angle block only the first cell counts; the rest are the same
+// stretch of film from another angle
+static gboolean playsCell(pgc_t *pgc, gint cell)
+{
+    cell_playback_t *playback = &pgc->cell_playback[cell];
+    return playback->block_type != 1 || playback->block_mode == 1;
+}
+
+static void appendCells(RippitDvdTitle *title, pgc_t *pgc)
+{
+    gint i;
+    for (i = 0; i < pgc->nr_of_cells; i++) {
+        RippitDvdCell cell;
+        if (!playsCell(pgc, i))
+            continue;
+        cell.firstSector = pgc->cell_playback[i].first_sector;
+        cell.lastSector = pgc->cell_playback[i].last_sector;
+        g_array_append_val(title->cells, cell);
+    }
+}
+
+static void readStreams(RippitDvdTitle *title, ifo_handle_t *vts, pgc_t *pgc)
+{
+    vtsi_mat_t *mat = vts->vtsi_mat;
+    gint i;
+
+    for (i = 0; i < mat->nr_of_vts_audio_streams && i < 8; i++) {
+        RippitDvdStream stream;
+        if (!(pgc->audio_control[i] & 0x8000))
+            continue;
+        stream.index = i;
+        setLanguage(stream.language, mat->vts_audio_attr[i].lang_code);
+        stream.format = audioFormat(mat->vts_audio_attr[i].audio_format);
+        stream.channels = mat->vts_audio_attr[i].channels + 1;
+        g_array_append_val(title->audio, stream);
+    }
+    for (i = 0; i < mat->nr_of_vts_subp_streams && i < 32; i++) {
+        RippitDvdStream stream;
+        if (!(pgc->subp_control[i] & 0x80000000))
+            continue;
+        stream.index = i;
+        setLanguage(stream.language, mat->vts_subp_attr[i].lang_code);
+        stream.format = "subpicture";
+        stream.channels = 0;
+        g_array_append_val(title->subtitles, stream);
+    }
+}
+
+// Decoy titles on copy protected discs point all over the place, so every
+// index out of the IFO gets checked before it's used.
+static RippitDvdTitle *readTitle(ifo_handle_t *vts, title_info_t *info, gint number)
+{
+    RippitDvdTitle *title;
+    ttu_t *ttu;
+    pgc_t *pgc = NULL;
+    gint lastPgcn = 0;
+    GstClockTime offset = 0;
+    gint i;
+
+    if (!vts->vts_ptt_srpt || !vts->vts_pgcit || info->vts_ttn < 1 || info->vts_ttn > vts->vts_ptt_srpt->nr_of_srpts)
+        return NULL;
+    ttu = &vts->vts_ptt_srpt->title[info->vts_ttn - 1];
+
+    title = g_new0(RippitDvdTitle, 1);
+    title->title = number;
+    title->titleSet = info->title_set_nr;
+    title->angles = info->nr_of_angles;
+    title->chapters = g_array_new(FALSE, FALSE, sizeof(GstClockTime));
+    title->cells = g_array_new(FALSE, FALSE, sizeof(RippitDvdCell));
+    title->audio = g_array_new(FALSE, FALSE, sizeof(RippitDvdStream));
+    title->subtitles = g_array_new(FALSE, FALSE, sizeof(RippitDvdStream));
+
+    for (i = 0; i < ttu->nr_of_ptts; i++) {
+        ptt_info_t *ptt = &ttu->ptt[i];
+        GstClockTime start;
+        gint cell;
+
+        if (ptt->pgcn < 1 || ptt->pgcn > vts->vts_pgcit->nr_of_pgci_srp)
+            continue;
+        if (ptt->pgcn != lastPgcn) {
+            // Chapters are nearly always in one program chain, but where
+            // they aren't, the chains play one after the other
+            if (pgc)
+                offset += dvdTime(&pgc->playback_time);
+            else
+                readStreams(title, vts, vts->vts_pgcit->pgci_srp[ptt->pgcn - 1].pgc);
+            pgc = vts->vts_pgcit->pgci_srp[ptt->pgcn - 1].pgc;
+            lastPgcn = ptt->pgcn;
+            appendCells(title, pgc);
+        }
+        if (ptt->pgn < 1 || ptt->pgn > pgc->nr_of_programs)
+            continue;
+
+        start = offset;
+        for (cell = 0; cell < pgc->program_map[ptt->pgn - 1] - 1 && cell < pgc->nr_of_cells; cell++) {
+            if (playsCell(pgc, cell))
+                start += dvdTime(&pgc->cell_playback[cell].playback_time);
+        }
+        g_array_append_val(title->chapters, start);
+    }
+    if (pgc)
+        title->duration = offset + dvdTime(&pgc->playback_time);
+    return title;
+}
+
+// Two titles that play the same cells of the same title set are the same
+// film, whatever the menus say
+static gchar *cellKey(RippitDvdTitle *title)
+{
+    GString *key = g_string_new(NULL);
+    gint i;
+
+    g_string_append_printf(key, "%d:", title->titleSet);
+    for (i = 0; i < title->cells->len; i++) {
+        RippitDvdCell *cell = &g_array_index(title->cells, RippitDvdCell, i);
+        g_string_append_printf(key, "%u-%u,", cell->firstSector, cell->lastSector);
+    }
+    return g_string_free(key, FALSE);
+}
+
+void rippit_dvd_title_free(RippitDvdTitle *title)
+{
+    g_array_free(title->chapters, TRUE);
+    g_array_free(title->cells, TRUE);
+    g_array_free(title->audio, TRUE);
+    g_array_free(title->subtitles, TRUE);
+    g_free(title);
+}
+
+static GArray *copyArray(GArray *array)
+{
+    guint size = g_array_get_element_size(array);
+    GArray *copy = g_array_sized_new(FALSE, FALSE, size, array->len);
+    g_array_append_vals(copy, array->data, array->len);
+    return copy;
+}
+
+RippitDvdTitle *rippit_dvd_title_copy(const RippitDvdTitle *title)
+{
+    RippitDvdTitle *copy = g_new0(RippitDvdTitle, 1);
+
+    *copy = *title;
+    copy->chapters = copyArray(title->chapters);
+    copy->cells = copyArray(title->cells);
+    copy->audio = copyArray(title->audio);
+    copy->subtitles = copyArray(title->subtitles);
+    return copy;
+}
+
+static gchar *ifoHash(dvd_reader_t *dvd)
+{
+    unsigned char digest[16];
+    GString *hash;
+    int i;
+
+    if (DVDDiscID(dvd, digest) < 0)
+        return NULL;
+    hash = g_string_sized_new(32);
+    for (i = 0; i < 16; i++)
+        g_string_append_printf(hash, "%02x", digest[i]);
+    return g_string_free(hash, FALSE);
+}
+
+// The ISO volume name, which is what dvdnav hands out as the title string.
+// Discs without an ISO filesystem only have the UDF one.
+static gchar *volumeName(dvd_reader_t *dvd)
+{
+    char name[33];
+
+    if (DVDISOVolumeInfo(dvd, name, sizeof(name), NULL, 0) < 0 &&
+        DVDUDFVolumeInfo(dvd, name, sizeof(name), NULL, 0) < 0)
+        return NULL;
+    name[sizeof(name) - 1] = '\0';
+    return g_strchomp(g_strdup(name));
+}
+
+static GPtrArray *readTitles(dvd_reader_t *dvd, const gchar *device, gint *titleCount, GError **error)
+{
+    ifo_handle_t *vmg;
+    ifo_handle_t **titleSets;
+    GHashTable *seen;
+    GPtrArray *titles;
+    gint setCount;
+    gint i;
+
+    vmg = ifoOpen(dvd, 0);
+    if (!vmg || !vmg->tt_srpt) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not read the title table of %s", device);
+        if (vmg)
+            ifoClose(vmg);
+        return NULL;
+    }
+
+    // Each title set's IFO only gets read once, however many titles use it
+    setCount = vmg->vmgi_mat->vts_nr;
+    titleSets = g_new0(ifo_handle_t*, setCount + 1);
+    titles = g_ptr_array_new_with_free_func((GDestroyNotify)rippit_dvd_title_free);
+    seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    *titleCount = vmg->tt_srpt->nr_of_srpts;
+
+    for (i = 0; i < *titleCount; i++) {
+        title_info_t *info = &vmg->tt_srpt->title[i];
+        RippitDvdTitle *title;
+        gchar *key;
+        gpointer original;
+
+        if (info->title_set_nr < 1 || info->title_set_nr > setCount)
+            continue;
+        if (!titleSets[info->title_set_nr])
+            titleSets[info->title_set_nr] = ifoOpen(dvd, info->title_set_nr);
+        if (!titleSets[info->title_set_nr])
+            continue;
+
+        title = readTitle(titleSets[info->title_set_nr], info, i + 1);
+        if (!title)
+            continue;
+        if (title->duration == 0) {
+            GST_DEBUG("Title %d is empty", title->title);
+            rippit_dvd_title_free(title);
+            continue;
+        }
+
+        key = cellKey(title);
+        original = g_hash_table_lookup(seen, key);
+        if (original) {
+            GST_DEBUG("Title %d plays the same cells as title %d", title->title, GPOINTER_TO_INT(original));
+            rippit_dvd_title_free(title);
+            g_free(key);
+            continue;
+        }
+        g_hash_table_insert(seen, key, GINT_TO_POINTER(title->title));
+
+        GST_INFO("Title %d: %" GST_TIME_FORMAT ", %d chapters, %d cells, %d audio and %d subtitle streams",
+                 title->title, GST_TIME_ARGS(title->duration), title->chapters->len, title->cells->len,
+                 title->audio->len, title->subtitles->len);
+        g_ptr_array_add(titles, title);
+    }
+
+    for (i = 1; i <= setCount; i++) {
+        if (titleSets[i])
+            ifoClose(titleSets[i]);
+    }
+    g_free(titleSets);
+    g_hash_table_destroy(seen);
+    ifoClose(vmg);
+    return titles;
+}
+
+RippitDvdInfo *rippit_dvd_read_info(const gchar *device, GError **error)
+{
+    dvd_reader_t *dvd = DVDOpen(device);
+    RippitDvdInfo *info;
+    GError *titleError = NULL;
+
+    if (!dvd) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not open %s", device);
+        return NULL;
+    }
+
+    info = g_new0(RippitDvdInfo, 1);
+    info->name = volumeName(dvd);
+    if (!info->name)
+        info->name = g_strdup("DVD");
+    info->ifoHash = ifoHash(dvd);
+    info->titles = readTitles(dvd, device, &info->titleCount, &titleError);
+    if (!info->titles) {
+        GST_WARNING("%s", titleError->message);
+        g_error_free(titleError);
+    }
+    DVDClose(dvd);
+    return info;
+}
+
+void rippit_dvd_info_free(RippitDvdInfo *info)
+{
+    if (info->titles)
+        g_ptr_array_free(info->titles, TRUE);
+    g_free(info->name);
+    g_free(info->ifoHash);
+    g_free(info);
+}
+
+static gboolean titleDone_cb(gpointer data)
+{
+    TitleJob *job = data;
+    RippitTitlePool *pool = job->pool;
+
+    g_mutex_lock(pool->lock);
+    pool->pending--;
+    g_mutex_unlock(pool->lock);
+
+    if (pool->done)
+        pool->done(pool, job->location, job->success, pool->doneData);
+
+    if (job->title)
+        rippit_dvd_title_free(job->title);
+    g_free(job->copy);
+    g_free(job->location);
+    g_free(job);
+    return FALSE;
+}
+
+static gboolean encodeWhole(TitleJob *job)
+{
+    gboolean success = FALSE;
+    GstElement *pipe = gst_pipeline_new(NULL);
+    GstElement *source = gst_element_factory_make("filesrc", NULL);
+    GstElement *output;
+    GstBus *bus;
+    GstMessage *msg;
+
+    GST_DEBUG("Encoding %s into %s", job->copy, job->location);
+
+    g_object_set(G_OBJECT(source), "location", job->copy, NULL);
+    gst_bin_add(GST_BIN(pipe), source);
+    output = job->pool->build(pipe, source);
+    if (output) {
+        output = rippit_write_sink_replace(output, job->pool->writeBuffer, job->pool->writeStats);
+        g_object_set(G_OBJECT(output), "location", job->location, NULL);
+        if (job->pool->profile)
+            rippit_profile_watch(job->pool->profile, GST_BIN(pipe));
+        gst_element_set_state(pipe, GST_STATE_PLAYING);
+
+        bus = gst_pipeline_get_bus(GST_PIPELINE(pipe));
+        msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+        success = (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+        if (msg)
+            gst_message_unref(msg);
+        gst_object_unref(bus);
+    }
+
+    gst_element_set_state(pipe, GST_STATE_NULL);
+    gst_object_unref(pipe);
+    return success;
+}
+
+static void encodeTitle(gpointer data, gpointer user_data)
+{
+    TitleJob *job = data;
+    GArray *plan = NULL;
+    GError *error = NULL;
+
+    if (job->pool->split && job->title)
+        plan = rippit_dvd_split_plan(job->copy, job->title, sysconf(_SC_NPROCESSORS_ONLN));
+    if (plan) {
+        job->success = rippit_dvd_split_encode(job->copy, plan, job->location, job->pool->build, job->pool->profile,
+                                               job->pool->writeBuffer, job->pool->writeStats, &error);
+        if (!job->success) {
+            g_warning("%s", error->message);
+            g_error_free(error);
+            error = NULL;
+        }
+        g_array_free(plan, TRUE);
+    } else {
+        job->success = encodeWhole(job);
+    }
+
+    if (job->success && job->title && job->title->chapters->len > 1) {
+        gchar *chapters = rippit_dvd_write_chapters(job->location, job->title, &error);
+        if (chapters) {
+            g_free(chapters);
+        } else {
+            g_warning("Could not write %s's chapters: %s", job->location, error->message);
+            g_error_free(error);
+        }
+    }
+
+    // A copy that didn't encode is kept, so it can be tried again by hand
+    if (job->success)
+        g_unlink(job->copy);
+
+    g_idle_add(titleDone_cb, job);
+}
+
+RippitTitlePool *rippit_title_pool_new(gint workers, RippitDvdBuildFunc build, RippitTitleDoneFunc done, gpointer data)
+{
+    RippitTitlePool *pool = g_new0(RippitTitlePool, 1);
+
+    if (workers < 1)
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+
+    pool->lock = g_mutex_new();
+    pool->build = build;
+    pool->done = done;
+    pool->doneData = data;
+    pool->encoders = g_thread_pool_new(encodeTitle, pool, workers, FALSE, NULL);
+    GST_DEBUG("Encoding DVD titles with %d workers", workers);
+    return pool;
+}
+
+void rippit_title_pool_free(RippitTitlePool *pool)
+{
+    g_thread_pool_free(pool->encoders, FALSE, TRUE);
+    g_mutex_free(pool->lock);
+    g_free(pool);
+}
+
+guint rippit_title_pool_pending(RippitTitlePool *pool)
+{
+    guint pending;
+    g_mutex_lock(pool->lock);
+    pending = pool->pending;
+    g_mutex_unlock(pool->lock);
+    return pending;
+}
+
+void rippit_title_pool_set_profile(RippitTitlePool *pool, RippitProfile *profile)
+{
+    pool->profile = profile;
+}
+
+void rippit_title_pool_set_split(RippitTitlePool *pool, gboolean split)
+{
+    pool->split = split;
+}
+
+void rippit_title_pool_set_write_buffer(RippitTitlePool *pool, guint64 maxBytes, RippitWriteStats *stats)
+{
+    pool->writeBuffer = maxBytes;
+    pool->writeStats = stats;
+}
+
+void rippit_title_pool_add(RippitTitlePool *pool, const gchar *copy, const gchar *location, const RippitDvdTitle *title)
+{
+    TitleJob *job = g_new0(TitleJob, 1);
+
+    job->pool = pool;
+    job->copy = g_strdup(copy);
+    job->location = g_strdup(location);
+    if (title)
+        job->title = rippit_dvd_title_copy(title);
+
+    g_mutex_lock(pool->lock);
+    pool->pending++;
+    g_mutex_unlock(pool->lock);
+
+    g_thread_pool_push(pool->encoders, job, NULL);
+}
@@ -0,0 +1,112 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef DVD_H
+#define DVD_H
+
+#include <gst/gst.h>
+#include "profile.h"
+#include "writesink.h"
+
+// Builds everything that comes after the DVD source: demuxing, decoding,
+// encoding and muxing into a filesink, which is returned. The source has to
+// be in pipe already. NULL if we're missing some of the elements.
+typedef GstElement *(*RippitDvdBuildFunc)(GstElement *pipe, GstElement *source);
+
+GstElement *rippit_dvd_encoder_add(GstElement *pipe, GstElement *source);
+// Same, but the streams go into the file as they are on the disc. Nothing
+// gets decoded, so this keeps up with the drive on a fraction of a core.
+GstElement *rippit_dvd_remux_add(GstElement *pipe, GstElement *source);
+
+// An audio or subtitle stream of a title
+typedef struct {
+    gint index;
+    gchar language[3];
+    const gchar *format;
+    gint channels;
+} RippitDvdStream;
+
+// A stretch of the title's VOBs, in sectors of its title set, inclusive
+typedef struct {
+    guint32 firstSector;
+    guint32 lastSector;
+} RippitDvdCell;
+
+// One title worth ripping, as the IFO files describe it
+typedef struct {
+    // The title number dvdreadsrc wants, from 1
+    gint title;
+    gint titleSet;
+    gint angles;
+    GstClockTime duration;
+    // GstClockTime where each chapter starts
+    GArray *chapters;
+    // RippitDvdCell, in the order they're played
+    GArray *cells;
+    // RippitDvdStream
+    GArray *audio;
+    GArray *subtitles;
+} RippitDvdTitle;
+
+void rippit_dvd_title_free(RippitDvdTitle *title);
+RippitDvdTitle *rippit_dvd_title_copy(const RippitDvdTitle *title);
+
+// Everything rippit wants to know about a DVD before it starts reading,
+// from one DVDOpen
+typedef struct {
+    // The volume name, which dvdnav calls the disc's title
+    gchar *name;
+    // libdvdread's MD5 of the disc's IFO files, in hex, or NULL. Two
+    // pressings with the same name still come out different.
+    gchar *ifoHash;
+    // Every title's layout, off the IFO files. Titles with nothing in
+    // them, and titles that play the same cells as one before them, are
+    // left out. NULL if the IFOs couldn't be read.
+    GPtrArray *titles;
+    // How many titles the disc claims to have
+    gint titleCount;
+} RippitDvdInfo;
+
+RippitDvdInfo *rippit_dvd_read_info(const gchar *device, GError **error);
+void rippit_dvd_info_free(RippitDvdInfo *info);
+
+// With --copy-dvd, titles come off the disc untouched at whatever speed the
+// drive manages, and the title pool encodes the copies on a few worker
+// threads at once. The copies are deleted as soon as they've been encoded.
+typedef struct _RippitTitlePool RippitTitlePool;
+
+// Called from the main loop whenever a title has been encoded
+typedef void (*RippitTitleDoneFunc)(RippitTitlePool *pool, const gchar *location, gboolean success, gpointer data);
+
+RippitTitlePool *rippit_title_pool_new(gint workers, RippitDvdBuildFunc build, RippitTitleDoneFunc done, gpointer data);
+void rippit_title_pool_free(RippitTitlePool *pool);
+guint rippit_title_pool_pending(RippitTitlePool *pool);
+// Encodes the program stream in copy to location. title is what's on the
+// disc, for cutting the copy up and for its chapters; it can be NULL.
+void rippit_title_pool_add(RippitTitlePool *pool, const gchar *copy, const gchar *location, const RippitDvdTitle *title);
+// With split on, titles are cut up and every core works on one title at
+// once, instead of a title per worker
+void rippit_title_pool_set_split(RippitTitlePool *pool, gboolean split);
+// Encoders started from now on get profiled too
+void rippit_title_pool_set_profile(RippitTitlePool *pool, RippitProfile *profile);
+// Titles encoded from now on get written through a rippitwritesink holding
+// up to maxBytes, counted in stats, unless maxBytes is 0
+void rippit_title_pool_set_write_buffer(RippitTitlePool *pool, guint64 maxBytes, RippitWriteStats *stats);
+
+#endif // DVD_H
@@ -0,0 +1,590 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "dvdsplit.h"
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SECTOR_SIZE 2048
+// Any smaller and starting another x264 costs more than it's worth
+#define MIN_PIECE_BYTES (64 * 1024 * 1024)
+// Enough to get from one stream to the next in a piece, however the muxer
+// interleaved them
+#define READ_BUFFERS 256
+// What the joiner holds for each stream before it waits on the muxer
+#define JOIN_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+    GMutex *lock;
+    GCond *cond;
+    gint running;
+    gboolean failed;
+} Split;
+
+typedef struct {
+    Split *split;
+    const gchar *copy;
+    const gchar *location;
+    guint64 start;
+    guint64 stop;
+    gint threads;
+    RippitDvdBuildFunc build;
+    RippitProfile *profile;
+} Piece;
+
+typedef struct _Joiner Joiner;
+
+typedef struct {
+    Joiner *joiner;
+    GstElement *source;
+    GstCaps *caps;
+    gboolean full;
+} JoinStream;
+
+struct _Joiner {
+    GstElement *pipe;
+    GstElement *muxer;
+    // JoinStream, in the order the first piece's demuxer found them
+    GPtrArray *streams;
+    GMutex *lock;
+    GCond *cond;
+    gboolean failed;
+    // Where the piece being joined starts in the output
+    GstClockTime offset;
+    guint64 writeBuffer;
+    RippitWriteStats *writeStats;
+};
+
+typedef struct {
+    GstElement *pipe;
+    // appsinks, in the order the demuxer found the streams
+    GPtrArray *sinks;
+} PieceReader;
+
+static GThreadPool *encoders;
+
+static void encodePiece(gpointer data, gpointer user_data);
+
+static gpointer initOnce(gpointer data)
+{
+    gint cores = sysconf(_SC_NPROCESSORS_ONLN);
+    encoders = g_thread_pool_new(encodePiece, NULL, MAX(cores, 1), FALSE, NULL);
+    return NULL;
+}
+
+GArray *rippit_dvd_split_plan(const gchar *copy, const RippitDvdTitle *title, gint pieces)
+{
+    struct stat info;
+    GArray *plan;
+    guint64 total = 0;
+    guint64 offset = 0;
+    guint i;
+
+    if (g_stat(copy, &info) < 0)
+        return NULL;
+    for (i = 0; i < title->cells->len; i++) {
+        RippitDvdCell *cell = &g_array_index(title->cells, RippitDvdCell, i);
+        total += (guint64)(cell->lastSector - cell->firstSector + 1) * SECTOR_SIZE;
+    }
+    // dvdreadsrc reads the cells back to back, so anything else means it
+    // played the title some other way and the offsets would be wrong
+    if (total != (guint64)info.st_size) {
+        GST_WARNING("%s is %" G_GUINT64_FORMAT " bytes, but title %d's cells add up to %" G_GUINT64_FORMAT,
+                    copy, (guint64)info.st_size, title->title, total);
+        return NULL;
+    }
+
+    pieces = MIN(pieces, total / MIN_PIECE_BYTES);
+    if (pieces < 2)
+        return NULL;
+
+    plan = g_array_new(FALSE, FALSE, sizeof(guint64));
+    g_array_append_val(plan, offset);
+    for (i = 0; i < title->cells->len; i++) {
+        RippitDvdCell *cell = &g_array_index(title->cells, RippitDvdCell, i);
+        if (offset >= total * plan->len / pieces && (gint)plan->len < pieces)
+            g_array_append_val(plan, offset);
+        offset += (guint64)(cell->lastSector - cell->firstSector + 1) * SECTOR_SIZE;
+    }
+    g_array_append_val(plan, total);
+
+    // One long cell is all there is
+    if (plan->len < 3) {
+        g_array_free(plan, TRUE);
+        return NULL;
+    }
+    return plan;
+}
+
+static gboolean waitForEnd(GstElement *pipe)
+{
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipe));
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    gboolean success = (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+
+    if (msg && !success) {
+        GError *error = NULL;
+        gst_message_parse_error(msg, &error, NULL);
+        GST_WARNING("%s", error->message);
+        g_error_free(error);
+    }
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    return success;
+}
+
+// x264enc is buried in the builder's bins. With a piece on every core,
+// its own threads would only fight each other's.
+static void limitThreads(GstElement *pipe, gint threads)
+{
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipe));
+    gpointer item;
+    gboolean done = FALSE;
+
+    while (!done) {
+        switch (gst_iterator_next(it, &item)) {
+            case GST_ITERATOR_OK: {
+                GstElementFactory *factory = gst_element_get_factory(GST_ELEMENT(item));
+                if (factory && g_str_equal(GST_PLUGIN_FEATURE_NAME(factory), "x264enc"))
+                    g_object_set(G_OBJECT(item), "threads", threads, NULL);
+                gst_object_unref(item);
+                break;
+            }
+            case GST_ITERATOR_RESYNC:
+                gst_iterator_resync(it);
+                break;
+            default:
+                done = TRUE;
+                break;
+        }
+    }
+    gst_iterator_free(it);
+}
+
+static void encodePiece(gpointer data, gpointer user_data)
+{
+    Piece *piece = data;
+    Split *split = piece->split;
+    GstElement *pipe = gst_pipeline_new(NULL);
+    GstElement *source = gst_element_factory_make("filesrc", NULL);
+    GstElement *output;
+    gboolean success = FALSE;
+
+    GST_DEBUG("Encoding bytes %" G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT " of %s into %s",
+              piece->start, piece->stop, piece->copy, piece->location);
+
+    g_object_set(G_OBJECT(source), "location", piece->copy, NULL);
+    gst_bin_add(GST_BIN(pipe), source);
+    output = piece->build(pipe, source);
+    if (output) {
+        g_object_set(G_OBJECT(output), "location", piece->location, NULL);
+        limitThreads(pipe, piece->threads);
+        if (piece->profile)
+            rippit_profile_watch(piece->profile, GST_BIN(pipe));
+        // filesrc holds on to a seek until it starts, and sends EOS at the
+        // end of the piece by itself
+        gst_element_set_state(pipe, GST_STATE_READY);
+        gst_element_send_event(source, gst_event_new_seek(1.0, GST_FORMAT_BYTES, GST_SEEK_FLAG_NONE,
+                                                          GST_SEEK_TYPE_SET, piece->start,
+                                                          GST_SEEK_TYPE_SET, piece->stop));
+        gst_element_set_state(pipe, GST_STATE_PLAYING);
+        success = waitForEnd(pipe);
+    }
+
+    gst_element_set_state(pipe, GST_STATE_NULL);
+    gst_object_unref(pipe);
+
+    g_mutex_lock(split->lock);
+    if (!success)
+        split->failed = TRUE;
+    split->running--;
+    g_cond_signal(split->cond);
+    g_mutex_unlock(split->lock);
+    g_free(piece);
+}
+
+static void addSink(GstElement *demux, GstPad *pad, gpointer data)
+{
+    PieceReader *reader = data;
+    GstElement *sink = gst_element_factory_make("appsink", NULL);
+    GstPad *sinkPad;
+
+    g_object_set(G_OBJECT(sink), "sync", FALSE, "max-buffers", READ_BUFFERS, NULL);
+    gst_bin_add(GST_BIN(reader->pipe), sink);
+    sinkPad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_link(pad, sinkPad);
+    gst_object_unref(sinkPad);
+    gst_element_sync_state_with_parent(sink);
+    g_ptr_array_add(reader->sinks, sink);
+}
+
+static void closePiece(PieceReader *reader)
+{
+    gst_element_set_state(reader->pipe, GST_STATE_NULL);
+    gst_object_unref(reader->pipe);
+    g_ptr_array_free(reader->sinks, TRUE);
+    g_free(reader);
+}
+
+static PieceReader *openPiece(const gchar *location)
+{
+    PieceReader *reader = g_new0(PieceReader, 1);
+    GstElement *source = gst_element_factory_make("filesrc", NULL);
+    GstElement *demux = gst_element_factory_make("matroskademux", NULL);
+
+    reader->pipe = gst_pipeline_new(NULL);
+    reader->sinks = g_ptr_array_new();
+    g_object_set(G_OBJECT(source), "location", location, NULL);
+    gst_bin_add_many(GST_BIN(reader->pipe), source, demux, NULL);
+    gst_element_link(source, demux);
+    g_signal_connect(G_OBJECT(demux), "pad-added", G_CALLBACK(addSink), reader);
+
+    // Every stream has its sink by the time they've all prerolled
+    gst_element_set_state(reader->pipe, GST_STATE_PAUSED);
+    if (gst_element_get_state(reader->pipe, NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE ||
+        reader->sinks->len == 0) {
+        closePiece(reader);
+        return NULL;
+    }
+    gst_element_set_state(reader->pipe, GST_STATE_PLAYING);
+    return reader;
+}
+
+static void needData_cb(GstAppSrc *source, guint length, gpointer data)
+{
+    JoinStream *stream = data;
+    g_mutex_lock(stream->joiner->lock);
+    stream->full = FALSE;
+    g_cond_broadcast(stream->joiner->cond);
+    g_mutex_unlock(stream->joiner->lock);
+}
+
+static void enoughData_cb(GstAppSrc *source, gpointer data)
+{
+    JoinStream *stream = data;
+    g_mutex_lock(stream->joiner->lock);
+    stream->full = TRUE;
+    g_mutex_unlock(stream->joiner->lock);
+}
+
+// A muxer that's given up never asks for more, so an error has to wake the
+// joiner up too
+static GstBusSyncReply joinerMessage_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    Joiner *joiner = data;
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        g_mutex_lock(joiner->lock);
+        joiner->failed = TRUE;
+        g_cond_broadcast(joiner->cond);
+        g_mutex_unlock(joiner->lock);
+    }
+    return GST_BUS_PASS;
+}
+
+// Streams come out of the first piece's buffers
+static gboolean startJoiner(Joiner *joiner, GstBuffer **first, guint count, const gchar *location)
+{
+    static GstAppSrcCallbacks callbacks = { needData_cb, enoughData_cb, NULL };
+    GstElement *output = rippit_write_sink_make(joiner->writeBuffer, joiner->writeStats);
+    GstBus *bus;
+    guint i;
+
+    joiner->muxer = gst_element_factory_make("matroskamux", NULL);
+    g_object_set(G_OBJECT(joiner->muxer), "writing-app", "Rippit " RIPPIT_VERSION_STRING, NULL);
+    g_object_set(G_OBJECT(output), "location", location, NULL);
+    gst_bin_add_many(GST_BIN(joiner->pipe), joiner->muxer, output, NULL);
+    gst_element_link(joiner->muxer, output);
+
+    for (i = 0; i < count; i++) {
+        JoinStream *stream = g_new0(JoinStream, 1);
+        stream->joiner = joiner;
+        stream->source = gst_element_factory_make("appsrc", NULL);
+        stream->caps = gst_caps_ref(GST_BUFFER_CAPS(first[i]));
+        g_ptr_array_add(joiner->streams, stream);
+
+        g_object_set(G_OBJECT(stream->source), "format", GST_FORMAT_TIME, "max-bytes", (guint64)JOIN_BYTES, NULL);
+        gst_app_src_set_caps(GST_APP_SRC(stream->source), stream->caps);
+        gst_app_src_set_callbacks(GST_APP_SRC(stream->source), &callbacks, stream, NULL);
+        gst_bin_add(GST_BIN(joiner->pipe), stream->source);
+        if (!gst_element_link(stream->source, joiner->muxer)) {
+            GST_WARNING("matroskamux won't take %" GST_PTR_FORMAT, stream->caps);
+            return FALSE;
+        }
+    }
+
+    bus = gst_pipeline_get_bus(GST_PIPELINE(joiner->pipe));
+    gst_bus_set_sync_handler(bus, joinerMessage_cb, joiner);
+    gst_object_unref(bus);
+    gst_element_set_state(joiner->pipe, GST_STATE_PLAYING);
+    return TRUE;
+}
+
+static gboolean pushBuffer(Joiner *joiner, JoinStream *stream, GstBuffer *buffer)
+{
+    g_mutex_lock(joiner->lock);
+    while (stream->full && !joiner->failed)
+        g_cond_wait(joiner->cond, joiner->lock);
+    g_mutex_unlock(joiner->lock);
+
+    if (joiner->failed || gst_app_src_push_buffer(GST_APP_SRC(stream->source), buffer) != GST_FLOW_OK) {
+        joiner->failed = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// A buffer without a timestamp goes out as soon as it comes up
+static gboolean comesFirst(GstBuffer *buffer, GstBuffer *than)
+{
+    if (!GST_BUFFER_TIMESTAMP_IS_VALID(buffer))
+        return TRUE;
+    return GST_BUFFER_TIMESTAMP_IS_VALID(than) && GST_BUFFER_TIMESTAMP(buffer) < GST_BUFFER_TIMESTAMP(than);
+}
+
+// Copies one piece's streams into the muxer, in timestamp order across
+// them, moved along so the piece starts where the last one ended
+static gboolean joinPiece(Joiner *joiner, const gchar *location, gboolean first, const gchar *output)
+{
+    PieceReader *reader = openPiece(location);
+    GstBuffer **next;
+    GstClockTime base = GST_CLOCK_TIME_NONE;
+    GstClockTime end = joiner->offset;
+    gboolean success = TRUE;
+    guint count;
+    guint i;
+
+    if (!reader) {
+        GST_WARNING("Could not read %s back", location);
+        return FALSE;
+    }
+    count = reader->sinks->len;
+    if (!first && count != joiner->streams->len) {
+        GST_WARNING("%s has %u streams, but the first piece had %u", location, count, joiner->streams->len);
+        closePiece(reader);
+        return FALSE;
+    }
+
+    next = g_new0(GstBuffer*, count);
+    for (i = 0; i < count; i++) {
+        next[i] = gst_app_sink_pull_buffer(GST_APP_SINK(g_ptr_array_index(reader->sinks, i)));
+        if (!next[i] || !GST_BUFFER_CAPS(next[i]))
+            success = FALSE;
+        else if (GST_BUFFER_TIMESTAMP_IS_VALID(next[i]))
+            base = MIN(base, GST_BUFFER_TIMESTAMP(next[i]));
+    }
+    if (success && first)
+        success = startJoiner(joiner, next, count, output);
+    if (success && !GST_CLOCK_TIME_IS_VALID(base))
+        base = 0;
+
+    for (i = 0; success && i < count; i++) {
+        JoinStream *stream = g_ptr_array_index(joiner->streams, i);
+        // The same encoder settings give the same headers, but say so if
+        // something got in the way
+        if (!gst_caps_is_equal(stream->caps, GST_BUFFER_CAPS(next[i])))
+            GST_WARNING("%s's stream %u doesn't match the first piece's, joining it anyway", location, i);
+    }
+
+    while (success) {
+        JoinStream *stream;
+        GstBuffer *buffer;
+        gint pick = -1;
+
+        for (i = 0; i < count; i++) {
+            if (next[i] && (pick < 0 || comesFirst(next[i], next[pick])))
+                pick = i;
+        }
+        if (pick < 0)
+            break;
+
+        stream = g_ptr_array_index(joiner->streams, pick);
+        buffer = gst_buffer_make_metadata_writable(next[pick]);
+        if (GST_BUFFER_TIMESTAMP_IS_VALID(buffer)) {
+            GstClockTime time = GST_BUFFER_TIMESTAMP(buffer);
+            time = (time > base ? time - base : 0) + joiner->offset;
+            GST_BUFFER_TIMESTAMP(buffer) = time;
+            if (GST_BUFFER_DURATION_IS_VALID(buffer))
+                time += GST_BUFFER_DURATION(buffer);
+            end = MAX(end, time);
+        }
+        gst_buffer_set_caps(buffer, stream->caps);
+        next[pick] = NULL;
+        success = pushBuffer(joiner, stream, buffer);
+        if (success)
+            next[pick] = gst_app_sink_pull_buffer(GST_APP_SINK(g_ptr_array_index(reader->sinks, pick)));
+    }
+
+    // The demuxer stops with EOS either way, so check it didn't stop early
+    if (success) {
+        GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(reader->pipe));
+        GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+        if (msg) {
+            success = FALSE;
+            gst_message_unref(msg);
+        }
+        gst_object_unref(bus);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (next[i])
+            gst_buffer_unref(next[i]);
+    }
+    g_free(next);
+    closePiece(reader);
+
+    GST_DEBUG("%s goes from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT,
+              location, GST_TIME_ARGS(joiner->offset), GST_TIME_ARGS(end));
+    joiner->offset = end;
+    return success;
+}
+
+static gboolean joinPieces(GPtrArray *locations, const gchar *location, guint64 writeBuffer, RippitWriteStats *writeStats, GError **error)
+{
+    Joiner joiner;
+    gboolean success = TRUE;
+    guint i;
+
+    memset(&joiner, 0, sizeof(joiner));
+    joiner.pipe = gst_pipeline_new(NULL);
+    joiner.streams = g_ptr_array_new();
+    joiner.lock = g_mutex_new();
+    joiner.cond = g_cond_new();
+    joiner.writeBuffer = writeBuffer;
+    joiner.writeStats = writeStats;
+
+    for (i = 0; success && i < locations->len; i++)
+        success = joinPiece(&joiner, g_ptr_array_index(locations, i), i == 0, location);
+
+    if (success) {
+        for (i = 0; i < joiner.streams->len; i++) {
+            JoinStream *stream = g_ptr_array_index(joiner.streams, i);
+            gst_app_src_end_of_stream(GST_APP_SRC(stream->source));
+        }
+        success = waitForEnd(joiner.pipe);
+    }
+    if (!success) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not join the pieces of %s", location);
+        g_unlink(location);
+    }
+
+    gst_element_set_state(joiner.pipe, GST_STATE_NULL);
+    gst_object_unref(joiner.pipe);
+    for (i = 0; i < joiner.streams->len; i++) {
+        JoinStream *stream = g_ptr_array_index(joiner.streams, i);
+        gst_caps_unref(stream->caps);
+        g_free(stream);
+    }
+    g_ptr_array_free(joiner.streams, TRUE);
+    g_mutex_free(joiner.lock);
+    g_cond_free(joiner.cond);
+    return success;
+}
+
+gboolean rippit_dvd_split_encode(const gchar *copy, GArray *plan, const gchar *location, RippitDvdBuildFunc build, RippitProfile *profile,
+                                 guint64 writeBuffer, RippitWriteStats *writeStats, GError **error)
+{
+    static GOnce once = G_ONCE_INIT;
+    gint cores = sysconf(_SC_NPROCESSORS_ONLN);
+    gint pieces = plan->len - 1;
+    GPtrArray *locations = g_ptr_array_new();
+    gboolean success;
+    Split split;
+    gint i;
+
+    g_once(&once, initOnce, NULL);
+
+    GST_INFO("Encoding %s in %d pieces", copy, pieces);
+    split.lock = g_mutex_new();
+    split.cond = g_cond_new();
+    split.running = pieces;
+    split.failed = FALSE;
+
+    for (i = 0; i < pieces; i++) {
+        Piece *piece = g_new0(Piece, 1);
+        gchar *pieceLocation = g_strdup_printf("%s.%d.mkv", copy, i + 1);
+        g_ptr_array_add(locations, pieceLocation);
+
+        piece->split = &split;
+        piece->copy = copy;
+        piece->location = pieceLocation;
+        piece->start = g_array_index(plan, guint64, i);
+        piece->stop = g_array_index(plan, guint64, i + 1);
+        piece->threads = MAX(cores / pieces, 1);
+        piece->build = build;
+        piece->profile = profile;
+        g_thread_pool_push(encoders, piece, NULL);
+    }
+
+    g_mutex_lock(split.lock);
+    while (split.running > 0)
+        g_cond_wait(split.cond, split.lock);
+    g_mutex_unlock(split.lock);
+
+    if (split.failed) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not encode every piece of %s", copy);
+        success = FALSE;
+    } else {
+        success = joinPieces(locations, location, writeBuffer, writeStats, error);
+    }
+
+    for (i = 0; i < pieces; i++) {
+        g_unlink(g_ptr_array_index(locations, i));
+        g_free(g_ptr_array_index(locations, i));
+    }
+    g_ptr_array_free(locations, TRUE);
+    g_mutex_free(split.lock);
+    g_cond_free(split.cond);
+    return success;
+}
+
+gchar *rippit_dvd_write_chapters(const gchar *location, const RippitDvdTitle *title, GError **error)
+{
+    GString *chapters = g_string_new(NULL);
+    gchar *base;
+    gchar *name;
+    guint i;
+
+    if (g_str_has_suffix(location, ".mkv"))
+        base = g_strndup(location, strlen(location) - strlen(".mkv"));
+    else
+        base = g_strdup(location);
+    name = g_strconcat(base, ".chapters.txt", NULL);
+    g_free(base);
+
+    for (i = 0; i < title->chapters->len; i++) {
+        guint64 ms = g_array_index(title->chapters, GstClockTime, i) / GST_MSECOND;
+        g_string_append_printf(chapters, "CHAPTER%02u=%02u:%02u:%02u.%03u\n",
+                               i + 1, (guint)(ms / 3600000), (guint)(ms / 60000 % 60),
+                               (guint)(ms / 1000 % 60), (guint)(ms % 1000));
+        g_string_append_printf(chapters, "CHAPTER%02uNAME=Chapter %u\n", i + 1, i + 1);
+    }
+
+    if (!g_file_set_contents(name, chapters->str, chapters->len, error)) {
+        g_free(name);
+        name = NULL;
+    }
+    g_string_free(chapters, TRUE);
+    return name;
+}
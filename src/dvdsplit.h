@@ -0,0 +1,49 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef DVDSPLIT_H
+#define DVDSPLIT_H
+
+#include "dvd.h"
+
+// One long title is one x264 instance, which runs out of threads to keep
+// busy well before a big machine runs out of cores. A title that's been
+// copied to disk can be cut up instead: every cell starts on a fresh GOP,
+// so pieces cut where cells start decode on their own. The pieces encode
+// at once, and get joined back up by remuxing, which doesn't touch the
+// video.
+
+// Byte offsets into copy where each piece starts, with the end of the copy
+// on the end, so there's one piece fewer than there are offsets. Aims for
+// pieces pieces of about the same size, fewer if the title's short or has
+// few cells. NULL if there's no point cutting it up, or if copy isn't laid
+// out the way the title's cells say it should be; either way it gets
+// encoded whole.
+GArray *rippit_dvd_split_plan(const gchar *copy, const RippitDvdTitle *title, gint pieces);
+// Encodes each piece of copy with build, all at once, and joins them into
+// location, through a write buffer of writeBuffer bytes if that isn't 0
+// (see rippit_write_sink_make()). profile and writeStats can be NULL.
+gboolean rippit_dvd_split_encode(const gchar *copy, GArray *plan, const gchar *location, RippitDvdBuildFunc build, RippitProfile *profile,
+                                 guint64 writeBuffer, RippitWriteStats *writeStats, GError **error);
+// Matroska in GStreamer 0.10 can't carry chapters, so they're written next
+// to location instead, the way mkvmerge --chapters and mkvpropedit
+// --chapters read them. Returns the file's name, or NULL.
+gchar *rippit_dvd_write_chapters(const gchar *location, const RippitDvdTitle *title, GError **error);
+
+#endif // DVDSPLIT_H
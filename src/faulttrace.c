@@ -0,0 +1,163 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "faulttrace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEFAULT_TRANSPORT_DELAY 100
+
+typedef struct {
+    gint first;
+    gint last;
+    gchar type[16];
+    gint value;
+    gboolean hasValue;
+} FaultRange;
+
+struct _RippitFaultTrace {
+    // FaultRange, in the order they're in the trace, which is the order
+    // they're applied in
+    GArray *ranges;
+    RippitSectorFault everywhere;
+    // The last lookup, and the sectors the same ranges cover. Reads go
+    // front to back, so it's only worked out again where a range starts
+    // or ends.
+    RippitSectorFault cached;
+    gint cachedFirst;
+    gint cachedLast;
+};
+
+static gboolean parseRange(const gchar *range, gint *first, gint *last)
+{
+    if (strcmp(range, "*") == 0) {
+        *first = *last = -1;
+        return TRUE;
+    }
+    if (sscanf(range, "%d-%d", first, last) == 2)
+        return *first >= 0 && *last >= *first;
+    if (sscanf(range, "%d", first) == 1) {
+        *last = *first;
+        return *first >= 0;
+    }
+    return FALSE;
+}
+
+static void applyFault(RippitSectorFault *fault, const gchar *type, gint value, gboolean hasValue)
+{
+    if (strcmp(type, "latency") == 0) {
+        fault->latency = value;
+    } else if (strcmp(type, "transport") == 0) {
+        fault->transport = TRUE;
+        fault->transportDelay = hasValue ? value : DEFAULT_TRANSPORT_DELAY;
+    } else if (strcmp(type, "unrecoverable") == 0) {
+        fault->unrecoverable = TRUE;
+    } else {
+        fault->hang = hasValue ? value : -1;
+    }
+}
+
+RippitFaultTrace *rippit_fault_trace_load(const gchar *location, GError **error)
+{
+    RippitFaultTrace *trace;
+    gchar *contents;
+    gchar **lines;
+    int i;
+
+    if (!g_file_get_contents(location, &contents, NULL, error))
+        return NULL;
+    lines = g_strsplit(contents, "\n", 0);
+    g_free(contents);
+
+    trace = g_new0(RippitFaultTrace, 1);
+    trace->ranges = g_array_new(FALSE, FALSE, sizeof(FaultRange));
+    trace->cachedFirst = 1;
+    trace->cachedLast = 0;
+
+    for (i = 0; lines[i]; i++) {
+        gchar *line = g_strstrip(lines[i]);
+        gchar type[16];
+        gchar range[32];
+        gint value = 0;
+        gint fields, first, last;
+        FaultRange fault;
+
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+        fields = sscanf(line, "%15s %31s %d", type, range, &value);
+        if (fields < 2 || !parseRange(range, &first, &last) || value < 0 ||
+            (strcmp(type, "latency") == 0 && fields < 3) ||
+            (strcmp(type, "latency") != 0 && strcmp(type, "transport") != 0 &&
+             strcmp(type, "unrecoverable") != 0 && strcmp(type, "hang") != 0)) {
+            g_set_error(error, RIPPIT_ERROR, 0, "%s:%d: can't make sense of '%s'", location, i + 1, line);
+            g_strfreev(lines);
+            rippit_fault_trace_free(trace);
+            return NULL;
+        }
+
+        if (first < 0) {
+            applyFault(&trace->everywhere, type, value, fields == 3);
+            continue;
+        }
+        fault.first = first;
+        fault.last = last;
+        g_strlcpy(fault.type, type, sizeof(fault.type));
+        fault.value = value;
+        fault.hasValue = fields == 3;
+        g_array_append_val(trace->ranges, fault);
+    }
+    g_strfreev(lines);
+
+    GST_DEBUG("Loaded %d faulty ranges from %s", trace->ranges->len, location);
+    return trace;
+}
+
+void rippit_fault_trace_free(RippitFaultTrace *trace)
+{
+    g_array_free(trace->ranges, TRUE);
+    g_free(trace);
+}
+
+const RippitSectorFault *rippit_fault_trace_lookup(RippitFaultTrace *trace, gint sector)
+{
+    guint i;
+
+    if (sector >= trace->cachedFirst && sector <= trace->cachedLast)
+        return &trace->cached;
+
+    // Whatever * says, with the sector's own faults on top
+    trace->cached = trace->everywhere;
+    trace->cachedFirst = 0;
+    trace->cachedLast = G_MAXINT;
+    for (i = 0; i < trace->ranges->len; i++) {
+        FaultRange *range = &g_array_index(trace->ranges, FaultRange, i);
+        if (sector < range->first) {
+            trace->cachedLast = MIN(trace->cachedLast, range->first - 1);
+        } else if (sector > range->last) {
+            trace->cachedFirst = MAX(trace->cachedFirst, range->last + 1);
+        } else {
+            applyFault(&trace->cached, range->type, range->value, range->hasValue);
+            trace->cachedFirst = MAX(trace->cachedFirst, range->first);
+            trace->cachedLast = MIN(trace->cachedLast, range->last);
+        }
+    }
+    return &trace->cached;
+}
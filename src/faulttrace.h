@@ -0,0 +1,57 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef FAULTTRACE_H
+#define FAULTTRACE_H
+
+#include <glib.h>
+
+// A script of how a bad drive behaves, for rippitimagesrc to act out so the
+// stall and error handling can be tried without ruining a disc. One fault
+// per line, for a sector, a range of them, or * for every sector:
+//
+//   # comment
+//   latency 0-1000 20       every read takes 20ms
+//   transport 5000-5010 200 transport error, then the read works after 200ms
+//   unrecoverable 6000      uncorrected error, the sector comes back silent
+//   hang 9000 30            the read doesn't come back for 30s
+//   hang 9500               ...or until the pipeline is stopped
+//
+// Sectors count from the start of the image, same as the error signals.
+
+typedef struct {
+    // Milliseconds
+    guint latency;
+    gboolean transport;
+    guint transportDelay;
+    gboolean unrecoverable;
+    // Seconds, or -1 for forever
+    gint hang;
+} RippitSectorFault;
+
+typedef struct _RippitFaultTrace RippitFaultTrace;
+
+RippitFaultTrace *rippit_fault_trace_load(const gchar *location, GError **error);
+void rippit_fault_trace_free(RippitFaultTrace *trace);
+// Never NULL. Every sector gets whatever * says, and its own faults on top
+// of that. Only good until the next lookup, and only one thread should be
+// looking things up.
+const RippitSectorFault *rippit_fault_trace_lookup(RippitFaultTrace *trace, gint sector);
+
+#endif // FAULTTRACE_H
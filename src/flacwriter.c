@@ -0,0 +1,601 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "flacwriter.h"
+#include "util.h"
+
+#include <FLAC/stream_encoder.h>
+#include <gst/tag/tag.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE 44100
+// Both channels of a 16 bit sample
+#define BYTES_PER_SAMPLE 4
+// flacenc's default, and what libFLAC picks at level 5 anyway
+#define BLOCK_SIZE 4096
+// About three seconds of audio, which is enough work per group that
+// handing it to another thread is lost in the noise
+#define GROUP_FRAMES 32
+#define GROUP_BYTES (BLOCK_SIZE * GROUP_FRAMES * BYTES_PER_SAMPLE)
+
+// Room is made in the seek table for this many points, since we can't
+// know how long the audio is until it's all been written. They go every
+// ten seconds, or further apart if that's too many.
+#define SEEK_POINTS 512
+#define SEEK_INTERVAL (10 * SAMPLE_RATE)
+
+#define STREAMINFO_LENGTH 34
+#define SEEKPOINT_LENGTH 18
+// Past "fLaC" and the STREAMINFO block header
+#define STREAMINFO_OFFSET 8
+#define SEEKTABLE_OFFSET (STREAMINFO_OFFSET + STREAMINFO_LENGTH + 4)
+
+typedef struct {
+    RippitFlacWriter *writer;
+    guint64 firstFrame;
+    guint8 *pcm;
+    gsize length;
+    // What the encoder made of it, renumbered to where it goes in the file
+    GByteArray *frames;
+    GArray *frameSizes;
+    gboolean done;
+    gboolean failed;
+} FrameGroup;
+
+struct _RippitFlacWriter {
+    gchar *location;
+    // What gets written until finish() renames it to location
+    gchar *partLocation;
+    int fd;
+    guint threads;
+    // Groups with the encoders, oldest first, and whether any went wrong
+    GMutex *lock;
+    GCond *cond;
+    GQueue groups;
+    gboolean failed;
+    // The group write() is filling up
+    FrameGroup *filling;
+    guint64 nextFrame;
+    GChecksum *md5;
+    guint64 samples;
+    // Where each frame went, counting from the first one
+    GArray *frameOffsets;
+    guint64 written;
+    guint32 minFrame;
+    guint32 maxFrame;
+    gboolean finished;
+};
+
+static GThreadPool *encoders;
+static guint8 crc8Table[256];
+static guint16 crc16Table[256];
+
+static void encodeGroup(gpointer data, gpointer user_data);
+
+static gpointer initOnce(gpointer data)
+{
+    gint cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, bit;
+
+    for (i = 0; i < 256; i++) {
+        guint8 crc8 = i;
+        guint16 crc16 = i << 8;
+        for (bit = 0; bit < 8; bit++) {
+            crc8 = (crc8 & 0x80) ? (crc8 << 1) ^ 0x07 : crc8 << 1;
+            crc16 = (crc16 & 0x8000) ? (crc16 << 1) ^ 0x8005 : crc16 << 1;
+        }
+        crc8Table[i] = crc8;
+        crc16Table[i] = crc16;
+    }
+    encoders = g_thread_pool_new(encodeGroup, NULL, MAX(cores, 1), FALSE, NULL);
+    return NULL;
+}
+
+static guint8 crc8(const guint8 *data, gsize length)
+{
+    guint8 crc = 0;
+    while (length--)
+        crc = crc8Table[crc ^ *data++];
+    return crc;
+}
+
+static guint16 crc16(const guint8 *data, gsize length)
+{
+    guint16 crc = 0;
+    while (length--)
+        crc = (crc << 8) ^ crc16Table[(crc >> 8) ^ *data++];
+    return crc;
+}
+
+// Frame numbers go in the header UTF-8 style, stretched out to 36 bits
+static gsize putFrameNumber(guint8 *out, guint64 number)
+{
+    gsize length;
+    gsize i;
+
+    if (number < 0x80) {
+        out[0] = number;
+        return 1;
+    }
+    for (length = 2; length < 7 && number >= (G_GUINT64_CONSTANT(1) << (5 * length + 1)); length++)
+        ;
+    for (i = length - 1; i > 0; i--) {
+        out[i] = 0x80 | (number & 0x3f);
+        number >>= 6;
+    }
+    out[0] = (0xff << (8 - length)) | number;
+    return length;
+}
+
+static gsize frameNumberLength(guint8 first)
+{
+    gsize length = 0;
+
+    if (!(first & 0x80))
+        return 1;
+    while (length < 8 && (first & (0x80 >> length)))
+        length++;
+    return length;
+}
+
+// Copies a frame the encoder numbered from the start of its group, with
+// the number it has in the whole file. Both CRCs cover the number, so they
+// get worked out again too.
+static gboolean renumberFrame(GByteArray *out, const guint8 *frame, gsize length, guint64 number)
+{
+    guint8 header[16];
+    gsize headerLength;
+    gsize numberLength;
+    gsize extra;
+    gsize oldLength;
+    guint start = out->len;
+    guint16 crc;
+    guint8 crcBytes[2];
+
+    if (length < 8 || frame[0] != 0xff || (frame[1] & 0xfe) != 0xf8)
+        return FALSE;
+    numberLength = frameNumberLength(frame[4]);
+    // Odd block sizes and sample rates are tacked on after the number
+    extra = ((frame[2] >> 4) == 6 ? 1 : (frame[2] >> 4) == 7 ? 2 : 0) +
+            ((frame[2] & 0xf) == 12 ? 1 : ((frame[2] & 0xf) == 13 || (frame[2] & 0xf) == 14) ? 2 : 0);
+    oldLength = 4 + numberLength + extra + 1;
+    if (numberLength > 7 || length < oldLength + 2)
+        return FALSE;
+
+    memcpy(header, frame, 4);
+    headerLength = 4 + putFrameNumber(header + 4, number);
+    memcpy(header + headerLength, frame + 4 + numberLength, extra);
+    headerLength += extra;
+    header[headerLength] = crc8(header, headerLength);
+    headerLength++;
+
+    g_byte_array_append(out, header, headerLength);
+    g_byte_array_append(out, frame + oldLength, length - oldLength - 2);
+    crc = crc16(out->data + start, out->len - start);
+    crcBytes[0] = crc >> 8;
+    crcBytes[1] = crc & 0xff;
+    g_byte_array_append(out, crcBytes, 2);
+    return TRUE;
+}
+
+static FLAC__StreamEncoderWriteStatus collectFrame_cb(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned frame, void *data)
+{
+    FrameGroup *group = data;
+    guint before = group->frames->len;
+    guint32 size;
+
+    // The group's own fLaC and STREAMINFO; the file has its own
+    if (samples == 0)
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    if (!renumberFrame(group->frames, buffer, bytes, group->firstFrame + frame)) {
+        GST_WARNING("libFLAC wrote a frame we can't make sense of");
+        group->failed = TRUE;
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    }
+    size = group->frames->len - before;
+    g_array_append_val(group->frameSizes, size);
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static gboolean setupEncoder(FLAC__StreamEncoder *encoder, FrameGroup *group)
+{
+    return FLAC__stream_encoder_set_channels(encoder, 2) &&
+           FLAC__stream_encoder_set_bits_per_sample(encoder, 16) &&
+           FLAC__stream_encoder_set_sample_rate(encoder, SAMPLE_RATE) &&
+           FLAC__stream_encoder_set_compression_level(encoder, 5) &&
+           // After the level, which sets a block size of its own
+           FLAC__stream_encoder_set_blocksize(encoder, BLOCK_SIZE) &&
+           FLAC__stream_encoder_set_do_md5(encoder, FALSE) &&
+           FLAC__stream_encoder_init_stream(encoder, collectFrame_cb, NULL, NULL, NULL, group) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+}
+
+// On the pool
+static void encodeGroup(gpointer data, gpointer user_data)
+{
+    FrameGroup *group = data;
+    RippitFlacWriter *writer = group->writer;
+    FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+    gsize samples = group->length / BYTES_PER_SAMPLE;
+    FLAC__int32 *wide = g_new(FLAC__int32, samples * 2);
+    const gint16 *pcm = (const gint16*)group->pcm;
+    gboolean ok = FALSE;
+    gsize i;
+
+    for (i = 0; i < samples * 2; i++)
+        wide[i] = GINT16_FROM_LE(pcm[i]);
+    g_free(group->pcm);
+    group->pcm = NULL;
+
+    if (encoder && setupEncoder(encoder, group)) {
+        ok = FLAC__stream_encoder_process_interleaved(encoder, wide, samples);
+        ok = FLAC__stream_encoder_finish(encoder) && ok;
+    }
+    if (encoder)
+        FLAC__stream_encoder_delete(encoder);
+    g_free(wide);
+
+    g_mutex_lock(writer->lock);
+    group->done = TRUE;
+    if (!ok || group->failed)
+        writer->failed = TRUE;
+    g_cond_broadcast(writer->cond);
+    g_mutex_unlock(writer->lock);
+}
+
+static void freeGroup(FrameGroup *group)
+{
+    g_free(group->pcm);
+    g_byte_array_free(group->frames, TRUE);
+    g_array_free(group->frameSizes, TRUE);
+    g_free(group);
+}
+
+static gboolean writeGroup(RippitFlacWriter *writer, FrameGroup *group)
+{
+    guint i;
+
+    if (!rippit_write_all(writer->fd, group->frames->data, group->frames->len, -1)) {
+        GST_WARNING("Could not write to %s: %s", writer->location, g_strerror(errno));
+        return FALSE;
+    }
+    for (i = 0; i < group->frameSizes->len; i++) {
+        guint32 size = g_array_index(group->frameSizes, guint32, i);
+        g_array_append_val(writer->frameOffsets, writer->written);
+        writer->written += size;
+        writer->minFrame = writer->minFrame ? MIN(writer->minFrame, size) : size;
+        writer->maxFrame = MAX(writer->maxFrame, size);
+    }
+    return TRUE;
+}
+
+// Writes out the groups at the front that are done, waiting on them while
+// there are more than `keep` with the encoders
+static gboolean drain(RippitFlacWriter *writer, guint keep)
+{
+    FrameGroup *head;
+    gboolean ok = TRUE;
+
+    for (;;) {
+        g_mutex_lock(writer->lock);
+        head = g_queue_peek_head(&writer->groups);
+        while (head && !head->done && g_queue_get_length(&writer->groups) > keep)
+            g_cond_wait(writer->cond, writer->lock);
+        if (!head || !head->done) {
+            ok = ok && !writer->failed;
+            g_mutex_unlock(writer->lock);
+            return ok;
+        }
+        g_queue_pop_head(&writer->groups);
+        ok = ok && !writer->failed;
+        g_mutex_unlock(writer->lock);
+
+        if (ok && !writeGroup(writer, head))
+            ok = FALSE;
+        freeGroup(head);
+        if (!ok) {
+            g_mutex_lock(writer->lock);
+            writer->failed = TRUE;
+            g_mutex_unlock(writer->lock);
+        }
+    }
+}
+
+static gboolean submitGroup(RippitFlacWriter *writer)
+{
+    FrameGroup *group = writer->filling;
+
+    writer->filling = NULL;
+    if (!drain(writer, writer->threads - 1)) {
+        freeGroup(group);
+        return FALSE;
+    }
+    g_mutex_lock(writer->lock);
+    g_queue_push_tail(&writer->groups, group);
+    g_mutex_unlock(writer->lock);
+    g_thread_pool_push(encoders, group, NULL);
+    return TRUE;
+}
+
+static FrameGroup *newGroup(RippitFlacWriter *writer)
+{
+    FrameGroup *group = g_new0(FrameGroup, 1);
+
+    group->writer = writer;
+    group->firstFrame = writer->nextFrame;
+    group->pcm = g_malloc(GROUP_BYTES);
+    group->frames = g_byte_array_new();
+    group->frameSizes = g_array_new(FALSE, FALSE, sizeof(guint32));
+    writer->nextFrame += GROUP_FRAMES;
+    return group;
+}
+
+static void putBlockHeader(GByteArray *out, gboolean last, guint8 type, guint32 length)
+{
+    guint8 header[4];
+
+    header[0] = (last ? 0x80 : 0) | type;
+    header[1] = length >> 16;
+    header[2] = length >> 8;
+    header[3] = length;
+    g_byte_array_append(out, header, 4);
+}
+
+static void putLE32(GByteArray *out, guint32 value)
+{
+    value = GUINT32_TO_LE(value);
+    g_byte_array_append(out, (guint8*)&value, 4);
+}
+
+static void collectComments(const GstTagList *tags, const gchar *tag, gpointer data)
+{
+    GList *comments = gst_tag_to_vorbis_comments(tags, tag);
+    GList *cur;
+
+    for (cur = comments; cur; cur = cur->next)
+        g_ptr_array_add(data, cur->data);
+    g_list_free(comments);
+}
+
+// STREAMINFO and the seek table are placeholders until finish()
+static GByteArray *buildHeaders(const GstTagList *tags)
+{
+    GByteArray *out = g_byte_array_new();
+    GPtrArray *comments = g_ptr_array_new();
+    const gchar *vendor = "rippit " RIPPIT_VERSION_STRING;
+    guint8 placeholder[SEEKPOINT_LENGTH];
+    guint32 commentLength;
+    guint i;
+
+    if (tags)
+        gst_tag_list_foreach(tags, collectComments, comments);
+
+    g_byte_array_append(out, (const guint8*)"fLaC", 4);
+    putBlockHeader(out, FALSE, 0, STREAMINFO_LENGTH);
+    g_byte_array_set_size(out, out->len + STREAMINFO_LENGTH);
+
+    putBlockHeader(out, FALSE, 3, SEEK_POINTS * SEEKPOINT_LENGTH);
+    memset(placeholder, 0, sizeof(placeholder));
+    memset(placeholder, 0xff, 8);
+    for (i = 0; i < SEEK_POINTS; i++)
+        g_byte_array_append(out, placeholder, sizeof(placeholder));
+
+    commentLength = 4 + strlen(vendor) + 4;
+    for (i = 0; i < comments->len; i++)
+        commentLength += 4 + strlen(g_ptr_array_index(comments, i));
+    putBlockHeader(out, TRUE, 4, commentLength);
+    putLE32(out, strlen(vendor));
+    g_byte_array_append(out, (const guint8*)vendor, strlen(vendor));
+    putLE32(out, comments->len);
+    for (i = 0; i < comments->len; i++) {
+        gchar *comment = g_ptr_array_index(comments, i);
+        putLE32(out, strlen(comment));
+        g_byte_array_append(out, (const guint8*)comment, strlen(comment));
+        g_free(comment);
+    }
+    g_ptr_array_free(comments, TRUE);
+    return out;
+}
+
+RippitFlacWriter *rippit_flac_writer_new(const gchar *location, const GstTagList *tags, gint threads, GError **error)
+{
+    static GOnce once = G_ONCE_INIT;
+    RippitFlacWriter *writer;
+    GByteArray *headers;
+    gchar *partLocation;
+    int fd;
+
+    g_once(&once, initOnce, NULL);
+
+    partLocation = rippit_part_name(location);
+    fd = open(partLocation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not create %s: %s", partLocation, g_strerror(errno));
+        g_free(partLocation);
+        return NULL;
+    }
+    headers = buildHeaders(tags);
+    if (!rippit_write_all(fd, headers->data, headers->len, -1)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not write to %s: %s", location, g_strerror(errno));
+        g_byte_array_free(headers, TRUE);
+        close(fd);
+        g_unlink(partLocation);
+        g_free(partLocation);
+        return NULL;
+    }
+    g_byte_array_free(headers, TRUE);
+
+    if (threads < 1)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    writer = g_new0(RippitFlacWriter, 1);
+    writer->location = g_strdup(location);
+    writer->partLocation = partLocation;
+    writer->fd = fd;
+    writer->threads = MAX(threads, 1);
+    writer->lock = g_mutex_new();
+    writer->cond = g_cond_new();
+    g_queue_init(&writer->groups);
+    writer->md5 = g_checksum_new(G_CHECKSUM_MD5);
+    writer->frameOffsets = g_array_new(FALSE, FALSE, sizeof(guint64));
+    return writer;
+}
+
+gboolean rippit_flac_writer_write(RippitFlacWriter *writer, const guint8 *data, gsize length)
+{
+    // FLAC's MD5 is of the samples as little endian, which CDDA already is
+    g_checksum_update(writer->md5, data, length);
+    writer->samples += length / BYTES_PER_SAMPLE;
+
+    while (length > 0) {
+        gsize take;
+
+        if (!writer->filling)
+            writer->filling = newGroup(writer);
+        take = MIN(length, GROUP_BYTES - writer->filling->length);
+        memcpy(writer->filling->pcm + writer->filling->length, data, take);
+        writer->filling->length += take;
+        data += take;
+        length -= take;
+        if (writer->filling->length == GROUP_BYTES && !submitGroup(writer))
+            return FALSE;
+    }
+    return drain(writer, writer->threads);
+}
+
+static void putBE(guint8 *out, guint64 value, gsize bytes)
+{
+    while (bytes--) {
+        out[bytes] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+static gboolean writeStreamInfo(RippitFlacWriter *writer)
+{
+    guint8 info[STREAMINFO_LENGTH];
+    gsize digestLength = 16;
+
+    putBE(info, BLOCK_SIZE, 2);
+    putBE(info + 2, BLOCK_SIZE, 2);
+    putBE(info + 4, writer->minFrame, 3);
+    putBE(info + 7, writer->maxFrame, 3);
+    // 20 bits of sample rate, 3 of channels - 1, 5 of bits per sample - 1
+    // and 36 of total samples
+    putBE(info + 10, ((guint64)SAMPLE_RATE << 44) | (G_GUINT64_CONSTANT(1) << 41) | (G_GUINT64_CONSTANT(15) << 36) | (writer->samples & G_GUINT64_CONSTANT(0xfffffffff)), 8);
+    g_checksum_get_digest(writer->md5, info + 18, &digestLength);
+    return rippit_write_all(writer->fd, info, sizeof(info), STREAMINFO_OFFSET);
+}
+
+static gboolean writeSeekTable(RippitFlacWriter *writer)
+{
+    guint8 table[SEEK_POINTS * SEEKPOINT_LENGTH];
+    guint64 interval = MAX(SEEK_INTERVAL, (writer->samples + SEEK_POINTS - 1) / SEEK_POINTS);
+    guint64 target;
+    gint64 lastFrame = -1;
+    guint points = 0;
+    guint i;
+
+    for (target = 0; target < writer->samples && points < SEEK_POINTS; target += interval) {
+        guint64 frame = target / BLOCK_SIZE;
+        guint8 *point = table + points * SEEKPOINT_LENGTH;
+
+        if ((gint64)frame == lastFrame || frame >= writer->frameOffsets->len)
+            continue;
+        putBE(point, frame * BLOCK_SIZE, 8);
+        putBE(point + 8, g_array_index(writer->frameOffsets, guint64, frame), 8);
+        putBE(point + 16, MIN(BLOCK_SIZE, writer->samples - frame * BLOCK_SIZE), 2);
+        lastFrame = frame;
+        points++;
+    }
+    // The rest stay placeholders, which players skip
+    for (i = points; i < SEEK_POINTS; i++) {
+        guint8 *point = table + i * SEEKPOINT_LENGTH;
+        memset(point, 0xff, 8);
+        memset(point + 8, 0, SEEKPOINT_LENGTH - 8);
+    }
+    return rippit_write_all(writer->fd, table, sizeof(table), SEEKTABLE_OFFSET);
+}
+
+gboolean rippit_flac_writer_finish(RippitFlacWriter *writer, GError **error)
+{
+    if (writer->filling && !submitGroup(writer)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not encode %s", writer->location);
+        return FALSE;
+    }
+    if (!drain(writer, 0)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not encode %s", writer->location);
+        return FALSE;
+    }
+    if (!writeStreamInfo(writer) || !writeSeekTable(writer)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not write to %s: %s", writer->location, g_strerror(errno));
+        return FALSE;
+    }
+    // Synced before the rename, so location is never a file that's only
+    // partly on disk
+    if (fdatasync(writer->fd) < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not write to %s: %s", writer->location, g_strerror(errno));
+        return FALSE;
+    }
+    if (close(writer->fd) < 0) {
+        writer->fd = -1;
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not write to %s: %s", writer->location, g_strerror(errno));
+        return FALSE;
+    }
+    writer->fd = -1;
+    if (g_rename(writer->partLocation, writer->location) < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not move %s into place: %s", writer->location, g_strerror(errno));
+        return FALSE;
+    }
+    writer->finished = TRUE;
+    GST_DEBUG("Wrote %s: %" G_GUINT64_FORMAT " samples in %d frames", writer->location, writer->samples, writer->frameOffsets->len);
+    return TRUE;
+}
+
+void rippit_flac_writer_free(RippitFlacWriter *writer)
+{
+    FrameGroup *group;
+
+    // Whatever's still with the encoders has to come back before anything
+    // it points at goes away
+    g_mutex_lock(writer->lock);
+    while ((group = g_queue_pop_head(&writer->groups))) {
+        while (!group->done)
+            g_cond_wait(writer->cond, writer->lock);
+        freeGroup(group);
+    }
+    g_mutex_unlock(writer->lock);
+
+    if (writer->filling)
+        freeGroup(writer->filling);
+    if (writer->fd >= 0)
+        close(writer->fd);
+    if (!writer->finished)
+        g_unlink(writer->partLocation);
+    g_checksum_free(writer->md5);
+    g_array_free(writer->frameOffsets, TRUE);
+    g_mutex_free(writer->lock);
+    g_cond_free(writer->cond);
+    g_free(writer->location);
+    g_free(writer->partLocation);
+    g_free(writer);
+}
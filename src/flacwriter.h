@@ -0,0 +1,51 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef FLACWRITER_H
+#define FLACWRITER_H
+
+#include <gst/gst.h>
+
+// FLAC encoding spread over every core. The audio gets cut into groups of
+// frames, each group goes to a libFLAC encoder of its own on a shared
+// thread pool, and the frames get renumbered and written out in order as
+// they come back. FLAC frames don't depend on each other, so the file is
+// the one a single encoder would have made. STREAMINFO and the seek table
+// are filled in once everything's been written.
+//
+// The MD5 of the audio is the one part that can't be split up; it's
+// worked out as the audio goes in.
+
+typedef struct _RippitFlacWriter RippitFlacWriter;
+
+// threads is how many groups of the file can be encoding at once, 0 for
+// one per core. tags can be NULL.
+RippitFlacWriter *rippit_flac_writer_new(const gchar *location, const GstTagList *tags, gint threads, GError **error);
+// Raw CDDA, in whole samples, as much or as little at a time as you like.
+// Blocks while the encoders are all busy with this file. FALSE once
+// anything's gone wrong, after which there's no point going on.
+gboolean rippit_flac_writer_write(RippitFlacWriter *writer, const guint8 *data, gsize length);
+// Waits on the encoders and fills the headers in. Until then the file is
+// written as .name.part next to location, and it only gets moved into
+// place once this is about to return TRUE.
+gboolean rippit_flac_writer_finish(RippitFlacWriter *writer, GError **error);
+// An unfinished file gets deleted
+void rippit_flac_writer_free(RippitFlacWriter *writer);
+
+#endif // FLACWRITER_H
@@ -0,0 +1,400 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "imagesrc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+typedef struct {
+    gint number;
+    gboolean audio;
+    gint64 start;
+} CueTrack;
+
+enum {
+    PROP_0,
+    PROP_FAULT_TRACE
+};
+
+enum {
+    TRANSPORT_ERROR,
+    UNCORRECTED_ERROR,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
+GST_BOILERPLATE(RippitImageSrc, rippit_image_src, GstCddaBaseSrc, GST_TYPE_CDDA_BASE_SRC);
+
+// Finds the audio in a WAV file. 0 if there isn't any.
+static gsize findWaveData(const guint8 *data, gsize length)
+{
+    gsize pos = 12;
+
+    if (length < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+        return 0;
+    while (pos + 8 <= length) {
+        guint32 size = GST_READ_UINT32_LE(data + pos + 4);
+        if (memcmp(data + pos, "data", 4) == 0)
+            return pos + 8;
+        pos += 8 + size + (size & 1);
+    }
+    return 0;
+}
+
+// Only the parts of a CUE sheet that say where tracks are. Returns the
+// image the sheet is for.
+static gchar *parseCue(const gchar *location, GArray *tracks, gboolean *wave, GError **error)
+{
+    gchar *contents;
+    gchar **lines;
+    gchar *image = NULL;
+    int i;
+
+    if (!g_file_get_contents(location, &contents, NULL, error))
+        return NULL;
+    lines = g_strsplit(contents, "\n", 0);
+    g_free(contents);
+
+    for (i = 0; lines[i]; i++) {
+        gchar *line = g_strstrip(lines[i]);
+        gchar type[32];
+        int number, minutes, seconds, frames;
+
+        if (g_str_has_prefix(line, "FILE ")) {
+            gchar *start = strchr(line, '"');
+            gchar *end = strrchr(line, '"');
+            gchar *dir;
+            gchar *name;
+
+            if (image) {
+                g_set_error(error, RIPPIT_ERROR, 0, "%s uses more than one file, which isn't supported", location);
+                g_free(image);
+                image = NULL;
+                break;
+            }
+            if (start && end > start) {
+                name = g_strndup(start + 1, end - start - 1);
+            } else {
+                // FILE name TYPE, where only the type can't have spaces
+                gchar *rest = g_strchug(line + strlen("FILE "));
+                gchar *space = strrchr(rest, ' ');
+                name = space ? g_strndup(rest, space - rest) : g_strdup(rest);
+                if (!*g_strchomp(name)) {
+                    g_free(name);
+                    continue;
+                }
+            }
+            dir = g_path_get_dirname(location);
+            image = g_build_filename(dir, name, NULL);
+            *wave = g_str_has_suffix(line, "WAVE");
+            g_free(dir);
+            g_free(name);
+        } else if (sscanf(line, "TRACK %d %31s", &number, type) == 2) {
+            CueTrack track = {number, strcmp(type, "AUDIO") == 0, -1};
+            g_array_append_val(tracks, track);
+        } else if (sscanf(line, "INDEX %d %d:%d:%d", &number, &minutes, &seconds, &frames) == 4) {
+            // Gaps stay with the track before, as they do when ripping
+            // from the disc
+            if (number == 1 && tracks->len > 0)
+                g_array_index(tracks, CueTrack, tracks->len - 1).start = (minutes * 60 + seconds) * 75 + frames;
+        }
+    }
+    g_strfreev(lines);
+
+    if (!image && !(error && *error))
+        g_set_error(error, RIPPIT_ERROR, 0, "%s doesn't say which file the image is in", location);
+    if (image && tracks->len == 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "%s doesn't list any tracks", location);
+        g_free(image);
+        image = NULL;
+    }
+    return image;
+}
+
+static gboolean rippit_image_src_open(GstCddaBaseSrc *cddabasesrc, const gchar *device)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(cddabasesrc);
+    GArray *tracks = g_array_new(FALSE, FALSE, sizeof(CueTrack));
+    GError *error = NULL;
+    gchar *image = NULL;
+    gboolean wave = FALSE;
+    gint64 sectors;
+    gsize length;
+    int i;
+
+    if (g_str_has_suffix(device, ".cue")) {
+        image = parseCue(device, tracks, &wave, &error);
+    } else if (g_str_has_suffix(device, ".wav")) {
+        image = g_strdup(device);
+        wave = TRUE;
+    } else if (g_str_has_suffix(device, ".bin") || g_str_has_suffix(device, ".raw") || g_str_has_suffix(device, ".cdda")) {
+        image = g_strdup(device);
+    } else {
+        g_set_error(&error, RIPPIT_ERROR, 0, "%s doesn't look like a CD image", device);
+    }
+
+    if (image)
+        src->image = g_mapped_file_new(image, FALSE, &error);
+    g_free(image);
+    if (!src->image)
+        goto fail;
+    if (src->faultTrace && !(src->faults = rippit_fault_trace_load(src->faultTrace, &error)))
+        goto fail;
+
+    length = g_mapped_file_get_length(src->image);
+    src->dataOffset = wave ? findWaveData((const guint8*)g_mapped_file_get_contents(src->image), length) : 0;
+    if (wave && src->dataOffset == 0) {
+        g_set_error(&error, RIPPIT_ERROR, 0, "%s isn't a WAV file", device);
+        goto fail;
+    }
+    sectors = (length - src->dataOffset) / CD_FRAMESIZE_RAW;
+    // It's going to be read front to back, once
+    madvise(g_mapped_file_get_contents(src->image), length, MADV_SEQUENTIAL);
+
+    // Without a CUE sheet, it's all one track
+    if (tracks->len == 0) {
+        CueTrack whole = {1, TRUE, 0};
+        g_array_append_val(tracks, whole);
+    }
+    for (i = 0; i < tracks->len; i++) {
+        CueTrack *cue = &g_array_index(tracks, CueTrack, i);
+        GstCddaBaseSrcTrack track;
+
+        memset(&track, 0, sizeof(track));
+        track.num = cue->number;
+        track.is_audio = cue->audio;
+        track.start = cue->start;
+        track.end = (i + 1 < tracks->len ? g_array_index(tracks, CueTrack, i + 1).start : sectors) - 1;
+        if (cue->start < 0 || track.end < track.start) {
+            g_set_error(&error, RIPPIT_ERROR, 0, "Track %d of %s is out of place", cue->number, device);
+            goto fail;
+        }
+        gst_cdda_base_src_add_track(cddabasesrc, &track);
+    }
+
+    GST_DEBUG("Opened %s: %d tracks, %" G_GINT64_FORMAT " sectors", device, tracks->len, sectors);
+    g_array_free(tracks, TRUE);
+    return TRUE;
+
+fail:
+    GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL), ("%s", error->message));
+    g_error_free(error);
+    g_array_free(tracks, TRUE);
+    if (src->image) {
+        g_mapped_file_unref(src->image);
+        src->image = NULL;
+    }
+    return FALSE;
+}
+
+// Like the drive taking its time. FALSE if we got stopped first.
+static gboolean simulateDelay(RippitImageSrc *src, gint64 milliseconds)
+{
+    GTimeVal until;
+    gboolean finished;
+
+    g_get_current_time(&until);
+    g_time_val_add(&until, milliseconds * 1000);
+    g_mutex_lock(src->lock);
+    while (!src->unlocked) {
+        if (milliseconds >= 0 && !g_cond_timed_wait(src->wake, src->lock, &until))
+            break;
+        if (milliseconds < 0)
+            g_cond_wait(src->wake, src->lock);
+    }
+    finished = !src->unlocked;
+    g_mutex_unlock(src->lock);
+    return finished;
+}
+
+static GstBuffer *simulateFaults(RippitImageSrc *src, gint sector, GstBuffer *buffer)
+{
+    const RippitSectorFault *fault = rippit_fault_trace_lookup(src->faults, sector);
+
+    if (fault->hang != 0) {
+        GST_DEBUG("Hanging on sector %d", sector);
+        if (!simulateDelay(src, fault->hang < 0 ? -1 : (gint64)fault->hang * 1000))
+            return buffer;
+    }
+    if (fault->latency > 0 && !simulateDelay(src, fault->latency))
+        return buffer;
+    if (fault->transport) {
+        g_signal_emit(src, signals[TRANSPORT_ERROR], 0, sector);
+        if (!simulateDelay(src, fault->transportDelay))
+            return buffer;
+    }
+    if (fault->unrecoverable) {
+        // Whatever cdparanoia would have made of it, it won't be right
+        GstBuffer *silence = gst_buffer_new_and_alloc(CD_FRAMESIZE_RAW);
+        memset(GST_BUFFER_DATA(silence), 0, CD_FRAMESIZE_RAW);
+        gst_buffer_unref(buffer);
+        g_signal_emit(src, signals[UNCORRECTED_ERROR], 0, sector);
+        return silence;
+    }
+    return buffer;
+}
+
+static void rippit_image_src_close(GstCddaBaseSrc *cddabasesrc)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(cddabasesrc);
+    if (src->image) {
+        g_mapped_file_unref(src->image);
+        src->image = NULL;
+    }
+    if (src->faults) {
+        rippit_fault_trace_free(src->faults);
+        src->faults = NULL;
+    }
+}
+
+// Stopping while a read is hanging has to wake it up, or the streaming
+// thread never gets to notice
+static gboolean rippit_image_src_unlock(GstBaseSrc *basesrc)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(basesrc);
+    g_mutex_lock(src->lock);
+    src->unlocked = TRUE;
+    g_cond_broadcast(src->wake);
+    g_mutex_unlock(src->lock);
+    return TRUE;
+}
+
+static gboolean rippit_image_src_unlock_stop(GstBaseSrc *basesrc)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(basesrc);
+    g_mutex_lock(src->lock);
+    src->unlocked = FALSE;
+    g_mutex_unlock(src->lock);
+    return TRUE;
+}
+
+static GstBuffer *rippit_image_src_read_sector(GstCddaBaseSrc *cddabasesrc, gint sector)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(cddabasesrc);
+    gsize offset = src->dataOffset + (gsize)sector * CD_FRAMESIZE_RAW;
+    GstBuffer *buffer;
+
+    if (sector < 0 || offset + CD_FRAMESIZE_RAW > g_mapped_file_get_length(src->image)) {
+        GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL), ("Sector %d is past the end of the image", sector));
+        return NULL;
+    }
+
+    // No copying; the buffer points into the mapping, and holds a reference
+    // to it for as long as it's around, which in the spool can be well after
+    // we've been closed. The mapping is read only, same as the buffer.
+    buffer = gst_buffer_new();
+    GST_BUFFER_DATA(buffer) = (guint8*)g_mapped_file_get_contents(src->image) + offset;
+    GST_BUFFER_SIZE(buffer) = CD_FRAMESIZE_RAW;
+    GST_BUFFER_MALLOCDATA(buffer) = (guint8*)g_mapped_file_ref(src->image);
+    GST_BUFFER_FREE_FUNC(buffer) = (GFreeFunc)g_mapped_file_unref;
+
+    if (src->faults)
+        buffer = simulateFaults(src, sector, buffer);
+    return buffer;
+}
+
+static void rippit_image_src_base_init(gpointer g_class)
+{
+    gst_element_class_set_details_simple(GST_ELEMENT_CLASS(g_class), "CD image source", "Source/File",
+        "Reads audio out of BIN/CUE, WAV and raw CD images", "Rippit");
+}
+
+static void rippit_image_src_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(object);
+
+    switch (prop_id) {
+        case PROP_FAULT_TRACE:
+            g_free(src->faultTrace);
+            src->faultTrace = g_value_dup_string(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void rippit_image_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(object);
+
+    switch (prop_id) {
+        case PROP_FAULT_TRACE:
+            g_value_set_string(value, src->faultTrace);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void rippit_image_src_finalize(GObject *object)
+{
+    RippitImageSrc *src = RIPPIT_IMAGE_SRC(object);
+
+    g_free(src->faultTrace);
+    g_mutex_free(src->lock);
+    g_cond_free(src->wake);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void rippit_image_src_class_init(RippitImageSrcClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstBaseSrcClass *baseClass = GST_BASE_SRC_CLASS(klass);
+    GstCddaBaseSrcClass *cddaClass = GST_CDDA_BASE_SRC_CLASS(klass);
+
+    objectClass->set_property = rippit_image_src_set_property;
+    objectClass->get_property = rippit_image_src_get_property;
+    objectClass->finalize = rippit_image_src_finalize;
+    baseClass->unlock = rippit_image_src_unlock;
+    baseClass->unlock_stop = rippit_image_src_unlock_stop;
+    cddaClass->open = rippit_image_src_open;
+    cddaClass->close = rippit_image_src_close;
+    cddaClass->read_sector = rippit_image_src_read_sector;
+
+    g_object_class_install_property(objectClass, PROP_FAULT_TRACE,
+        g_param_spec_string("fault-trace", "Fault trace", "Act out the faults in this file, like a bad drive would",
+                            NULL, G_PARAM_READWRITE));
+
+    // Same as cdparanoiasrc's
+    signals[TRANSPORT_ERROR] = g_signal_new("transport-error", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+        0, NULL, NULL, g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
+    signals[UNCORRECTED_ERROR] = g_signal_new("uncorrected-error", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+        0, NULL, NULL, g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
+}
+
+static void rippit_image_src_init(RippitImageSrc *src, RippitImageSrcClass *klass)
+{
+    src->lock = g_mutex_new();
+    src->wake = g_cond_new();
+}
+
+static gboolean plugin_init(GstPlugin *plugin)
+{
+    return gst_element_register(plugin, "rippitimagesrc", GST_RANK_NONE, RIPPIT_TYPE_IMAGE_SRC);
+}
+
+gboolean rippit_image_src_register()
+{
+    return gst_plugin_register_static(GST_VERSION_MAJOR, GST_VERSION_MINOR, "rippit",
+        "Sources built into rippit", plugin_init, RIPPIT_VERSION_STRING, "GPL", "rippit", "rippit", "rippit");
+}
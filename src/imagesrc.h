@@ -0,0 +1,62 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef IMAGESRC_H
+#define IMAGESRC_H
+
+#include <gst/cdda/gstcddabasesrc.h>
+#include "faulttrace.h"
+
+// A CD source that reads from an image instead of a drive: a CUE sheet with
+// its BIN or WAV file, or a raw CDDA dump as a single track. Being a
+// GstCddaBaseSrc like cdparanoiasrc, it has the same track and sector
+// formats, modes and disc ID tags. The image is mapped into memory, and
+// buffers point straight into it.
+//
+// Given a fault trace (see faulttrace.h), it plays a bad drive instead:
+// slow reads, hangs, and the same "transport-error" and "uncorrected-error"
+// signals cdparanoiasrc has.
+
+#define RIPPIT_TYPE_IMAGE_SRC (rippit_image_src_get_type())
+#define RIPPIT_IMAGE_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), RIPPIT_TYPE_IMAGE_SRC, RippitImageSrc))
+
+typedef struct {
+    GstCddaBaseSrc parent;
+    GMappedFile *image;
+    // Bytes before the audio starts, for WAV files
+    gsize dataOffset;
+
+    gchar *faultTrace;
+    RippitFaultTrace *faults;
+    // Slow reads and hangs wait on this, so stopping doesn't have to wait
+    // for them
+    GMutex *lock;
+    GCond *wake;
+    gboolean unlocked;
+} RippitImageSrc;
+
+typedef struct {
+    GstCddaBaseSrcClass parent_class;
+} RippitImageSrcClass;
+
+GType rippit_image_src_get_type();
+// Makes "rippitimagesrc" available to gst_element_factory_make()
+gboolean rippit_image_src_register();
+
+#endif // IMAGESRC_H
@@ -0,0 +1,2527 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "librippit.h"
+
+#include "spool.h"
+#include "metadata.h"
+#include "checksum.h"
+#include "journal.h"
+#include "cuesheet.h"
+#include "dvd.h"
+#include "imagesrc.h"
+#include "profile.h"
+#include "speedcontrol.h"
+#include "library.h"
+#include "media.h"
+#include "writesink.h"
+#include <gst/gst.h>
+#include <gst/tag/tag.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <linux/cdrom.h>
+#include <gst/app/gstappsink.h>
+
+GST_DEBUG_CATEGORY(rippit);
+
+#define PARANOIA_MODE_FULL 0xff
+#define PARANOIA_MODE_OVERLAP 0x04
+#define CDDA_MODE_CONTINUOUS 1
+
+// Sectors either side of a bad one that get re-read along with it
+#define REPAIR_MARGIN 16
+// Audio from the last run goes back into the spool a second at a time
+#define RESUME_CHUNK (CD_FRAMESIZE_RAW * 75)
+// Drive speed for re-reads, which drops with every go a range needs, and
+// how many goes it gets
+#define REPAIR_SPEED 4
+#define REPAIR_ATTEMPTS 3
+// How far past a spot that stalls the fast pass gets skipped, a second
+#define STALL_SKIP 75
+#define DVD_SECTOR_SIZE 2048
+
+struct _RippitJob {
+    RippitJobOptions options;
+    RippitJobCallbacks callbacks;
+    gpointer callbackData;
+    // With --spool and --copy-dvd, where the encoding happens
+    RippitSpool *spool;
+    RippitTitlePool *titlePool;
+    gint pendingRetags;
+    RippitProfile *profile;
+    RippitSpeedControl *speed;
+    guint speedSource;
+    // With --write-buffer, shared by every file the job writes
+    RippitWriteStats *writeStats;
+    // With --library: what the disc goes under, and the tracks ripped so
+    // far, to add once the job's done
+    RippitLibrary *library;
+    gchar *libraryKey;
+    RippitLibraryEntry *ripped;
+    // What the library has of the disc, while one track of it gets read
+    // again to make sure
+    RippitLibraryEntry *known;
+    gboolean spotChecking;
+    // The library's copy is no good, so nothing of an earlier rip counts
+    gboolean rerip;
+
+    gchar *device;
+    // What's in the drive, from before the pipeline was built
+    RippitMedia *media;
+    GstElement *pipeline;
+    GstElement *filesink;
+    GstElement *cdsrc;
+    GstElement *dvdsrc;
+    // Where per-track outputs get linked to; the source, unless there's
+    // an image being written alongside them
+    GstElement *splitSrc;
+    GstElement *imagesink;
+    // The raw copy of a DVD title being made, with --copy-dvd
+    gchar *copyLocation;
+    // The DVD titles worth ripping, or NULL if the IFOs couldn't be read
+    GPtrArray *dvdTitles;
+    GstTagSetter *tag_setter;
+    RippitDiscInfo *discInfo;
+    gchar *toc;
+    gboolean gotData;
+    gboolean lookupPending;
+    // Tracks ripped under a stand-in name while the lookup was running
+    GList *provisional;
+    GMutex *lock;
+    gchar *curLocation;
+    int curTrack;
+    gint64 trackCount;
+    gchar *discID;
+    guint timeoutSource;
+    guint64 stallTrack;
+    guint64 stallPos;
+    // When the position last moved, and when we noticed it had stopped
+    GstClockTime lastProgress;
+    GstClockTime stallDetected;
+    RippitSpoolTrack *spoolTrack;
+    GstElement *output;
+    gint64 *trackStarts;
+    guint64 trackRemaining;
+    gboolean draining;
+    // Adaptive paranoia: where the fast pass ran into trouble
+    GArray *badSectors;
+    GArray *repairRanges;
+    guint repairIndex;
+    gboolean repairing;
+    // Goes at the range being re-read so far, and whether this one had
+    // errors too
+    guint repairAttempts;
+    gboolean repairErrors;
+    // Damaged tracks left for the end of the disc, and how much of the
+    // spool they're holding on to until then
+    GQueue *deferred;
+    guint64 heldBytes;
+    gboolean repairPass;
+    // Checksums of the track streaming past, and which track that is
+    RippitTrackChecksum checksum;
+    int checksumTrack;
+    // First sector past the end of the audio, from the TOC
+    gint64 leadout;
+    FILE *ripLog;
+    RippitJournal *journal;
+    GstClockTime transitionStart;
+    GstClockTime transitionTotal;
+    GstClockTime transitionMax;
+    guint transitions;
+    // For rippit_job_get_stats(). Only the streaming threads write these,
+    // apart from errorSectors, which is under the lock.
+    int statsTrack;
+    guint64 trackBytes;
+    guint64 bytesRead;
+    guint64 bytesEncoded;
+    guint retries;
+    GArray *errorSectors;
+    // When the job was made, and how long after that the first sector came
+    // off the disc
+    GstClockTime created;
+    GstClockTime firstSector;
+    gboolean done;
+    // Something went wrong, or we were told to stop
+    gboolean failed;
+    // The done callback has been called, so there's nothing more to do
+    gboolean finished;
+};
+
+typedef struct {
+    int track;
+    gchar *location;
+    gboolean finished;
+} ProvisionalTrack;
+
+// Sectors relative to the start of a track, end exclusive
+typedef struct {
+    gint64 start;
+    gint64 end;
+    // Still bad after every go at re-reading it
+    gboolean lost;
+} SectorRange;
+
+// A track with damaged parts to come back to once the rest of the disc has
+// been read. Its audio waits in the spool, held, until then.
+typedef struct {
+    int track;
+    RippitSpoolTrack *spoolTrack;
+    RippitTrackChecksum checksum;
+    gchar *location;
+    GArray *ranges;
+    guint64 size;
+} DeferredTrack;
+
+static void startNextTrack(RippitJob *job);
+static void trackRead(RippitJob *job);
+static void finishSpotCheck(RippitJob *job);
+static void dropDeferred(RippitJob *job);
+static guint64 currentTrackBytes(RippitJob *job);
+static gboolean isStalled(RippitJob *job);
+static gboolean checkForStall(gpointer data);
+static guint64 trackLength(RippitJob *job);
+static guint64 trackSamples(RippitJob *job);
+static void logTrackChecksum(RippitJob *job, gboolean complete, const gchar *note);
+static void writeCueSheet(RippitJob *job);
+static gchar *imageName(RippitJob *job);
+static gchar *taggedName(RippitJob *job, int track);
+static RippitDvdTitle *findTitle(RippitJob *job, int title);
+static gboolean wantTrack(RippitJob *job, int track);
+
+GQuark rippit_error_quark()
+{
+    return g_quark_from_static_string("rippit-error-quark");
+}
+
+static gpointer initOnce(gpointer data)
+{
+    GST_DEBUG_CATEGORY_INIT(rippit, "rippit", 0, "Rippit Debugging");
+    rippit_image_src_register();
+    rippit_write_sink_register();
+    return NULL;
+}
+
+void rippit_init()
+{
+    static GOnce once = G_ONCE_INIT;
+    g_once(&once, initOnce, NULL);
+}
+
+static void debug_tag(const GstTagList *list, const gchar *tag, gpointer data)
+{
+    GST_DEBUG("Found Tag %s", tag);
+}
+
+static void setOutputMessage(RippitJob *job, const gchar *msg, ...)
+{
+    gchar *message;
+    va_list ap;
+    va_start(ap, msg);
+    message = g_strdup_vprintf(msg, ap);
+    va_end(ap);
+    if (job->callbacks.message)
+        job->callbacks.message(job, message, job->callbackData);
+    g_free(message);
+}
+
+typedef struct {
+    RippitJob *job;
+    gchar *message;
+} PostedMessage;
+
+static gboolean postedMessage_idle(gpointer data)
+{
+    PostedMessage *posted = data;
+    setOutputMessage(posted->job, "%s", posted->message);
+    g_free(posted->message);
+    g_free(posted);
+    return FALSE;
+}
+
+// setOutputMessage() for the streaming threads. The callback still comes
+// from the main loop, like every other one.
+static void postOutputMessage(RippitJob *job, const gchar *msg, ...)
+{
+    PostedMessage *posted = g_new0(PostedMessage, 1);
+    va_list ap;
+    va_start(ap, msg);
+    posted->message = g_strdup_vprintf(msg, ap);
+    va_end(ap);
+    posted->job = job;
+    g_idle_add(postedMessage_idle, posted);
+}
+
+static void reportProgress(RippitJob *job)
+{
+    RippitJobProgress progress;
+    if (!job->callbacks.progress)
+        return;
+    rippit_job_get_progress(job, &progress);
+    job->callbacks.progress(job, &progress, job->callbackData);
+}
+
+static gboolean reportProgress_idle(gpointer data)
+{
+    reportProgress(data);
+    return FALSE;
+}
+
+// Only cdparanoiasrc has a paranoia mode
+static gboolean setParanoiaMode(GstElement *source, gint mode)
+{
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(source), "paranoia-mode"))
+        return FALSE;
+    g_object_set(G_OBJECT(source), "paranoia-mode", mode, NULL);
+    return TRUE;
+}
+
+// Only cdparanoiasrc can be slowed down
+static void setReadSpeed(GstElement *source, gint speed)
+{
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(source), "read-speed"))
+        g_object_set(G_OBJECT(source), "read-speed", speed, NULL);
+}
+
+static void recordBadSector(RippitJob *job, gint sector)
+{
+    if (!job->options.adaptive || job->repairing)
+        return;
+    g_mutex_lock(job->lock);
+    g_array_append_val(job->badSectors, sector);
+    g_mutex_unlock(job->lock);
+}
+
+static void uncorrectedError_cb(GstElement *element, gint sector, gpointer data)
+{
+    RippitJob *job = data;
+    GST_DEBUG("Disk error in sector %d", sector);
+    recordBadSector(job, sector);
+    if (job->repairing)
+        job->repairErrors = TRUE;
+    else if (job->speed)
+        rippit_speed_control_error(job->speed);
+    g_mutex_lock(job->lock);
+    g_array_append_val(job->errorSectors, sector);
+    g_mutex_unlock(job->lock);
+    if (job->options.adaptive && !job->repairing) {
+        postOutputMessage(job, "Disk is scratched at sector %d. Will try again later.", sector);
+        return;
+    }
+    postOutputMessage(job, "Disk is scratched at sector %d. Data was lost. I'm sorry :(", sector);
+}
+
+static void transportError_cb(GstElement *element, gint sector, gpointer data)
+{
+    RippitJob *job = data;
+    GST_DEBUG("Possible disk error in sector %d", sector);
+    recordBadSector(job, sector);
+    job->retries++;
+    if (job->speed && !job->repairing)
+        rippit_speed_control_retry(job->speed);
+    postOutputMessage(job, "Disk is scratched at sector %d. Recovering...", sector);
+}
+
+static guint64 getPos(RippitJob *job)
+{
+    gint64 pos = 0;
+    GstFormat format = GST_FORMAT_TIME;
+    if (job->pipeline == NULL)
+        return 0;
+    gst_element_query_position (GST_ELEMENT(job->pipeline), &format, &pos);
+    return pos;
+}
+
+static guint64 getDuration(RippitJob *job)
+{
+    gint64 duration = 0;
+    GstFormat format = GST_FORMAT_TIME;
+    if (job->pipeline == NULL)
+        return 0;
+    if (!gst_element_query_duration(GST_ELEMENT(job->pipeline), &format, &duration))
+        return 0;
+    return duration;
+}
+
+static void writeProfile(RippitJob *job)
+{
+    gchar *report = g_strconcat(job->options.profile, ".txt", NULL);
+    GError *error = NULL;
+
+    if (rippit_profile_write(job->profile, job->options.profile, report, &error)) {
+        setOutputMessage(job, "Profile written to %s and %s", job->options.profile, report);
+    } else {
+        setOutputMessage(job, "%s", error->message);
+        g_error_free(error);
+    }
+    g_free(report);
+}
+
+// Tracks still under the disc ID get the names they were retagged with
+static void addToLibrary(RippitJob *job)
+{
+    GError *error = NULL;
+    guint i;
+
+    for (i = 0; job->discInfo && job->cdsrc && i < job->ripped->tracks->len; i++) {
+        RippitLibraryTrack *track = &g_array_index(job->ripped->tracks, RippitLibraryTrack, i);
+        gchar *provisional = g_strdup_printf("%s - %d.flac", job->discID, track->track);
+        gchar *name = g_path_get_basename(track->location);
+        if (strcmp(name, provisional) == 0) {
+            gchar *tagged = taggedName(job, track->track);
+            RippitTrackChecksum sum;
+            memset(&sum, 0, sizeof(sum));
+            sum.crc = track->crc;
+            sum.arV1 = track->arV1;
+            sum.arV2 = track->arV2;
+            rippit_library_entry_add_track(job->ripped, track->track, tagged, &sum);
+            g_free(tagged);
+        }
+        g_free(name);
+        g_free(provisional);
+    }
+
+    if (rippit_library_add(job->library, job->ripped, &error)) {
+        GST_INFO("Added %s to the library, %d tracks", job->ripped->key, job->ripped->tracks->len);
+    } else {
+        setOutputMessage(job, "Could not add %s to the library: %s", job->discID, error->message);
+        g_error_free(error);
+    }
+}
+
+// The job's done once the drive is, and everything it read has been
+// encoded and named
+static void quitIfFinished(RippitJob *job)
+{
+    if (job->finished || !job->done || job->lookupPending)
+        return;
+    if (job->spool && rippit_spool_pending(job->spool) > 0)
+        return;
+    if (job->titlePool && rippit_title_pool_pending(job->titlePool) > 0)
+        return;
+    if (job->pendingRetags > 0)
+        return;
+    if (job->profile)
+        writeProfile(job);
+    // Tracks are remembered as they're read, so a failed encode anywhere
+    // keeps the whole disc out
+    if (job->ripped && job->ripped->tracks->len > 0 && !job->failed)
+        addToLibrary(job);
+    // Otherwise a rip of the same disc in the same place would skip it all
+    if (job->journal && !job->failed) {
+        rippit_journal_remove(job->journal);
+        rippit_journal_free(job->journal);
+        job->journal = NULL;
+    }
+    job->finished = TRUE;
+    if (job->callbacks.done)
+        job->callbacks.done(job, !job->failed, job->callbackData);
+}
+
+static GstTagList *trackTags(RippitJob *job, int track)
+{
+    return gst_tag_list_new_full(
+        GST_TAG_TITLE, rippit_disc_info_track_title(job->discInfo, track),
+        GST_TAG_ARTIST, rippit_disc_info_track_artist(job->discInfo, track),
+        GST_TAG_ALBUM, job->discInfo->album,
+        GST_TAG_APPLICATION_NAME, "rippit",
+        GST_TAG_TRACK_NUMBER, track,
+        NULL
+    );
+}
+
+static gchar *taggedName(RippitJob *job, int track)
+{
+    return g_strdup_printf("%s - %s.flac", rippit_disc_info_track_artist(job->discInfo, track), rippit_disc_info_track_title(job->discInfo, track));
+}
+
+typedef struct {
+    RippitJob *job;
+    gchar *provisional;
+} RetaggedTrack;
+
+static void retagDone_cb(const gchar *location, gboolean success, gpointer data)
+{
+    RetaggedTrack *retagged = data;
+    RippitJob *job = retagged->job;
+
+    if (success) {
+        setOutputMessage(job, "Renamed to %s", location);
+        // Only done now, so a resume after a failed lookup still sees it
+        // needs its real name
+        if (job->journal)
+            rippit_journal_track_moved(job->journal, retagged->provisional, location);
+    } else {
+        setOutputMessage(job, "Could not retag %s", location);
+    }
+    g_free(retagged->provisional);
+    g_free(retagged);
+    job->pendingRetags--;
+    quitIfFinished(job);
+}
+
+// Once we know what the disc is, anything ripped under a stand-in name gets
+// its real name and tags, as soon as it's done being written.
+static void fixProvisionalTracks(RippitJob *job)
+{
+    GList *cur;
+    GList *next;
+
+    g_mutex_lock(job->lock);
+    if (job->discInfo) {
+        for (cur = job->provisional; cur; cur = next) {
+            ProvisionalTrack *track = cur->data;
+            next = cur->next;
+            if (track->finished) {
+                gchar *name = taggedName(job, track->track);
+                RetaggedTrack *retagged = g_new0(RetaggedTrack, 1);
+                retagged->job = job;
+                retagged->provisional = track->location;
+                job->pendingRetags++;
+                rippit_retag_async(track->location, name, trackTags(job, track->track), retagDone_cb, retagged);
+                job->provisional = g_list_delete_link(job->provisional, cur);
+                g_free(track);
+                g_free(name);
+            }
+        }
+    }
+    g_mutex_unlock(job->lock);
+}
+
+static void markFinished(RippitJob *job, const gchar *location)
+{
+    GList *cur;
+    gboolean provisional = FALSE;
+
+    g_mutex_lock(job->lock);
+    for (cur = job->provisional; cur; cur = cur->next) {
+        ProvisionalTrack *track = cur->data;
+        if (g_strcmp0(track->location, location) == 0) {
+            track->finished = TRUE;
+            provisional = TRUE;
+        }
+    }
+    g_mutex_unlock(job->lock);
+    // A track under the disc ID isn't done until it's been renamed
+    if (job->journal && !provisional)
+        rippit_journal_track_written(job->journal, location);
+    fixProvisionalTracks(job);
+}
+
+typedef struct {
+    RippitJob *job;
+    gchar *location;
+} FinishedTrack;
+
+static gboolean markFinished_idle(gpointer data)
+{
+    FinishedTrack *finished = data;
+    markFinished(finished->job, finished->location);
+    g_free(finished->location);
+    g_free(finished);
+    return FALSE;
+}
+
+static void closeSpoolTrack(RippitJob *job)
+{
+    if (job->spoolTrack) {
+        rippit_spool_track_close(job->spoolTrack);
+        rippit_spool_track_release(job->spoolTrack);
+        job->spoolTrack = NULL;
+    }
+}
+
+// The track being read when the job stopped is only part of one. It
+// mustn't get a real name, or look finished to the journal.
+static void dropCurrentTrack(RippitJob *job)
+{
+    GList *cur;
+    GList *next;
+
+    if (job->spoolTrack) {
+        rippit_spool_track_abandon(job->spoolTrack);
+        job->spoolTrack = NULL;
+    }
+    if (!job->curLocation)
+        return;
+
+    g_mutex_lock(job->lock);
+    for (cur = job->provisional; cur; cur = next) {
+        ProvisionalTrack *track = cur->data;
+        next = cur->next;
+        if (!track->finished && g_strcmp0(track->location, job->curLocation) == 0) {
+            job->provisional = g_list_delete_link(job->provisional, cur);
+            g_free(track->location);
+            g_free(track);
+        }
+    }
+    g_mutex_unlock(job->lock);
+    // The spool deletes its own once the encoder's let go of it
+    if (!job->spool)
+        g_unlink(job->curLocation);
+}
+
+// A copy that didn't make it to the end isn't worth encoding
+static void dropCopiedTitle(RippitJob *job)
+{
+    if (job->copyLocation) {
+        g_unlink(job->copyLocation);
+        g_free(job->copyLocation);
+        job->copyLocation = NULL;
+    }
+}
+
+static void titleDone_cb(RippitTitlePool *pool, const gchar *location, gboolean success, gpointer data)
+{
+    RippitJob *job = data;
+    if (success) {
+        setOutputMessage(job, "Finished encoding %s", location);
+    } else {
+        // Its file is still there under the title's name, so the disc
+        // mustn't go into the library as if it were done
+        setOutputMessage(job, "Could not encode %s", location);
+        job->failed = TRUE;
+    }
+    quitIfFinished(job);
+}
+
+static void finishJob(RippitJob *job)
+{
+    if (job->done)
+        return;
+    job->done = TRUE;
+
+    if (job->timeoutSource > 0) {
+        g_source_remove(job->timeoutSource);
+        job->timeoutSource = 0;
+    }
+    if (job->speedSource > 0) {
+        g_source_remove(job->speedSource);
+        job->speedSource = 0;
+    }
+    if (job->pipeline)
+        gst_element_set_state(job->pipeline, GST_STATE_NULL);
+    dropCopiedTitle(job);
+    if (job->failed) {
+        dropCurrentTrack(job);
+    } else {
+        closeSpoolTrack(job);
+        if (!job->spool && job->curLocation)
+            markFinished(job, job->curLocation);
+    }
+    dropDeferred(job);
+
+    logTrackChecksum(job, FALSE, "incomplete");
+    if (job->imagesink && job->trackStarts)
+        writeCueSheet(job);
+    if (job->ripLog) {
+        fclose(job->ripLog);
+        job->ripLog = NULL;
+    }
+
+    if (job->transitions > 0) {
+        GST_INFO("%s: %d track changes, %.1fms each on average", job->device, job->transitions,
+                 (double)job->transitionTotal / job->transitions / GST_MSECOND);
+    }
+
+    if (job->spool && rippit_spool_pending(job->spool) > 0)
+        setOutputMessage(job, "Done reading, waiting on %d encoders...", rippit_spool_pending(job->spool));
+    if (job->titlePool && rippit_title_pool_pending(job->titlePool) > 0)
+        setOutputMessage(job, "Done reading, waiting on %d titles to encode...", rippit_title_pool_pending(job->titlePool));
+    quitIfFinished(job);
+}
+
+static void spoolDone_cb(RippitSpool *spool, const gchar *location, gboolean success, gpointer data)
+{
+    RippitJob *job = data;
+
+    if (success) {
+        setOutputMessage(job, "Finished encoding %s", location);
+        markFinished(job, location);
+    } else {
+        // Left pending in the journal, so a resume has another go at it
+        setOutputMessage(job, "Could not encode %s", location);
+        job->failed = TRUE;
+    }
+    quitIfFinished(job);
+}
+
+static GstFlowReturn spoolBuffer_cb(GstAppSink *sink, gpointer data)
+{
+    RippitJob *job = data;
+    GstBuffer *buffer = gst_app_sink_pull_buffer(sink);
+
+    if (!buffer)
+        return GST_FLOW_UNEXPECTED;
+    if (!job->spoolTrack) {
+        gst_buffer_unref(buffer);
+    } else if (job->repairing) {
+        // Re-read audio goes back where it came from in the spooled track
+        if (GST_CLOCK_TIME_IS_VALID(GST_BUFFER_TIMESTAMP(buffer))) {
+            guint64 offset = gst_util_uint64_scale_int_round(GST_BUFFER_TIMESTAMP(buffer), 44100, GST_SECOND) * 4;
+            rippit_spool_track_splice(job->spoolTrack, offset, buffer);
+        } else {
+            gst_buffer_unref(buffer);
+        }
+    } else {
+        rippit_spool_track_push(job->spoolTrack, buffer);
+    }
+    return GST_FLOW_OK;
+}
+
+static gint compareSectors(gconstpointer a, gconstpointer b)
+{
+    return *(const gint*)a - *(const gint*)b;
+}
+
+// Turns the bad sectors from the fast pass into a few track-relative ranges,
+// with some slack around each so paranoia has something to sync against.
+static void collectRepairRanges(RippitJob *job)
+{
+    gint64 trackStart = job->trackStarts ? job->trackStarts[job->curTrack-1] : 0;
+    gint64 trackSectors = trackLength(job) / CD_FRAMESIZE_RAW;
+    SectorRange range = {-1, -1, FALSE};
+    int i;
+
+    g_array_set_size(job->repairRanges, 0);
+    g_mutex_lock(job->lock);
+    g_array_sort(job->badSectors, compareSectors);
+    for (i = 0; i < job->badSectors->len; i++) {
+        gint64 sector = g_array_index(job->badSectors, gint, i) - trackStart;
+        gint64 start = MAX(0, sector - REPAIR_MARGIN);
+        gint64 end = MIN(trackSectors, sector + REPAIR_MARGIN + 1);
+
+        if (start >= end)
+            continue;
+        if (range.end >= start) {
+            range.end = MAX(range.end, end);
+        } else {
+            if (range.end > 0)
+                g_array_append_val(job->repairRanges, range);
+            range.start = start;
+            range.end = end;
+        }
+    }
+    if (range.end > 0)
+        g_array_append_val(job->repairRanges, range);
+    g_array_set_size(job->badSectors, 0);
+    g_mutex_unlock(job->lock);
+}
+
+static void checksumBuffer(gpointer data, gpointer user_data)
+{
+    GstBuffer *buffer = data;
+    rippit_track_checksum_update(user_data, GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer));
+}
+
+static guint64 sectorTime(gint64 sector)
+{
+    return gst_util_uint64_scale_int_ceil(sector * CD_SAMPLES_PER_SECTOR, GST_SECOND, 44100);
+}
+
+// Has the source start at a sector of the current track once it gets going,
+// and stop short of end unless that's -1. Only works while in READY.
+static void seekTrack(RippitJob *job, gint64 start, gint64 end)
+{
+    // Not started yet, so the source holds on to this until it is
+    gst_element_send_event(job->cdsrc, gst_event_new_seek(1.0, GST_FORMAT_TIME,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
+        GST_SEEK_TYPE_SET, sectorTime(start),
+        end < 0 ? GST_SEEK_TYPE_NONE : GST_SEEK_TYPE_SET, end < 0 ? GST_CLOCK_TIME_NONE : sectorTime(end)));
+}
+
+// The ranges of the current track that got re-read, under its checksums
+// in the rip log
+static void logRepairs(RippitJob *job)
+{
+    gint64 trackStart = job->trackStarts ? job->trackStarts[job->curTrack-1] : 0;
+    int i;
+
+    g_mutex_lock(job->lock);
+    for (i = 0; job->ripLog && i < job->repairRanges->len; i++) {
+        SectorRange *range = &g_array_index(job->repairRanges, SectorRange, i);
+        fprintf(job->ripLog, "          sectors %ld-%ld %s\n", (long)(trackStart + range->start),
+                (long)(trackStart + range->end - 1), range->lost ? "could not be recovered" : "re-read");
+    }
+    if (job->ripLog)
+        fflush(job->ripLog);
+    g_mutex_unlock(job->lock);
+}
+
+// Leaves the damaged parts of the track for the end of the disc, as long
+// as the spool has room to keep holding on to its audio until then
+static gboolean deferRepairs(RippitJob *job)
+{
+    guint64 size = trackSamples(job) * 4;
+    DeferredTrack *deferred;
+
+    // Half the spool at most, so there's room left for the tracks after
+    // it to get to the encoders
+    if (job->repairPass || job->heldBytes + size > (guint64)job->options.spoolSize * 1024 * 1024 / 2)
+        return FALSE;
+
+    deferred = g_new0(DeferredTrack, 1);
+    deferred->track = job->curTrack;
+    deferred->spoolTrack = job->spoolTrack;
+    deferred->checksum = job->checksum;
+    deferred->location = g_strdup(job->curLocation);
+    deferred->ranges = job->repairRanges;
+    deferred->size = size;
+    job->repairRanges = g_array_new(FALSE, FALSE, sizeof(SectorRange));
+    job->heldBytes += size;
+    g_queue_push_tail(job->deferred, deferred);
+    setOutputMessage(job, "Track %d has %d damaged parts, coming back for them at the end", job->curTrack, deferred->ranges->len);
+
+    // Closed but still held, so the encoder waits for the re-reads. The
+    // checksums get logged once they're in.
+    rippit_spool_track_close(job->spoolTrack);
+    job->spoolTrack = NULL;
+    job->checksumTrack = 0;
+    return TRUE;
+}
+
+// Called at the end of every pass over a track in adaptive mode. Returns
+// TRUE while there's still something being re-read.
+static gboolean repairNextRange(RippitJob *job)
+{
+    SectorRange *range;
+    gint speed;
+
+    if (!job->repairing) {
+        collectRepairRanges(job);
+        if (job->repairRanges->len == 0) {
+            GST_INFO("Track %d read clean, CRC %08X", job->curTrack, job->checksum.crc);
+            rippit_spool_track_release(job->spoolTrack);
+            return FALSE;
+        }
+        if (deferRepairs(job))
+            return FALSE;
+        job->repairing = TRUE;
+        job->repairIndex = 0;
+        job->repairAttempts = 0;
+        setOutputMessage(job, "Re-reading %d damaged parts of track %d with full paranoia", job->repairRanges->len, job->curTrack);
+    } else if (job->repairIndex > 0) {
+        range = &g_array_index(job->repairRanges, SectorRange, job->repairIndex-1);
+        if (job->repairErrors && job->repairAttempts < REPAIR_ATTEMPTS) {
+            GST_DEBUG("Sectors %ld-%ld of track %d still aren't right, trying again", (long)range->start, (long)range->end, job->curTrack);
+            job->repairIndex--;
+        } else {
+            range->lost = job->repairErrors;
+            job->repairAttempts = 0;
+        }
+    }
+
+    if (job->repairIndex >= job->repairRanges->len) {
+        // The probe only saw the fast pass, so sum up what's in the spool now
+        RippitTrackChecksum repaired;
+        rippit_track_checksum_init(&repaired, trackSamples(job), job->curTrack == 1, job->curTrack == job->trackCount);
+        rippit_spool_track_foreach(job->spoolTrack, checksumBuffer, &repaired);
+        GST_INFO("Track %d repaired, CRC %08X -> %08X", job->curTrack, job->checksum.crc, repaired.crc);
+        if (repaired.crc == job->checksum.crc)
+            setOutputMessage(job, "Track %d was fine after all", job->curTrack);
+        else
+            setOutputMessage(job, "Track %d repaired", job->curTrack);
+        job->checksum = repaired;
+        logTrackChecksum(job, TRUE, "repaired");
+        logRepairs(job);
+        job->repairing = FALSE;
+        rippit_spool_track_release(job->spoolTrack);
+        return FALSE;
+    }
+
+    range = &g_array_index(job->repairRanges, SectorRange, job->repairIndex++);
+    job->repairAttempts++;
+    job->repairErrors = FALSE;
+    speed = MAX(1, REPAIR_SPEED / job->repairAttempts);
+    GST_DEBUG("Re-reading sectors %ld-%ld of track %d at %dx", (long)range->start, (long)range->end, job->curTrack, speed);
+
+    isStalled(job);
+    gst_element_set_state(job->pipeline, GST_STATE_NULL);
+    setParanoiaMode(job->cdsrc, PARANOIA_MODE_FULL);
+    setReadSpeed(job->cdsrc, speed);
+    g_object_set(G_OBJECT(job->cdsrc), "track", job->curTrack, NULL);
+    gst_element_set_state(job->pipeline, GST_STATE_READY);
+    seekTrack(job, range->start, range->end);
+    gst_element_set_state(job->pipeline, GST_STATE_PLAYING);
+    return TRUE;
+}
+
+// Picks up the next track that was left for the end of the disc. FALSE
+// once there aren't any.
+static gboolean repairDeferred(RippitJob *job)
+{
+    DeferredTrack *deferred = g_queue_pop_head(job->deferred);
+
+    if (!deferred)
+        return FALSE;
+    job->heldBytes -= deferred->size;
+    job->curTrack = deferred->track;
+    job->spoolTrack = deferred->spoolTrack;
+    job->checksum = deferred->checksum;
+    job->checksumTrack = deferred->track;
+    g_free(job->curLocation);
+    job->curLocation = deferred->location;
+    g_array_free(job->repairRanges, TRUE);
+    job->repairRanges = deferred->ranges;
+    g_free(deferred);
+
+    job->repairing = TRUE;
+    job->repairIndex = 0;
+    job->repairAttempts = 0;
+    setOutputMessage(job, "Going back for %d damaged parts of track %d", job->repairRanges->len, job->curTrack);
+    repairNextRange(job);
+    return TRUE;
+}
+
+// Gives up on the tracks left for later, so their encoders aren't kept
+// waiting on re-reads that won't happen. If the job failed they're thrown
+// away, since they still have holes in them.
+static void dropDeferred(RippitJob *job)
+{
+    DeferredTrack *deferred;
+
+    while ((deferred = g_queue_pop_head(job->deferred))) {
+        if (job->failed)
+            rippit_spool_track_abandon(deferred->spoolTrack);
+        else
+            rippit_spool_track_release(deferred->spoolTrack);
+        g_array_free(deferred->ranges, TRUE);
+        g_free(deferred->location);
+        g_free(deferred);
+    }
+    job->heldBytes = 0;
+}
+
+// Rather than sitting on a spot the drive can't get past, or throwing the
+// whole track away, put silence in its place, mark it down to be re-read
+// at the end, and carry on after it
+static void skipDamage(RippitJob *job)
+{
+    gint64 trackStart = job->trackStarts ? job->trackStarts[job->curTrack-1] : 0;
+    gint64 trackSectors = trackSamples(job) / CD_SAMPLES_PER_SECTOR;
+    gint64 from = currentTrackBytes(job) / CD_FRAMESIZE_RAW;
+    gint64 to = from + STALL_SKIP;
+    GstBuffer *silence;
+    gint64 sector;
+
+    if (trackSectors > 0)
+        to = MIN(to, trackSectors);
+    GST_INFO("Track %d stuck at sector %ld, skipping to %ld", job->curTrack, (long)from, (long)to);
+    setOutputMessage(job, "Can't get past sector %ld of track %d, coming back for it later", (long)(trackStart + from), job->curTrack);
+
+    gst_element_set_state(job->pipeline, GST_STATE_NULL);
+    for (sector = from; sector < to; sector++)
+        recordBadSector(job, trackStart + sector);
+
+    if (to > from) {
+        silence = gst_buffer_new_and_alloc((to - from) * CD_FRAMESIZE_RAW);
+        memset(GST_BUFFER_DATA(silence), 0, GST_BUFFER_SIZE(silence));
+        GST_BUFFER_TIMESTAMP(silence) = sectorTime(from);
+        GST_BUFFER_DURATION(silence) = sectorTime(to) - sectorTime(from);
+        rippit_spool_track_push(job->spoolTrack, silence);
+    }
+    job->statsTrack = job->curTrack;
+    job->trackBytes = to * CD_FRAMESIZE_RAW;
+
+    job->stallDetected = 0;
+    job->lastProgress = gst_util_get_timestamp();
+    if (trackSectors > 0 && to >= trackSectors) {
+        // It's the rest of the track that's bad
+        trackRead(job);
+        return;
+    }
+    g_object_set(G_OBJECT(job->cdsrc), "track", job->curTrack, NULL);
+    gst_element_set_state(job->pipeline, GST_STATE_READY);
+    seekTrack(job, to, -1);
+    gst_element_set_state(job->pipeline, GST_STATE_PLAYING);
+}
+
+static gboolean skipIfStalled(gpointer data)
+{
+    RippitJob *job = data;
+    GST_DEBUG("Skipping?");
+    if (job->done)
+        return FALSE;
+    if (!isStalled(job)) {
+        job->timeoutSource = g_timeout_add_seconds(job->options.stallTimeout, checkForStall, job);
+    } else if (job->options.adaptive && job->spoolTrack) {
+        job->timeoutSource = 0;
+        if (job->repairing) {
+            GST_INFO("Re-reading part of track %d stalled, giving up on it", job->curTrack);
+            setOutputMessage(job, "Giving up on part of track %d", job->curTrack);
+            job->repairErrors = TRUE;
+            job->repairAttempts = REPAIR_ATTEMPTS;
+            trackRead(job);
+        } else {
+            skipDamage(job);
+        }
+        if (!job->done && job->timeoutSource == 0)
+            job->timeoutSource = g_timeout_add_seconds(job->options.stallTimeout, checkForStall, job);
+    } else if (job->options.ignoreStall) {
+        job->timeoutSource = 0;
+        GST_INFO("Skipping track %d, %.1fs after the last progress", job->curTrack,
+                 (gdouble)(gst_util_get_timestamp() - job->lastProgress) / GST_SECOND);
+        setOutputMessage(job, "Skipping track in the hopes that others may work. Sorry it didn't work out.");
+        logTrackChecksum(job, FALSE, "skipped");
+        startNextTrack(job);
+    } else {
+        job->timeoutSource = 0;
+    }
+    return FALSE;
+}
+
+static gboolean checkForStall(gpointer data)
+{
+    RippitJob *job = data;
+    GST_DEBUG("stall check");
+    if (isStalled(job)) {
+        job->stallDetected = gst_util_get_timestamp();
+        GST_INFO("Track %d stalled, noticed %.1fs after the last progress", job->curTrack,
+                 (gdouble)(job->stallDetected - job->lastProgress) / GST_SECOND);
+        if (job->dvdsrc) {
+            setOutputMessage(job, "Still waiting to decode title. Perhaps the DVD is scratched, or really weird?");
+        } else {
+            setOutputMessage(job, "Still waiting to decode track. Is the disc scratched?");
+        }
+        GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(job->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "stalled");
+        job->timeoutSource = g_timeout_add_seconds(job->options.stallTimeout, skipIfStalled, job);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean isStalled(RippitJob *job)
+{
+    guint64 pos;
+
+    if (job->stallTrack != job->curTrack) {
+        job->stallTrack = job->curTrack;
+        job->stallPos = 0;
+        job->lastProgress = gst_util_get_timestamp();
+        GST_DEBUG("lastTrack != curTrack");
+        return FALSE;
+    }
+
+    pos = getPos(job);
+    if (job->stallPos != pos) {
+        if (job->stallDetected > 0) {
+            GST_INFO("Track %d got going again %.1fs after the stall was noticed", job->curTrack,
+                     (gdouble)(gst_util_get_timestamp() - job->stallDetected) / GST_SECOND);
+            job->stallDetected = 0;
+        }
+        job->stallPos = pos;
+        job->lastProgress = gst_util_get_timestamp();
+        GST_DEBUG("lastPos != getPos");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static guint64 titleBytes(RippitDvdTitle *title)
+{
+    guint64 sectors = 0;
+    int i;
+    for (i = 0; i < title->cells->len; i++) {
+        RippitDvdCell *cell = &g_array_index(title->cells, RippitDvdCell, i);
+        sectors += cell->lastSector - cell->firstSector + 1;
+    }
+    return sectors * DVD_SECTOR_SIZE;
+}
+
+// 0 if we can't tell
+static guint64 trackSize(RippitJob *job, int track)
+{
+    if (job->dvdTitles) {
+        RippitDvdTitle *title = findTitle(job, track);
+        return title ? titleBytes(title) : 0;
+    }
+    if (!job->trackStarts || track < 1 || track > job->trackCount)
+        return 0;
+    if (track < job->trackCount)
+        return (job->trackStarts[track] - job->trackStarts[track-1]) * CD_FRAMESIZE_RAW;
+    if (job->leadout > job->trackStarts[track-1])
+        return (job->leadout - job->trackStarts[track-1]) * CD_FRAMESIZE_RAW;
+    return 0;
+}
+
+static guint64 currentTrackBytes(RippitJob *job)
+{
+    return job->statsTrack == job->curTrack ? job->trackBytes : 0;
+}
+
+// What's left of the current track and the ones after it that we want
+static guint64 bytesLeft(RippitJob *job)
+{
+    guint64 left = 0;
+    guint64 size;
+    int track;
+
+    // Re-reads at the end jump about too much to say
+    if (job->done || job->curTrack < 1 || job->repairPass)
+        return 0;
+    for (track = job->curTrack; wantTrack(job, track); track++) {
+        // Titles we skip don't count
+        if (job->dvdTitles && !findTitle(job, track))
+            continue;
+        size = trackSize(job, track);
+        if (size == 0)
+            return 0;
+        left += size;
+    }
+    return left - MIN(left, currentTrackBytes(job));
+}
+
+static int jobPercent(RippitJob *job)
+{
+    guint64 size = trackSize(job, job->curTrack);
+    guint64 duration;
+    guint64 left;
+
+    // The probes already know, without asking the pipeline
+    if (job->cdsrc && (job->options.continuous || job->options.image)) {
+        left = bytesLeft(job);
+        if (!job->done && left > 0)
+            return job->bytesRead * 100 / (job->bytesRead + left);
+    } else if (!job->done && size > 0) {
+        return MIN(100, currentTrackBytes(job) * 100 / size);
+    }
+    duration = getDuration(job);
+    if (job->done || duration == 0)
+        return job->done ? 100 : 0;
+    return ((double)getPos(job)/(double)duration)*100;
+}
+
+static gchar *imageName(RippitJob *job)
+{
+    return g_strdup_printf("%s.flac", job->discID);
+}
+
+static void writeCueSheet(RippitJob *job)
+{
+    gchar *name = imageName(job);
+    gchar *cueName = g_strdup_printf("%s.cue", job->discID);
+    GError *error = NULL;
+
+    g_mutex_lock(job->lock);
+    if (!rippit_cue_sheet_write(cueName, name, job->discID, job->discInfo, job->trackStarts, job->trackCount, &error)) {
+        g_warning("Could not write %s: %s", cueName, error->message);
+        g_error_free(error);
+    }
+    g_mutex_unlock(job->lock);
+    g_free(cueName);
+    g_free(name);
+}
+
+// Works out where the current track goes, and with which tags. The tags
+// may come back NULL if there's nothing worth tagging with.
+static gchar *trackOutputName(RippitJob *job, GstTagList **tags)
+{
+    gchar *outname;
+
+    *tags = NULL;
+    if (job->dvdsrc)
+        return g_strdup_printf("%s - %d.mkv", job->discID, job->curTrack);
+
+    g_mutex_lock(job->lock);
+    if (job->discInfo && !job->options.forceRip) {
+        *tags = trackTags(job, job->curTrack);
+        outname = taggedName(job, job->curTrack);
+    } else {
+        outname = g_strdup_printf("%s - %d.flac", job->discID, job->curTrack);
+        if (job->lookupPending) {
+            ProvisionalTrack *track = g_new0(ProvisionalTrack, 1);
+            track->track = job->curTrack;
+            track->location = g_strdup(outname);
+            job->provisional = g_list_append(job->provisional, track);
+        }
+    }
+    g_mutex_unlock(job->lock);
+
+    g_free(job->curLocation);
+    job->curLocation = g_strdup(outname);
+    return outname;
+}
+
+static RippitDvdTitle *findTitle(RippitJob *job, int title)
+{
+    int i;
+    for (i = 0; i < job->dvdTitles->len; i++) {
+        RippitDvdTitle *found = g_ptr_array_index(job->dvdTitles, i);
+        if (found->title == title)
+            return found;
+    }
+    return NULL;
+}
+
+static gboolean wantTrack(RippitJob *job, int track)
+{
+    return track <= job->trackCount && (job->options.singleTrack < 0 || track <= job->options.singleTrack);
+}
+
+// In continuous mode the whole disc is one stream, so this is how many bytes
+// of it belong to the current track. The last one just runs until EOS.
+static guint64 trackLength(RippitJob *job)
+{
+    if (!job->trackStarts || job->curTrack >= job->trackCount)
+        return G_MAXINT64;
+    return (job->trackStarts[job->curTrack] - job->trackStarts[job->curTrack-1]) * CD_FRAMESIZE_RAW;
+}
+
+// Unlike trackLength, this knows where the last track ends too, which
+// AccurateRip needs. 0 if we can't tell.
+static guint64 trackSamples(RippitJob *job)
+{
+    guint64 length = trackLength(job);
+    if (length != G_MAXINT64)
+        return length / 4;
+    if (job->trackStarts && job->leadout > job->trackStarts[job->curTrack-1])
+        return (job->leadout - job->trackStarts[job->curTrack-1]) * CD_SAMPLES_PER_SECTOR;
+    return 0;
+}
+
+static void beginChecksum(RippitJob *job)
+{
+    if (!job->cdsrc)
+        return;
+    rippit_track_checksum_init(&job->checksum, trackSamples(job), job->curTrack == 1, job->curTrack == job->trackCount);
+    job->checksumTrack = job->curTrack;
+}
+
+// The rip log is opened next to the tracks the first time there's
+// something to put in it. Called with the lock held.
+static void openRipLog(RippitJob *job)
+{
+    // Named after the disc, so not until we know which one it is
+    if (!job->ripLog && job->discID) {
+        gchar *logName = g_strdup_printf("%s.log", job->discID);
+        job->ripLog = fopen(logName, "a");
+        if (job->ripLog) {
+            fprintf(job->ripLog, "rippit %s\n", RIPPIT_VERSION_STRING);
+            fprintf(job->ripLog, "Disc %s in %s\n", job->discID, job->device);
+            if (job->toc)
+                fprintf(job->ripLog, "TOC %s\n", job->toc);
+            fprintf(job->ripLog, "\n");
+        } else {
+            g_warning("Could not open rip log %s", logName);
+        }
+        g_free(logName);
+    }
+}
+
+// Notes a track down for the library. With only an image being written,
+// location is NULL and that's where every track is. Called with the lock
+// held.
+static void rememberTrack(RippitJob *job, int track, const gchar *location, const RippitTrackChecksum *sum)
+{
+    gchar *image = NULL;
+
+    if (!job->ripped)
+        return;
+    if (!location)
+        image = imageName(job);
+    rippit_library_entry_add_track(job->ripped, track, image ? image : location, sum);
+    g_free(image);
+}
+
+// Called with the lock held
+static void writeChecksumLine(RippitJob *job, int track, const RippitTrackChecksum *sum, const gchar *note)
+{
+    openRipLog(job);
+    if (job->ripLog) {
+        fprintf(job->ripLog, "Track %2d  CRC32 %08X  AccurateRip v1 %08X  v2 %08X",
+                track, sum->crc, sum->arV1, sum->arV2);
+        if (note)
+            fprintf(job->ripLog, "  (%s)", note);
+        fprintf(job->ripLog, "\n");
+        fflush(job->ripLog);
+    }
+}
+
+// Adds the current track to the rip log. Called from both the main loop
+// and the streaming thread, hence the lock.
+static void logTrackChecksum(RippitJob *job, gboolean complete, const gchar *note)
+{
+    if (job->checksumTrack == 0)
+        return;
+
+    if (complete && job->journal)
+        rippit_journal_track_read(job->journal, job->checksumTrack, job->curLocation, &job->checksum);
+
+    g_mutex_lock(job->lock);
+    if (complete)
+        rememberTrack(job, job->checksumTrack, job->curLocation, &job->checksum);
+    writeChecksumLine(job, job->checksumTrack, &job->checksum, note);
+    job->checksumTrack = 0;
+    g_mutex_unlock(job->lock);
+}
+
+static gboolean encoderBuffer_cb(GstPad *pad, GstBuffer *buffer, gpointer data)
+{
+    RippitJob *job = data;
+    job->bytesEncoded += GST_BUFFER_SIZE(buffer);
+    return TRUE;
+}
+
+static void watchEncoder(RippitJob *job, GstElement *encoder)
+{
+    GstPad *pad = gst_element_get_static_pad(encoder, "sink");
+    gst_pad_add_buffer_probe(pad, G_CALLBACK(encoderBuffer_cb), job);
+    gst_object_unref(pad);
+}
+
+static guint64 writeBufferBytes(RippitJob *job)
+{
+    return (guint64)job->options.writeBuffer * 1024 * 1024;
+}
+
+// A filesink, or with --write-buffer, one that writes behind the pipeline
+static GstElement *makeFileSink(RippitJob *job)
+{
+    return rippit_write_sink_make(writeBufferBytes(job), job->writeStats);
+}
+
+static GstElement *buildFlacOutput(RippitJob *job)
+{
+    GstElement *bin = gst_bin_new(NULL);
+    GstElement *encoder = gst_element_factory_make("flacenc", NULL);
+    GstElement *tagger = gst_element_factory_make("flactag", NULL);
+    GstElement *output = makeFileSink(job);
+    GstPad *pad;
+
+    g_object_set(G_OBJECT(output), "location", "/dev/null", NULL);
+
+    gst_bin_add_many(GST_BIN(bin), encoder, tagger, output, NULL);
+    gst_element_link_many(encoder, tagger, output, NULL);
+    watchEncoder(job, encoder);
+
+    pad = gst_element_get_static_pad(encoder, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+    gst_object_unref(pad);
+
+    job->tag_setter = GST_TAG_SETTER(tagger);
+    job->filesink = output;
+    job->output = bin;
+    return bin;
+}
+
+// Called from the streaming thread, right before the first buffer of the
+// next track goes out. The old encoder gets its EOS so it can finish the
+// file, and a fresh one takes its place without the source ever stopping.
+static void swapOutput(RippitJob *job, GstPad *pad, GstBuffer *buffer)
+{
+    GstTagList *tags;
+    GstElement *old;
+    GstPad *sinkpad;
+    gchar *outname;
+    FinishedTrack *finished;
+
+    finished = g_new0(FinishedTrack, 1);
+    finished->job = job;
+    finished->location = g_strdup(job->curLocation);
+
+    job->transitionStart = gst_util_get_timestamp();
+    logTrackChecksum(job, TRUE, NULL);
+    job->curTrack++;
+    job->trackRemaining = trackLength(job);
+    beginChecksum(job);
+    g_idle_add(reportProgress_idle, job);
+    outname = trackOutputName(job, &tags);
+    GST_DEBUG("Continuing with track %d on %s", job->curTrack, job->device);
+
+    if (job->spool) {
+        // The spool tells us itself once the old track has been encoded
+        closeSpoolTrack(job);
+        job->spoolTrack = rippit_spool_add_track(job->spool, outname, tags);
+        g_free(finished->location);
+        g_free(finished);
+        g_free(outname);
+        return;
+    }
+
+    // Take the old branch out of the pipeline first, so its EOS doesn't look
+    // like the end of the disc to the bus.
+    old = gst_object_ref(job->output);
+    gst_bin_remove(GST_BIN(job->pipeline), old);
+    sinkpad = gst_element_get_static_pad(old, "sink");
+    gst_pad_send_event(sinkpad, gst_event_new_eos());
+    gst_object_unref(sinkpad);
+    gst_element_set_state(old, GST_STATE_NULL);
+    gst_object_unref(old);
+    g_idle_add(markFinished_idle, finished);
+
+    buildFlacOutput(job);
+    g_object_set(G_OBJECT(job->filesink), "location", outname, NULL);
+    if (tags) {
+        gst_tag_setter_merge_tags(job->tag_setter, tags, GST_TAG_MERGE_REPLACE_ALL);
+        gst_tag_list_free(tags);
+    }
+    gst_bin_add(GST_BIN(job->pipeline), job->output);
+    gst_element_link(job->splitSrc, job->output);
+    gst_element_sync_state_with_parent(job->output);
+    gst_pad_push_event(pad, gst_event_new_new_segment(FALSE, 1.0, GST_FORMAT_TIME, GST_BUFFER_TIMESTAMP(buffer), -1, GST_BUFFER_TIMESTAMP(buffer)));
+
+    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(job->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, outname);
+    g_free(outname);
+}
+
+// With only an image being written, the next track starting just means
+// there are checksums to work out for it.
+static void nextImageTrack(RippitJob *job)
+{
+    logTrackChecksum(job, TRUE, NULL);
+    job->curTrack++;
+    job->trackRemaining = trackLength(job);
+    beginChecksum(job);
+    g_idle_add(reportProgress_idle, job);
+}
+
+static gboolean finishJob_idle(gpointer data)
+{
+    RippitJob *job = data;
+    setOutputMessage(job, "Complete!");
+    finishJob(job);
+    return FALSE;
+}
+
+static gboolean sourceBuffer_cb(GstPad *pad, GstBuffer *buffer, gpointer data)
+{
+    RippitJob *job = data;
+
+    if (job->draining)
+        return FALSE;
+
+    if (job->firstSector == 0) {
+        job->firstSector = gst_util_get_timestamp() - job->created;
+        GST_INFO("First sector off %s %.1fms in", job->device, (gdouble)job->firstSector / GST_MSECOND);
+        // Getting to the first track isn't a change of track
+        job->transitionStart = 0;
+    }
+
+    if ((job->options.continuous || job->options.image) && job->cdsrc && job->trackRemaining == 0) {
+        if (!wantTrack(job, job->curTrack+1)) {
+            GstPad *sinkpad;
+
+            // Nothing more we want off this disc; finish the file and let
+            // the main loop shut the drive down.
+            job->draining = TRUE;
+            logTrackChecksum(job, TRUE, NULL);
+            if (job->spool) {
+                closeSpoolTrack(job);
+            } else {
+                sinkpad = gst_element_get_static_pad(job->output, "sink");
+                gst_pad_send_event(sinkpad, gst_event_new_eos());
+                gst_object_unref(sinkpad);
+            }
+            g_idle_add(finishJob_idle, job);
+            return FALSE;
+        }
+        // cdparanoiasrc hands out a sector at a time and tracks start on
+        // sector boundaries, so each buffer belongs to exactly one track
+        // and can go out as it is
+        if (job->output)
+            swapOutput(job, pad, buffer);
+        else
+            nextImageTrack(job);
+    }
+
+    if (job->transitionStart > 0) {
+        GstClockTime transition = gst_util_get_timestamp() - job->transitionStart;
+        job->transitionTotal += transition;
+        job->transitionMax = MAX(job->transitionMax, transition);
+        job->transitions++;
+        job->transitionStart = 0;
+    }
+
+    // Re-reads in adaptive mode only cover bits of the track; the spool
+    // gets summed up again once they're in.
+    if (job->checksumTrack > 0 && !job->repairing) {
+        rippit_track_checksum_update(&job->checksum, GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer));
+        if (job->journal)
+            rippit_journal_write_partial(job->journal, GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer));
+    }
+
+    if (job->statsTrack != job->curTrack) {
+        job->statsTrack = job->curTrack;
+        job->trackBytes = 0;
+    }
+    if (!job->repairing)
+        job->trackBytes += GST_BUFFER_SIZE(buffer);
+    job->bytesRead += GST_BUFFER_SIZE(buffer);
+
+    job->trackRemaining -= MIN(job->trackRemaining, GST_BUFFER_SIZE(buffer));
+    return TRUE;
+}
+
+// Feeds the spool whatever the journal kept of the current track from the
+// last time, and says which sector to carry on reading from.
+static gint64 resumeTrack(RippitJob *job)
+{
+    gint64 sectors = rippit_journal_track_progress(job->journal, job->curTrack);
+    gchar *contents;
+    gsize length;
+    gsize offset;
+
+    if (sectors > 0 && !rippit_journal_read_partial(job->journal, job->curTrack, &contents, &length))
+        sectors = 0;
+    rippit_journal_begin_partial(job->journal, job->curTrack, sectors);
+    if (sectors == 0)
+        return 0;
+
+    setOutputMessage(job, "Resuming track %d from sector %ld", job->curTrack, (long)sectors);
+    for (offset = 0; offset < length; offset += RESUME_CHUNK) {
+        gsize size = MIN(RESUME_CHUNK, length - offset);
+        GstBuffer *buffer = gst_buffer_new_and_alloc(size);
+
+        memcpy(GST_BUFFER_DATA(buffer), contents + offset, size);
+        GST_BUFFER_TIMESTAMP(buffer) = gst_util_uint64_scale_int(offset / 4, GST_SECOND, 44100);
+        GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(size / 4, GST_SECOND, 44100);
+        rippit_track_checksum_update(&job->checksum, GST_BUFFER_DATA(buffer), size);
+        rippit_spool_track_push(job->spoolTrack, buffer);
+    }
+    g_free(contents);
+    return sectors;
+}
+
+static void startNextTrack(RippitJob *job)
+{
+    gint64 resumeFrom = 0;
+    gchar *outname;
+    GstTagList *tags;
+    RippitTrackChecksum doneSum;
+    gchar *doneLocation;
+
+    job->transitionStart = gst_util_get_timestamp();
+
+    // Reset the stall detector
+    isStalled(job);
+
+    if (job->timeoutSource > 0)
+        g_source_remove(job->timeoutSource);
+    job->stallDetected = 0;
+    job->timeoutSource = g_timeout_add_seconds(job->options.stallTimeout, checkForStall, job);
+
+    logTrackChecksum(job, TRUE, NULL);
+    job->curTrack++;
+    while (job->journal && wantTrack(job, job->curTrack) && rippit_journal_track_done(job->journal, job->curTrack, &doneSum, &doneLocation)) {
+        setOutputMessage(job, "Track %d was ripped last time, skipping it", job->curTrack);
+        // It's still part of the disc, as far as the rip log and the
+        // library are concerned
+        g_mutex_lock(job->lock);
+        rememberTrack(job, job->curTrack, doneLocation, &doneSum);
+        writeChecksumLine(job, job->curTrack, &doneSum, "ripped last time");
+        g_mutex_unlock(job->lock);
+        g_free(doneLocation);
+        job->curTrack++;
+    }
+    while (job->dvdTitles && wantTrack(job, job->curTrack) && !findTitle(job, job->curTrack)) {
+        GST_DEBUG("Skipping title %d, it's empty or a copy of another one", job->curTrack);
+        job->curTrack++;
+    }
+    if (!wantTrack(job, job->curTrack)) {
+        if (!g_queue_is_empty(job->deferred)) {
+            // The rest of the disc is in, so there's time to be careful
+            GST_INFO("Read to the end of %s, %d damaged tracks to go back to", job->device, g_queue_get_length(job->deferred));
+            closeSpoolTrack(job);
+            job->repairPass = TRUE;
+            repairDeferred(job);
+            return;
+        }
+        setOutputMessage(job, "Complete!");
+        finishJob(job);
+        return;
+    }
+
+
+    GST_DEBUG("Starting with track %d on %s", job->curTrack, job->device);
+
+    gst_element_set_state(job->pipeline, GST_STATE_NULL);
+    dropCopiedTitle(job);
+    closeSpoolTrack(job);
+    if (!job->spool && job->curLocation)
+        markFinished(job, job->curLocation);
+    job->trackRemaining = trackLength(job);
+    beginChecksum(job);
+
+    if (job->spotChecking) {
+        // Only the checksum matters
+        tags = NULL;
+        outname = g_strdup("/dev/null");
+    } else if (job->imagesink && !job->output) {
+        tags = NULL;
+        outname = imageName(job);
+    } else {
+        outname = trackOutputName(job, &tags);
+    }
+
+    if (job->cdsrc) {
+        g_object_set(G_OBJECT(job->cdsrc), "track", job->curTrack, NULL);
+        if (job->options.adaptive) {
+            job->repairing = FALSE;
+            g_array_set_size(job->badSectors, 0);
+            setParanoiaMode(job->cdsrc, PARANOIA_MODE_OVERLAP);
+            // 0 is full speed again; -1 would leave the drive as slow as
+            // the last re-read had it
+            setReadSpeed(job->cdsrc, 0);
+        }
+        // Opening the drive again mustn't undo what the controller worked out
+        if (job->speed)
+            setReadSpeed(job->cdsrc, rippit_speed_control_get_speed(job->speed));
+    } else if (job->dvdTitles) {
+        g_object_set(G_OBJECT(job->dvdsrc), "title", job->curTrack, "chapter", 1, NULL);
+    } else {
+        // Without the title table, the only way to spot a dummy title is to
+        // open it up and look
+        gint64 titleLength = 0;
+        gst_element_set_state(job->dvdsrc, GST_STATE_NULL);
+        g_object_set(G_OBJECT(job->dvdsrc), "title", job->curTrack, NULL);
+        g_object_set(G_OBJECT(job->dvdsrc), "chapter", 1, NULL);
+        gst_element_set_state(job->dvdsrc, GST_STATE_PAUSED);
+        titleLength = getDuration(job);
+        gst_element_set_state(job->dvdsrc, GST_STATE_NULL);
+        if (titleLength == 0) {
+            setOutputMessage(job, "Skipping title %d, it appears to be a dummy title.", job->curTrack);
+            if (tags)
+                gst_tag_list_free(tags);
+            startNextTrack(job);
+            g_free(outname);
+            return;
+        }
+    }
+
+    if (job->imagesink && job->curTrack == 1) {
+        gchar *name = imageName(job);
+        g_object_set(G_OBJECT(job->imagesink), "location", name, NULL);
+        g_free(name);
+    }
+
+    if (job->spotChecking) {
+        // Without a spool track, whatever reaches the spool gets dropped
+        if (job->filesink) {
+            gst_element_set_state(job->filesink, GST_STATE_NULL);
+            g_object_set(G_OBJECT(job->filesink), "location", outname, NULL);
+            gst_element_set_state(job->filesink, GST_STATE_READY);
+        }
+    } else if (!job->filesink && job->imagesink) {
+        setOutputMessage(job, "Reading the whole disc into %s", outname);
+    } else if (job->spool && job->cdsrc) {
+        setOutputMessage(job, "Spooling %s", outname);
+        job->spoolTrack = rippit_spool_add_track(job->spool, outname, tags);
+        if (job->options.adaptive)
+            rippit_spool_track_hold(job->spoolTrack);
+        else if (job->journal && !job->options.continuous)
+            resumeFrom = resumeTrack(job);
+    } else {
+        if (job->titlePool && job->dvdsrc)
+            setOutputMessage(job, "Copying title %d, to be encoded into %s", job->curTrack, outname);
+        else
+            setOutputMessage(job, "Ripping to %s", outname);
+
+        if (tags) {
+            gst_element_set_state(job->pipeline, GST_STATE_READY);
+            gst_tag_setter_merge_tags(job->tag_setter, tags, GST_TAG_MERGE_REPLACE_ALL);
+            gst_tag_list_free(tags);
+        }
+
+        gst_element_set_state(job->filesink, GST_STATE_NULL);
+        if (job->titlePool && job->dvdsrc) {
+            job->copyLocation = g_strdup_printf("%s - %d.vob", job->discID, job->curTrack);
+            g_object_set(G_OBJECT(job->filesink), "location", job->copyLocation, NULL);
+        } else {
+            g_object_set(G_OBJECT(job->filesink), "location", outname, NULL);
+        }
+        gst_element_set_state(job->filesink, GST_STATE_READY);
+    }
+
+    if (resumeFrom > 0) {
+        gst_element_set_state(job->pipeline, GST_STATE_READY);
+        seekTrack(job, resumeFrom, -1);
+    }
+    gst_element_set_state(job->pipeline, GST_STATE_PLAYING);
+    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(job->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, outname);
+    g_free(outname);
+    reportProgress(job);
+}
+
+static gboolean element_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    const GstStructure *str = gst_message_get_structure(msg);
+    GST_DEBUG("Got element message %s", gst_structure_get_name(str));
+    return TRUE;
+}
+
+// A track, or a part of one being re-read, has been read to the end
+static void trackRead(RippitJob *job)
+{
+    if (job->spotChecking) {
+        finishSpotCheck(job);
+        return;
+    }
+    if (job->options.adaptive && job->spoolTrack && repairNextRange(job))
+        return;
+    if (job->repairPass) {
+        // Released already, and it may be encoded and gone any moment
+        job->spoolTrack = NULL;
+        if (!repairDeferred(job)) {
+            setOutputMessage(job, "Complete!");
+            finishJob(job);
+        }
+        return;
+    }
+    if (job->copyLocation) {
+        // The copy is complete, so it's the pool's now
+        RippitDvdTitle *title = NULL;
+        if (job->options.splitTitles && job->dvdTitles)
+            title = findTitle(job, job->curTrack);
+        rippit_title_pool_add(job->titlePool, job->copyLocation, job->curLocation, title);
+        g_free(job->copyLocation);
+        job->copyLocation = NULL;
+    }
+    // DVDs have nothing to checksum, so they're remembered here instead
+    if (job->dvdsrc) {
+        g_mutex_lock(job->lock);
+        rememberTrack(job, job->curTrack, job->curLocation, NULL);
+        g_mutex_unlock(job->lock);
+    }
+    GST_DEBUG("End of track, advancing");
+    startNextTrack(job);
+}
+
+static gboolean eos_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    trackRead(data);
+    return TRUE;
+}
+
+static gboolean state_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    GstState oldState;
+    GstState newState;
+    GstState pendingState;
+    gchar *name;
+
+    gst_message_parse_state_changed(msg, &oldState, &newState, &pendingState);
+    name = gst_element_get_name(msg->src);
+    GST_DEBUG("Element %s changed state from %s to %s", name, gst_element_state_get_name(oldState), gst_element_state_get_name(newState));
+    g_free(name);
+    return TRUE;
+}
+
+static void reportContributeUrl(RippitJob *job)
+{
+    gchar **tocParts;
+    GString *encodedToc;
+    int i = 0;
+
+    if (!job->toc) {
+        setOutputMessage(job, "Could not get musicbrainz information for the disc in %s.", job->device);
+        return;
+    }
+
+    encodedToc = g_string_new(0);
+    tocParts = g_strsplit(job->toc, " ", 0);
+    i = 0;
+    while(tocParts[i]) {
+        int framePos;
+        sscanf(tocParts[i], "%x", &framePos);
+        g_string_append_printf(encodedToc, "%d+", framePos);
+        i++;
+    }
+    g_strfreev(tocParts);
+    g_string_truncate(encodedToc, encodedToc->len-1);
+
+    setOutputMessage(job, "Could not get musicbrainz information for the disc in %s.\n"
+                          "Please visit the following url to contribute disc information:\n"
+                          "http://musicbrainz.org/bare/cdlookup.html?id=%s&tracks=%d&toc=%s\n"
+                          "If you want to rip anyways, force the rip",
+                     job->device, job->discID, (int)job->trackCount, encodedToc->str);
+
+    g_string_free(encodedToc, TRUE);
+}
+
+static void discInfo_cb(RippitDiscInfo *info, gpointer data)
+{
+    RippitJob *job = data;
+
+    g_mutex_lock(job->lock);
+    job->lookupPending = FALSE;
+    job->discInfo = info;
+    g_mutex_unlock(job->lock);
+
+    if (info) {
+        setOutputMessage(job, "Found %s by %s", info->album, info->artist);
+        fixProvisionalTracks(job);
+        // The CUE sheet went out before we knew what to call anything
+        if (job->done && job->imagesink && job->trackStarts)
+            writeCueSheet(job);
+    } else {
+        reportContributeUrl(job);
+        // Whatever is being ripped right now is only half there, which
+        // finishJob() takes care of
+        job->failed = TRUE;
+        finishJob(job);
+    }
+    quitIfFinished(job);
+}
+
+// Once we know which CD it is
+static void startRip(RippitJob *job)
+{
+    GError *error = NULL;
+
+    // An image is all or nothing, there's no resuming that
+    if (!job->options.image)
+        job->journal = rippit_journal_open(job->discID, &error);
+    if (!job->options.image && !job->journal) {
+        g_warning("%s, rips of this disc can't be resumed", error->message);
+        g_error_free(error);
+    }
+    if (job->journal && job->rerip)
+        rippit_journal_reset(job->journal);
+
+    if (!job->options.forceRip) {
+        job->discInfo = rippit_disc_info_load(job->options.metadataCache, job->discID);
+        if (!job->discInfo) {
+            // Start ripping under the disc ID straight away; the tracks
+            // get renamed once the lookup comes back.
+            setOutputMessage(job, "Looking up disc information...");
+            job->lookupPending = TRUE;
+            rippit_disc_info_lookup_async(job->options.metadataCache, job->options.musicbrainzServer, job->discID, discInfo_cb, job);
+        }
+    }
+    startNextTrack(job);
+}
+
+// How many tracks or titles a finished rip of the whole disc has
+static guint discTracks(RippitJob *job)
+{
+    if (job->dvdsrc)
+        return job->dvdTitles ? job->dvdTitles->len : 0;
+    return job->trackCount;
+}
+
+// TRUE if the library has already got the whole disc, with every file of
+// it still there, and there's nothing for the job to do but finish. Also
+// TRUE while a spot check is making sure it really is the same disc;
+// finishSpotCheck() carries on from there.
+static gboolean skipKnownDisc(RippitJob *job)
+{
+    RippitLibraryEntry *entry;
+    guint64 shortest = 0;
+    guint i;
+
+    if (!job->library || !job->libraryKey)
+        return FALSE;
+    entry = rippit_library_lookup(job->library, job->libraryKey);
+    for (i = 0; entry && i < entry->tracks->len; i++) {
+        RippitLibraryTrack *track = &g_array_index(entry->tracks, RippitLibraryTrack, i);
+        if (!g_file_test(track->location, G_FILE_TEST_EXISTS)) {
+            setOutputMessage(job, "%s was ripped before, but %s has gone; ripping it again", job->discID, track->location);
+            rippit_library_entry_free(entry);
+            entry = NULL;
+            job->rerip = TRUE;
+        }
+    }
+    if (entry && entry->tracks->len < discTracks(job)) {
+        GST_INFO("The library only has %d of the %d tracks of %s", entry->tracks->len, discTracks(job), job->discID);
+        rippit_library_entry_free(entry);
+        entry = NULL;
+    }
+    if (!entry) {
+        job->ripped = rippit_library_entry_new(job->libraryKey);
+        return FALSE;
+    }
+
+    // Reading the shortest track back is the quickest way to tell the
+    // disc is the one that was ripped, and not just one with the same TOC
+    if (job->options.spotCheck && job->cdsrc && !job->options.continuous && !job->options.image) {
+        for (i = 0; i < entry->tracks->len; i++) {
+            RippitLibraryTrack *track = &g_array_index(entry->tracks, RippitLibraryTrack, i);
+            guint64 size = trackSize(job, track->track);
+            if (size > 0 && (shortest == 0 || size < shortest)) {
+                shortest = size;
+                job->curTrack = track->track - 1;
+            }
+        }
+        if (shortest > 0) {
+            setOutputMessage(job, "%s is in the library, checking track %d against it", job->discID, job->curTrack + 1);
+            job->known = entry;
+            job->spotChecking = TRUE;
+            startNextTrack(job);
+            return TRUE;
+        }
+    }
+
+    setOutputMessage(job, "%s is already in the library, skipping it", job->discID);
+    rippit_library_entry_free(entry);
+    finishJob(job);
+    return TRUE;
+}
+
+// The track being spot checked has been read
+static void finishSpotCheck(RippitJob *job)
+{
+    const RippitLibraryTrack *known = rippit_library_entry_find_track(job->known, job->checksumTrack);
+    gboolean match = known && known->crc == job->checksum.crc && known->arV2 == job->checksum.arV2;
+    int track = job->checksumTrack;
+
+    logTrackChecksum(job, FALSE, match ? "spot check, matches the library" : "spot check, doesn't match the library");
+    job->spotChecking = FALSE;
+    rippit_library_entry_free(job->known);
+    job->known = NULL;
+
+    if (match) {
+        setOutputMessage(job, "Track %d matches the library, skipping the disc", track);
+        finishJob(job);
+        return;
+    }
+    setOutputMessage(job, "Track %d doesn't match the library, ripping the disc again", track);
+    job->rerip = TRUE;
+    job->ripped = rippit_library_entry_new(job->libraryKey);
+    job->curTrack = job->options.singleTrack > 0 ? job->options.singleTrack - 1 : 0;
+    startRip(job);
+}
+
+static gboolean tag_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    RippitJob *job = data;
+    GstTagList *tags = NULL;
+    gst_message_parse_tag(msg, &tags);
+    if (!job->gotData && gst_tag_list_get_string(tags, GST_TAG_CDDA_MUSICBRAINZ_DISCID, &job->discID)) {
+        job->gotData = TRUE;
+        GST_DEBUG("Got MusicBrainz id %s", job->discID);
+        if (gst_tag_list_get_string(tags, GST_TAG_CDDA_MUSICBRAINZ_DISCID_FULL, &job->toc)) {
+            // "first last leadout offsets...", in hex frames with the
+            // 150 frame lead-in counted
+            gchar **tocParts = g_strsplit(job->toc, " ", 0);
+            if (g_strv_length(tocParts) > 2)
+                job->leadout = strtol(tocParts[2], NULL, 16) - 150;
+            g_strfreev(tocParts);
+        }
+
+        job->libraryKey = g_strdup_printf("cd:%s", job->discID);
+        if (!skipKnownDisc(job))
+            startRip(job);
+    }
+    gst_tag_list_foreach(tags, debug_tag, NULL);
+    gst_tag_list_free(tags);
+    return TRUE;
+}
+
+static gboolean error_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    RippitJob *job = data;
+    GError *err;
+    gchar *debug;
+    gst_message_parse_error(msg, &err, &debug);
+    g_free(debug);
+    g_warning("%s: %d %d: %s", job->device, err->domain, err->code, err->message);
+    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(job->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "quit");
+    job->failed = TRUE;
+    finishJob(job);
+    g_error_free(err);
+    return TRUE;
+}
+
+static gboolean warning_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    RippitJob *job = data;
+    GError *err;
+    gchar *debug;
+    gst_message_parse_warning(msg, &err, &debug);
+    g_free(debug);
+    g_warning("%s: %d %d: %s", job->device, err->domain, err->code, err->message);
+    g_error_free(err);
+    return TRUE;
+}
+
+static gboolean speedTick_cb(gpointer data)
+{
+    RippitJob *job = data;
+    gchar *reason = NULL;
+    gint speed;
+
+    // Re-reads set their own speed
+    if (job->repairing)
+        return TRUE;
+    if (!rippit_speed_control_update(job->speed, job->bytesRead, &reason))
+        return TRUE;
+
+    speed = rippit_speed_control_get_speed(job->speed);
+    GST_INFO("%s: speed now %dx at %" G_GUINT64_FORMAT " bytes in, %s", job->device, speed, job->bytesRead, reason);
+    if (speed > 0)
+        setOutputMessage(job, "Reading at %dx, %s", speed, reason);
+    else
+        setOutputMessage(job, "Reading at full speed, %s", reason);
+
+    g_mutex_lock(job->lock);
+    openRipLog(job);
+    if (job->ripLog) {
+        if (speed > 0)
+            fprintf(job->ripLog, "Speed %dx in track %d: %s\n", speed, job->curTrack, reason);
+        else
+            fprintf(job->ripLog, "Speed max in track %d: %s\n", job->curTrack, reason);
+        fflush(job->ripLog);
+    }
+    g_mutex_unlock(job->lock);
+    g_free(reason);
+    return TRUE;
+}
+
+// Only real drives have a speed to set
+static void controlSpeed(RippitJob *job)
+{
+    GError *error = NULL;
+
+    if (job->media->drive && job->media->drive->capabilities && !(job->media->drive->capabilities & CDC_SELECT_SPEED)) {
+        setOutputMessage(job, "Can't control the drive's speed: %s doesn't let its speed be set", job->media->drive->name);
+        return;
+    }
+    job->speed = rippit_speed_control_new(job->device, &error);
+    if (!job->speed) {
+        setOutputMessage(job, "Can't control the drive's speed: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+    job->speedSource = g_timeout_add_seconds(1, speedTick_cb, job);
+}
+
+static void watchSource(RippitJob *job, GstElement *source)
+{
+    GstPad *pad = gst_element_get_static_pad(source, "src");
+    gst_pad_add_buffer_probe(pad, G_CALLBACK(sourceBuffer_cb), job);
+    gst_object_unref(pad);
+}
+
+static void watchBus(RippitJob *job, GstElement *pipe)
+{
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipe));
+    gst_bus_add_signal_watch(bus);
+    g_signal_connect(bus, "message::error", G_CALLBACK(error_cb), job);
+    g_signal_connect(bus, "message::warning", G_CALLBACK(warning_cb), job);
+    g_signal_connect(bus, "message::state-changed", G_CALLBACK(state_cb), job);
+    g_signal_connect(bus, "message::tag", G_CALLBACK(tag_cb), job);
+    g_signal_connect(bus, "message::eos", G_CALLBACK(eos_cb), job);
+    g_signal_connect(bus, "message::element", G_CALLBACK(element_cb), job);
+    gst_object_unref(bus);
+}
+
+
+static GstElement *buildCDPipeline(RippitJob *job, const gchar *sourceName)
+{
+    GstElement *pipe = gst_pipeline_new(NULL);
+
+    GstElement *cdSource = gst_element_factory_make(sourceName, NULL);
+
+    if (job->device) {
+        g_object_set(G_OBJECT(cdSource), "device", job->device, NULL);
+    } else {
+        g_object_get(G_OBJECT(cdSource), "device", &job->device, NULL);
+    }
+
+    // Images read the same every time, so there's nothing to be paranoid
+    // about
+    setParanoiaMode(cdSource, PARANOIA_MODE_FULL);
+    if (job->options.faultTrace && job->device && g_file_test(job->device, G_FILE_TEST_IS_REGULAR))
+        g_object_set(G_OBJECT(cdSource), "fault-trace", job->options.faultTrace, NULL);
+    // Images only have errors when there's a fault trace to act out
+    if (g_signal_lookup("uncorrected-error", G_OBJECT_TYPE(cdSource))) {
+        g_signal_connect(G_OBJECT(cdSource), "uncorrected-error", G_CALLBACK(uncorrectedError_cb), job); 
+        g_signal_connect(G_OBJECT(cdSource), "transport-error", G_CALLBACK(transportError_cb), job); 
+    }
+
+    job->cdsrc = cdSource;
+    job->splitSrc = cdSource;
+    if (job->options.autoSpeed && job->device && !g_file_test(job->device, G_FILE_TEST_IS_REGULAR))
+        controlSpeed(job);
+
+    if (job->options.image) {
+        // The whole disc goes into one file. With --continuous, every buffer
+        // also goes off to be cut up into tracks; tee hands the same buffer
+        // to both, so nothing gets copied.
+        GstElement *tee = gst_element_factory_make("tee", NULL);
+        GstElement *queue = gst_element_factory_make("queue", NULL);
+        GstElement *encoder = gst_element_factory_make("flacenc", NULL);
+
+        job->imagesink = makeFileSink(job);
+        g_object_set(G_OBJECT(job->imagesink), "location", "/dev/null", NULL);
+        gst_bin_add_many(GST_BIN(pipe), cdSource, tee, queue, encoder, job->imagesink, NULL);
+        gst_element_link_many(cdSource, tee, queue, encoder, job->imagesink, NULL);
+        watchEncoder(job, encoder);
+
+        if (job->options.continuous) {
+            GstElement *splitQueue = gst_element_factory_make("queue", NULL);
+            GstElement *output = buildFlacOutput(job);
+
+            gst_bin_add_many(GST_BIN(pipe), splitQueue, output, NULL);
+            gst_element_link_many(tee, splitQueue, output, NULL);
+            job->splitSrc = splitQueue;
+        }
+    } else if (job->spool) {
+        // Encoding happens in the spool, so the drive only feeds raw audio
+        // into it as fast as it can read
+        static GstAppSinkCallbacks callbacks = { NULL, NULL, spoolBuffer_cb, NULL };
+        GstElement *output = gst_element_factory_make("appsink", NULL);
+        GstCaps *caps = gst_caps_from_string(RIPPIT_SPOOL_CAPS);
+
+        g_object_set(G_OBJECT(output), "sync", FALSE, "caps", caps, NULL);
+        gst_caps_unref(caps);
+        gst_app_sink_set_callbacks(GST_APP_SINK(output), &callbacks, job, NULL);
+
+        gst_bin_add_many(GST_BIN(pipe), cdSource, output, NULL);
+        gst_element_link(cdSource, output);
+    } else {
+        GstElement *output = buildFlacOutput(job);
+
+        gst_bin_add_many(GST_BIN(pipe), cdSource, output, NULL);
+        gst_element_link(cdSource, output);
+    }
+
+    if (job->options.continuous || job->options.image) {
+        // One stream for the whole disc; sourceBuffer_cb cuts it into tracks
+        g_object_set(G_OBJECT(cdSource), "mode", CDDA_MODE_CONTINUOUS, NULL);
+    }
+    // Where tracks get cut, the new track's segment has to go out on
+    // the same pad
+    watchSource(job, job->splitSrc);
+
+    watchBus(job, pipe);
+
+    return pipe;
+}
+
+static RippitDvdBuildFunc dvdBuilder(RippitJob *job)
+{
+    return job->options.remux ? rippit_dvd_remux_add : rippit_dvd_encoder_add;
+}
+
+static GstElement *buildDVDPipeline(RippitJob *job)
+{
+    GstElement *pipe = gst_pipeline_new(NULL);
+    GstElement *dvdSource = gst_element_factory_make("dvdreadsrc", NULL);
+    RippitDvdInfo *dvd = job->media->dvd;
+    job->dvdsrc = dvdSource;
+
+    if (job->device) {
+        g_object_set(G_OBJECT(dvdSource), "device", job->device, NULL);
+    } else {
+        g_object_get(G_OBJECT(dvdSource), "device", &job->device, NULL);
+    }
+
+    // The gstreamer elements don't publish the disc title
+    job->discID = g_strdup(dvd->name);
+
+    if (job->library) {
+        // Plenty of discs are just called DVD_VIDEO
+        if (dvd->ifoHash)
+            job->libraryKey = g_strdup_printf("dvd:%s:%s", job->discID, dvd->ifoHash);
+        else
+            g_warning("Could not read the IFOs of %s, so it can't be looked up in the library", job->device);
+    }
+
+    // The job has them from here on
+    job->dvdTitles = dvd->titles;
+    dvd->titles = NULL;
+    if (job->dvdTitles) {
+        job->trackCount = dvd->titleCount;
+        setOutputMessage(job, "%d of the %d titles on %s are worth ripping", job->dvdTitles->len, dvd->titleCount, job->discID);
+    } else {
+        g_warning("Could not read the title table of %s, checking titles the slow way", job->device);
+    }
+
+    gst_bin_add(GST_BIN(pipe), dvdSource);
+    if (job->titlePool) {
+        // Nothing between the drive and the disk; the encoding happens later
+        job->filesink = makeFileSink(job);
+        g_object_set(G_OBJECT(job->filesink), "location", "/dev/null", NULL);
+        gst_bin_add(GST_BIN(pipe), job->filesink);
+        gst_element_link(dvdSource, job->filesink);
+    } else {
+        // The builders end in a plain filesink
+        job->filesink = dvdBuilder(job)(pipe, dvdSource);
+        if (job->filesink)
+            job->filesink = rippit_write_sink_replace(job->filesink, writeBufferBytes(job), job->writeStats);
+        // The encoders are buried in the builder's bins, so count what
+        // comes out of them
+        if (job->filesink)
+            watchEncoder(job, job->filesink);
+    }
+
+    if (!job->filesink) {
+        setOutputMessage(job, "Error: You're missing some vital gstreamer elements!");
+        gst_object_unref(pipe);
+        return NULL;
+    }
+
+    watchSource(job, dvdSource);
+    watchBus(job, pipe);
+
+    return pipe;
+}
+
+static GstElement *buildPipeline(RippitJob *job)
+{
+    GstElement *pipeline = NULL;
+    GError *error = NULL;
+
+    job->media = rippit_media_probe(job->device, &error);
+    if (!job->media) {
+        setOutputMessage(job, "No disks found :'( %s", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+    if (!job->device)
+        job->device = g_strdup(job->media->device);
+
+    switch (job->media->type) {
+        case RIPPIT_MEDIA_CD_IMAGE:
+            setOutputMessage(job, "Reading CD image...");
+            pipeline = buildCDPipeline(job, "rippitimagesrc");
+            break;
+        case RIPPIT_MEDIA_CD:
+            setOutputMessage(job, "Reading CD...");
+            pipeline = buildCDPipeline(job, "cdparanoiasrc");
+            break;
+        case RIPPIT_MEDIA_DVD:
+            setOutputMessage(job, "Reading DVD...");
+            pipeline = buildDVDPipeline(job);
+            break;
+    }
+    return pipeline;
+}
+
+void rippit_job_options_init(RippitJobOptions *options)
+{
+    memset(options, 0, sizeof(RippitJobOptions));
+    options->singleTrack = -1;
+    options->spoolSize = 512;
+    options->stallTimeout = 5;
+}
+
+RippitJob *rippit_job_new(const gchar *device, const RippitJobOptions *options, GError **error)
+{
+    RippitJob *job;
+
+    rippit_init();
+
+    if (options->singleTrack == 0) {
+        g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "Tracks start at 1. Sorry for any confusion.");
+        return NULL;
+    }
+    if (options->image && (options->adaptive || options->singleTrack > 0)) {
+        g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "An image is the whole disc read straight through, it can't be combined with adaptive ripping or a single track.");
+        return NULL;
+    }
+    if (options->stallTimeout < 1) {
+        g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "The stall timeout has to be at least a second.");
+        return NULL;
+    }
+    if (options->writeBuffer < 0) {
+        g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "The write buffer can't be negative.");
+        return NULL;
+    }
+    if (options->faultTrace && !(device && g_file_test(device, G_FILE_TEST_IS_REGULAR))) {
+        g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "Fault traces only work with CD images.");
+        return NULL;
+    }
+
+    job = g_new0(RippitJob, 1);
+    job->options = *options;
+    job->options.metadataCache = options->metadataCache ? g_strdup(options->metadataCache) : rippit_metadata_default_cache();
+    job->options.musicbrainzServer = g_strdup(options->musicbrainzServer);
+    job->options.faultTrace = g_strdup(options->faultTrace);
+    job->options.profile = g_strdup(options->profile);
+    job->options.library = g_strdup(options->library);
+
+    if (job->options.image) {
+        // The spool only knows about tracks, and the image has its own
+        // queue to keep the drive from waiting on the encoder anyway
+        job->options.spool = FALSE;
+    }
+    if (job->options.parallelFlac && !job->options.image)
+        job->options.spool = TRUE;
+    // A remux keeps up with the drive on one core already
+    if (job->options.remux)
+        job->options.splitTitles = FALSE;
+    if (job->options.splitTitles)
+        job->options.copyDVD = TRUE;
+    if (job->options.adaptive) {
+        // Repairs get spliced into the spool before the encoder sees them,
+        // and need a track at a time from the drive to do it.
+        job->options.spool = TRUE;
+        job->options.continuous = FALSE;
+    }
+
+    job->device = g_strdup(device);
+    job->lock = g_mutex_new();
+    job->created = gst_util_get_timestamp();
+    job->badSectors = g_array_new(FALSE, FALSE, sizeof(gint));
+    job->repairRanges = g_array_new(FALSE, FALSE, sizeof(SectorRange));
+    job->errorSectors = g_array_new(FALSE, FALSE, sizeof(gint));
+    job->deferred = g_queue_new();
+    if (job->options.writeBuffer > 0)
+        job->writeStats = rippit_write_stats_new();
+    job->stallTrack = -1;
+    if (job->options.singleTrack > 0)
+        job->curTrack = job->options.singleTrack-1;
+    return job;
+}
+
+void rippit_job_set_callbacks(RippitJob *job, const RippitJobCallbacks *callbacks, gpointer data)
+{
+    job->callbacks = *callbacks;
+    job->callbackData = data;
+}
+
+gboolean rippit_job_start(RippitJob *job, GError **error)
+{
+    GstFormat format;
+
+    if (job->options.copyDVD) {
+        gint encoders = job->options.encoderCount;
+        // Same as the spool with --parallel-flac
+        if (job->options.splitTitles && encoders == 0)
+            encoders = 2;
+        job->titlePool = rippit_title_pool_new(encoders, dvdBuilder(job), titleDone_cb, job);
+        rippit_title_pool_set_split(job->titlePool, job->options.splitTitles);
+        rippit_title_pool_set_write_buffer(job->titlePool, writeBufferBytes(job), job->writeStats);
+    }
+    if (job->options.spool) {
+        gint encoders = job->options.encoderCount;
+        // Every track gets all the cores already; two at once is enough to
+        // keep them busy across the gap between tracks
+        if (job->options.parallelFlac && encoders == 0)
+            encoders = 2;
+        job->spool = rippit_spool_new((guint64)job->options.spoolSize*1024*1024, encoders, spoolDone_cb, job);
+        rippit_spool_set_parallel_flac(job->spool, job->options.parallelFlac);
+        rippit_spool_set_write_buffer(job->spool, writeBufferBytes(job), job->writeStats);
+    }
+
+    if (job->options.library) {
+        GError *libraryError = NULL;
+        job->library = rippit_library_open(job->options.library, &libraryError);
+        if (!job->library) {
+            g_warning("%s, ripping without the library", libraryError->message);
+            g_error_free(libraryError);
+        }
+    }
+
+    setOutputMessage(job, "Probing devices...");
+    job->pipeline = buildPipeline(job);
+    if (job->pipeline == NULL) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Nothing to rip in %s", job->device ? job->device : "the drive");
+        job->done = TRUE;
+        job->failed = TRUE;
+        job->finished = TRUE;
+        return FALSE;
+    }
+
+    if (job->options.profile) {
+        job->profile = rippit_profile_new();
+        rippit_profile_watch(job->profile, GST_BIN(job->pipeline));
+        if (job->spool)
+            rippit_spool_set_profile(job->spool, job->profile);
+        if (job->titlePool)
+            rippit_title_pool_set_profile(job->titlePool, job->profile);
+    }
+
+    gst_element_set_state(job->pipeline, GST_STATE_PAUSED);
+    if (job->dvdsrc)
+        format = gst_format_get_by_nick("title");
+    else
+        format = gst_format_get_by_nick("track");
+    // The DVD title table and the CD's table of contents already know
+    if (job->media->trackCount > 0) {
+        job->trackCount = job->media->trackCount;
+        job->trackStarts = g_memdup(job->media->trackStarts, job->trackCount * sizeof(gint64));
+        job->leadout = job->media->leadout;
+    } else if (!job->dvdTitles) {
+        gst_element_query_duration(GST_ELEMENT(job->pipeline), &format, &job->trackCount);
+    }
+    g_debug("Found %d tracks on %s", (int)job->trackCount, job->device);
+
+    if (job->cdsrc && job->trackCount > 0 && !job->trackStarts) {
+        GstFormat sectorFormat = gst_format_get_by_nick("sector");
+        int i;
+
+        job->trackStarts = g_new0(gint64, job->trackCount);
+        for (i = 0; i < job->trackCount; i++) {
+            GstFormat outFormat = sectorFormat;
+            gst_element_query_convert(job->cdsrc, format, i, &outFormat, &job->trackStarts[i]);
+        }
+    }
+
+    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(job->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "init");
+
+    if (job->dvdsrc && !skipKnownDisc(job))
+        startNextTrack(job);
+    return TRUE;
+}
+
+void rippit_job_cancel(RippitJob *job)
+{
+    if (job->done)
+        return;
+    setOutputMessage(job, "Cancelled");
+    job->failed = TRUE;
+    logTrackChecksum(job, FALSE, "cancelled");
+    finishJob(job);
+}
+
+void rippit_job_get_progress(RippitJob *job, RippitJobProgress *progress)
+{
+    progress->track = job->curTrack;
+    progress->trackCount = job->trackCount;
+    progress->percent = jobPercent(job);
+    progress->done = job->done;
+}
+
+void rippit_job_get_stats(RippitJob *job, RippitJobStats *stats)
+{
+    stats->track = job->curTrack;
+    stats->trackCount = job->trackCount;
+    stats->sectorSize = job->dvdsrc ? DVD_SECTOR_SIZE : CD_FRAMESIZE_RAW;
+    stats->trackBytes = currentTrackBytes(job);
+    stats->trackSize = trackSize(job, job->curTrack);
+    stats->bytesRead = job->bytesRead;
+    stats->bytesLeft = bytesLeft(job);
+    stats->bytesEncoded = job->bytesEncoded;
+    if (job->spool)
+        stats->bytesEncoded += rippit_spool_encoded(job->spool);
+    stats->retries = job->retries;
+    g_mutex_lock(job->lock);
+    stats->errorSectors = job->errorSectors->len;
+    g_mutex_unlock(job->lock);
+    stats->firstSectorMs = job->firstSector / GST_MSECOND;
+    stats->transitions = job->transitions;
+    stats->transitionMs = job->transitionTotal / GST_MSECOND;
+    stats->transitionMaxMs = job->transitionMax / GST_MSECOND;
+    if (job->writeStats) {
+        RippitWriteStats write;
+        rippit_write_stats_get(job->writeStats, &write);
+        stats->writePending = write.pending;
+        stats->writePeak = write.peak;
+        stats->writeStalls = write.stalls;
+        stats->writeStallMs = write.stallTime / GST_MSECOND;
+    } else {
+        stats->writePending = 0;
+        stats->writePeak = 0;
+        stats->writeStalls = 0;
+        stats->writeStallMs = 0;
+    }
+    stats->done = job->done;
+}
+
+gint *rippit_job_get_error_sectors(RippitJob *job, guint from, guint *count)
+{
+    gint *sectors;
+
+    g_mutex_lock(job->lock);
+    *count = from < job->errorSectors->len ? job->errorSectors->len - from : 0;
+    sectors = g_new(gint, MAX(*count, 1));
+    if (*count > 0)
+        memcpy(sectors, &g_array_index(job->errorSectors, gint, from), *count * sizeof(gint));
+    g_mutex_unlock(job->lock);
+    return sectors;
+}
+
+const gchar *rippit_job_get_device(RippitJob *job)
+{
+    return job->device;
+}
+
+const gchar *rippit_job_get_disc_id(RippitJob *job)
+{
+    return job->discID;
+}
+
+static void freeProvisional(gpointer data, gpointer user_data)
+{
+    ProvisionalTrack *track = data;
+    g_free(track->location);
+    g_free(track);
+}
+
+void rippit_job_free(RippitJob *job)
+{
+    if (job->timeoutSource > 0)
+        g_source_remove(job->timeoutSource);
+    if (job->pipeline) {
+        GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(job->pipeline));
+        g_signal_handlers_disconnect_matched(bus, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, job);
+        gst_bus_remove_signal_watch(bus);
+        gst_object_unref(bus);
+        gst_element_set_state(job->pipeline, GST_STATE_NULL);
+        gst_object_unref(job->pipeline);
+    }
+    dropDeferred(job);
+    // Only now that nothing's going through the pipeline any more
+    if (job->profile)
+        rippit_profile_free(job->profile);
+    if (job->writeStats)
+        rippit_write_stats_free(job->writeStats);
+    if (job->speedSource > 0)
+        g_source_remove(job->speedSource);
+    if (job->speed)
+        rippit_speed_control_free(job->speed);
+    if (job->spool)
+        rippit_spool_free(job->spool);
+    if (job->titlePool)
+        rippit_title_pool_free(job->titlePool);
+    if (job->journal)
+        rippit_journal_free(job->journal);
+    if (job->library)
+        rippit_library_close(job->library);
+    if (job->ripped)
+        rippit_library_entry_free(job->ripped);
+    if (job->known)
+        rippit_library_entry_free(job->known);
+    g_free(job->libraryKey);
+    if (job->ripLog)
+        fclose(job->ripLog);
+    if (job->discInfo)
+        rippit_disc_info_free(job->discInfo);
+    // Its free function takes care of the titles
+    if (job->dvdTitles)
+        g_ptr_array_free(job->dvdTitles, TRUE);
+    if (job->media)
+        rippit_media_free(job->media);
+    g_list_foreach(job->provisional, freeProvisional, NULL);
+    g_list_free(job->provisional);
+    g_array_free(job->badSectors, TRUE);
+    g_array_free(job->repairRanges, TRUE);
+    g_array_free(job->errorSectors, TRUE);
+    g_queue_free(job->deferred);
+    g_mutex_free(job->lock);
+    g_free(job->trackStarts);
+    g_free(job->copyLocation);
+    g_free(job->curLocation);
+    g_free(job->discID);
+    g_free(job->toc);
+    g_free(job->device);
+    g_free((gchar*)job->options.metadataCache);
+    g_free((gchar*)job->options.musicbrainzServer);
+    g_free((gchar*)job->options.faultTrace);
+    g_free((gchar*)job->options.profile);
+    g_free((gchar*)job->options.library);
+    g_free(job);
+}
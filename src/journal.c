@@ -0,0 +1,531 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "journal.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// How much audio can pile up in a partial file before it gets synced and
+// the journal hears about it. About four seconds' worth.
+#define JOURNAL_SYNC_SECTORS 300
+// How far the partial file can fall behind the drive before we give up on
+// saving the rest of the track, rather than make the drive wait
+#define JOURNAL_BACKLOG (16 * 1024 * 1024)
+
+// What the drive asks of the partial files, done in order on a thread of
+// their own so it never waits on a sync
+typedef enum {
+    PARTIAL_BEGIN,
+    PARTIAL_DATA,
+    PARTIAL_CLOSE,
+    PARTIAL_REMOVE
+} PartialOpType;
+
+typedef struct {
+    PartialOpType type;
+    gint track;
+    gint64 sectors;
+    guint8 *data;
+    gsize length;
+} PartialOp;
+
+typedef struct {
+    gint track;
+    gchar *location;
+    RippitTrackChecksum sum;
+} PendingTrack;
+
+typedef struct {
+    gchar *location;
+    RippitTrackChecksum sum;
+} DoneTrack;
+
+struct _RippitJournal {
+    gchar *discID;
+    // Taken on its own, so the drive never waits while it's synced
+    GMutex *logLock;
+    FILE *log;
+    GMutex *lock;
+    GCond *cond;
+    // Track -> DoneTrack
+    GHashTable *done;
+    // Track -> sectors safely in its partial file
+    GHashTable *progress;
+    // Read, but still waiting on the encoder
+    GList *pending;
+    // PartialOp, oldest first, and how much audio's in them
+    GQueue ops;
+    gsize queuedBytes;
+    gboolean writing;
+    gboolean quit;
+    GThread *writer;
+    // The track whose audio is still wanted, as far as the drive's concerned
+    gint savingTrack;
+    // From here on only touched by the writer, or while it's idle
+    FILE *partial;
+    gint partialTrack;
+    guint64 partialBytes;
+    guint64 unsyncedBytes;
+};
+
+static gchar *partialName(RippitJournal *journal, gint track)
+{
+    return g_strdup_printf("%s - %d.partial", journal->discID, track);
+}
+
+static void freeDone(gpointer data)
+{
+    DoneTrack *done = data;
+    g_free(done->location);
+    g_free(done);
+}
+
+static void addDone(RippitJournal *journal, gint track, const gchar *location, guint32 crc, guint32 arV1, guint32 arV2)
+{
+    DoneTrack *done = g_new0(DoneTrack, 1);
+
+    done->location = g_strdup(location);
+    done->sum.crc = crc;
+    done->sum.arV1 = arV1;
+    done->sum.arV2 = arV2;
+    g_hash_table_insert(journal->done, GINT_TO_POINTER(track), done);
+    g_hash_table_remove(journal->progress, GINT_TO_POINTER(track));
+}
+
+static void appendRecord(RippitJournal *journal, const gchar *format, ...)
+{
+    va_list args;
+
+    g_mutex_lock(journal->logLock);
+    if (journal->log) {
+        va_start(args, format);
+        vfprintf(journal->log, format, args);
+        va_end(args);
+        fflush(journal->log);
+        fdatasync(fileno(journal->log));
+    }
+    g_mutex_unlock(journal->logLock);
+}
+
+static void replay(RippitJournal *journal, const gchar *contents)
+{
+    gchar **lines = g_strsplit(contents, "\n", 0);
+    int i;
+
+    // The last piece is whatever came after the last newline, which is
+    // either nothing or a record that never got finished
+    for (i = 0; lines[i] && lines[i+1]; i++) {
+        gint track;
+        long sectors;
+        unsigned int crc;
+        unsigned int arV1;
+        unsigned int arV2;
+        int location = 0;
+        if (sscanf(lines[i], "progress %d %ld", &track, &sectors) == 2) {
+            g_hash_table_insert(journal->progress, GINT_TO_POINTER(track), GINT_TO_POINTER((gint)sectors));
+        } else if (sscanf(lines[i], "done %d %X %X %X %n", &track, &crc, &arV1, &arV2, &location) == 4 && location > 0) {
+            // A track whose file has gone since doesn't count
+            if (g_file_test(lines[i] + location, G_FILE_TEST_EXISTS)) {
+                addDone(journal, track, lines[i] + location, crc, arV1, arV2);
+            } else {
+                GST_INFO("%s has gone, track %d needs ripping again", lines[i] + location, track);
+                g_hash_table_remove(journal->done, GINT_TO_POINTER(track));
+                g_hash_table_remove(journal->progress, GINT_TO_POINTER(track));
+            }
+        } else {
+            GST_WARNING("Ignoring journal line '%s'", lines[i]);
+        }
+    }
+    g_strfreev(lines);
+}
+
+static void closePartial(RippitJournal *journal)
+{
+    if (journal->partial) {
+        fclose(journal->partial);
+        journal->partial = NULL;
+    }
+    journal->partialTrack = 0;
+}
+
+static void beginPartial(RippitJournal *journal, gint track, gint64 sectors)
+{
+    gchar *name = partialName(journal, track);
+
+    closePartial(journal);
+    if (sectors > 0 && truncate(name, sectors * CD_FRAMESIZE_RAW) == 0) {
+        journal->partial = fopen(name, "ab");
+    } else {
+        sectors = 0;
+        journal->partial = fopen(name, "wb");
+    }
+    if (journal->partial) {
+        journal->partialTrack = track;
+        journal->partialBytes = sectors * CD_FRAMESIZE_RAW;
+        journal->unsyncedBytes = 0;
+    } else {
+        GST_WARNING("Could not open %s, track %d can't be resumed", name, track);
+    }
+    g_free(name);
+}
+
+static void writePartial(RippitJournal *journal, const guint8 *data, gsize length)
+{
+    gint64 sectors;
+
+    if (!journal->partial)
+        return;
+    if (fwrite(data, 1, length, journal->partial) != length) {
+        GST_WARNING("Could not save audio of track %d, it won't be resumable", journal->partialTrack);
+        closePartial(journal);
+        return;
+    }
+    journal->partialBytes += length;
+    journal->unsyncedBytes += length;
+    if (journal->unsyncedBytes < JOURNAL_SYNC_SECTORS * CD_FRAMESIZE_RAW)
+        return;
+
+    sectors = journal->partialBytes / CD_FRAMESIZE_RAW;
+    fflush(journal->partial);
+    fdatasync(fileno(journal->partial));
+    journal->unsyncedBytes = 0;
+    appendRecord(journal, "progress %d %ld\n", journal->partialTrack, (long)sectors);
+    g_mutex_lock(journal->lock);
+    if (!g_hash_table_lookup(journal->done, GINT_TO_POINTER(journal->partialTrack)))
+        g_hash_table_insert(journal->progress, GINT_TO_POINTER(journal->partialTrack), GINT_TO_POINTER((gint)sectors));
+    g_mutex_unlock(journal->lock);
+}
+
+static void runOp(RippitJournal *journal, PartialOp *op)
+{
+    gchar *name;
+
+    switch (op->type) {
+        case PARTIAL_BEGIN:
+            beginPartial(journal, op->track, op->sectors);
+            break;
+        case PARTIAL_DATA:
+            writePartial(journal, op->data, op->length);
+            break;
+        case PARTIAL_CLOSE:
+            if (journal->partialTrack == op->track)
+                closePartial(journal);
+            break;
+        case PARTIAL_REMOVE:
+            if (journal->partialTrack == op->track)
+                closePartial(journal);
+            name = partialName(journal, op->track);
+            g_unlink(name);
+            g_free(name);
+            break;
+    }
+}
+
+static gpointer writeLoop(gpointer data)
+{
+    RippitJournal *journal = data;
+
+    g_mutex_lock(journal->lock);
+    while (TRUE) {
+        PartialOp *op;
+
+        while (g_queue_is_empty(&journal->ops) && !journal->quit)
+            g_cond_wait(journal->cond, journal->lock);
+        if (g_queue_is_empty(&journal->ops))
+            break;
+
+        op = g_queue_pop_head(&journal->ops);
+        journal->writing = TRUE;
+        g_mutex_unlock(journal->lock);
+
+        runOp(journal, op);
+
+        g_mutex_lock(journal->lock);
+        journal->queuedBytes -= op->length;
+        journal->writing = FALSE;
+        g_free(op->data);
+        g_free(op);
+        g_cond_broadcast(journal->cond);
+    }
+    g_mutex_unlock(journal->lock);
+    return NULL;
+}
+
+// Called with the lock held. Takes ownership of data.
+static void queueOp(RippitJournal *journal, PartialOpType type, gint track, gint64 sectors, guint8 *data, gsize length)
+{
+    PartialOp *op = g_new0(PartialOp, 1);
+
+    op->type = type;
+    op->track = track;
+    op->sectors = sectors;
+    op->data = data;
+    op->length = length;
+    journal->queuedBytes += length;
+    g_queue_push_tail(&journal->ops, op);
+    g_cond_broadcast(journal->cond);
+}
+
+// Called with the lock held. Afterwards the partial files are ours to
+// do with as we like, until something else gets queued.
+static void waitForWriter(RippitJournal *journal)
+{
+    while (!g_queue_is_empty(&journal->ops) || journal->writing)
+        g_cond_wait(journal->cond, journal->lock);
+}
+
+RippitJournal *rippit_journal_open(const gchar *discID, GError **error)
+{
+    RippitJournal *journal = g_new0(RippitJournal, 1);
+    gchar *name = g_strdup_printf("%s.journal", discID);
+    gchar *contents;
+    gsize length;
+
+    journal->discID = g_strdup(discID);
+    journal->logLock = g_mutex_new();
+    journal->lock = g_mutex_new();
+    journal->cond = g_cond_new();
+    g_queue_init(&journal->ops);
+    journal->done = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeDone);
+    journal->progress = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (g_file_get_contents(name, &contents, &length, NULL)) {
+        gchar *end = strrchr(contents, '\n');
+        gsize kept = end ? end - contents + 1 : 0;
+        replay(journal, contents);
+        // Cut off a half written record, so the next one starts on its own line
+        if (kept != length && truncate(name, kept) < 0)
+            GST_WARNING("Could not trim %s", name);
+        g_free(contents);
+    }
+
+    journal->log = fopen(name, "a");
+    if (!journal->log) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not open %s", name);
+        g_free(name);
+        rippit_journal_free(journal);
+        return NULL;
+    }
+    g_free(name);
+    journal->writer = g_thread_create(writeLoop, journal, TRUE, NULL);
+    return journal;
+}
+
+void rippit_journal_free(RippitJournal *journal)
+{
+    GList *cur;
+
+    if (journal->writer) {
+        // Whatever's queued still gets written, so it can be resumed from
+        g_mutex_lock(journal->lock);
+        journal->quit = TRUE;
+        g_cond_broadcast(journal->cond);
+        g_mutex_unlock(journal->lock);
+        g_thread_join(journal->writer);
+    }
+    closePartial(journal);
+    if (journal->log)
+        fclose(journal->log);
+    for (cur = journal->pending; cur; cur = cur->next) {
+        PendingTrack *pending = cur->data;
+        g_free(pending->location);
+        g_free(pending);
+    }
+    g_list_free(journal->pending);
+    g_hash_table_destroy(journal->done);
+    g_hash_table_destroy(journal->progress);
+    g_mutex_free(journal->lock);
+    g_cond_free(journal->cond);
+    g_mutex_free(journal->logLock);
+    g_free(journal->discID);
+    g_free(journal);
+}
+
+static void removePartial(gpointer key, gpointer value, gpointer data)
+{
+    gchar *name = partialName(data, GPOINTER_TO_INT(key));
+    g_unlink(name);
+    g_free(name);
+}
+
+// Called with the lock held
+static void dropPartials(RippitJournal *journal)
+{
+    journal->savingTrack = 0;
+    waitForWriter(journal);
+    if (journal->partialTrack > 0)
+        removePartial(GINT_TO_POINTER(journal->partialTrack), NULL, journal);
+    closePartial(journal);
+    g_hash_table_foreach(journal->progress, removePartial, journal);
+    g_hash_table_remove_all(journal->progress);
+}
+
+void rippit_journal_remove(RippitJournal *journal)
+{
+    gchar *name = g_strdup_printf("%s.journal", journal->discID);
+
+    g_mutex_lock(journal->lock);
+    dropPartials(journal);
+    g_mutex_lock(journal->logLock);
+    if (journal->log) {
+        fclose(journal->log);
+        journal->log = NULL;
+    }
+    g_unlink(name);
+    g_mutex_unlock(journal->logLock);
+    g_mutex_unlock(journal->lock);
+    g_free(name);
+}
+
+void rippit_journal_reset(RippitJournal *journal)
+{
+    g_mutex_lock(journal->lock);
+    dropPartials(journal);
+    g_hash_table_remove_all(journal->done);
+    // Opened for appending, so the next record goes at the start
+    g_mutex_lock(journal->logLock);
+    if (journal->log && ftruncate(fileno(journal->log), 0) < 0)
+        GST_WARNING("Could not empty the journal of %s", journal->discID);
+    g_mutex_unlock(journal->logLock);
+    g_mutex_unlock(journal->lock);
+}
+
+gboolean rippit_journal_track_done(RippitJournal *journal, gint track, RippitTrackChecksum *sum, gchar **location)
+{
+    DoneTrack *done;
+
+    g_mutex_lock(journal->lock);
+    done = g_hash_table_lookup(journal->done, GINT_TO_POINTER(track));
+    if (done && sum) {
+        memset(sum, 0, sizeof(*sum));
+        sum->crc = done->sum.crc;
+        sum->arV1 = done->sum.arV1;
+        sum->arV2 = done->sum.arV2;
+    }
+    if (done && location)
+        *location = g_strdup(done->location);
+    g_mutex_unlock(journal->lock);
+    return done != NULL;
+}
+
+gint64 rippit_journal_track_progress(RippitJournal *journal, gint track)
+{
+    gint64 sectors;
+    g_mutex_lock(journal->lock);
+    sectors = GPOINTER_TO_INT(g_hash_table_lookup(journal->progress, GINT_TO_POINTER(track)));
+    g_mutex_unlock(journal->lock);
+    return sectors;
+}
+
+gboolean rippit_journal_read_partial(RippitJournal *journal, gint track, gchar **contents, gsize *length)
+{
+    gsize wanted = rippit_journal_track_progress(journal, track) * CD_FRAMESIZE_RAW;
+    gchar *name = partialName(journal, track);
+    gboolean ok = FALSE;
+
+    if (wanted > 0 && g_file_get_contents(name, contents, length, NULL)) {
+        if (*length >= wanted) {
+            *length = wanted;
+            ok = TRUE;
+        } else {
+            GST_WARNING("%s is shorter than the journal says", name);
+            g_free(*contents);
+        }
+    }
+    g_free(name);
+    return ok;
+}
+
+void rippit_journal_begin_partial(RippitJournal *journal, gint track, gint64 sectors)
+{
+    g_mutex_lock(journal->lock);
+    queueOp(journal, PARTIAL_BEGIN, track, sectors, NULL, 0);
+    journal->savingTrack = track;
+    g_mutex_unlock(journal->lock);
+}
+
+void rippit_journal_write_partial(RippitJournal *journal, const guint8 *data, gsize length)
+{
+    g_mutex_lock(journal->lock);
+    if (journal->savingTrack > 0 && journal->queuedBytes + length > JOURNAL_BACKLOG) {
+        GST_WARNING("The disk can't keep up, track %d can only be resumed from where it got to", journal->savingTrack);
+        queueOp(journal, PARTIAL_CLOSE, journal->savingTrack, 0, NULL, 0);
+        journal->savingTrack = 0;
+    }
+    if (journal->savingTrack > 0)
+        queueOp(journal, PARTIAL_DATA, journal->savingTrack, 0, g_memdup(data, length), length);
+    g_mutex_unlock(journal->lock);
+}
+
+void rippit_journal_track_read(RippitJournal *journal, gint track, const gchar *location, const RippitTrackChecksum *sum)
+{
+    PendingTrack *pending = g_new0(PendingTrack, 1);
+
+    pending->track = track;
+    pending->location = g_strdup(location);
+    pending->sum = *sum;
+
+    g_mutex_lock(journal->lock);
+    // The partial file stays until the track is written, in case we die
+    // while it's still being encoded
+    if (journal->savingTrack == track) {
+        queueOp(journal, PARTIAL_CLOSE, track, 0, NULL, 0);
+        journal->savingTrack = 0;
+    }
+    journal->pending = g_list_append(journal->pending, pending);
+    g_mutex_unlock(journal->lock);
+}
+
+void rippit_journal_track_written(RippitJournal *journal, const gchar *location)
+{
+    rippit_journal_track_moved(journal, location, location);
+}
+
+void rippit_journal_track_moved(RippitJournal *journal, const gchar *location, const gchar *newLocation)
+{
+    PendingTrack *pending = NULL;
+    GList *cur;
+
+    g_mutex_lock(journal->lock);
+    for (cur = journal->pending; cur; cur = cur->next) {
+        if (g_strcmp0(((PendingTrack*)cur->data)->location, location) == 0) {
+            pending = cur->data;
+            journal->pending = g_list_delete_link(journal->pending, cur);
+            break;
+        }
+    }
+    g_mutex_unlock(journal->lock);
+    if (!pending)
+        return;
+
+    // Not under the lock, which the drive needs too
+    appendRecord(journal, "done %d %08X %08X %08X %s\n", pending->track,
+                 pending->sum.crc, pending->sum.arV1, pending->sum.arV2, newLocation);
+
+    g_mutex_lock(journal->lock);
+    addDone(journal, pending->track, newLocation, pending->sum.crc, pending->sum.arV1, pending->sum.arV2);
+    queueOp(journal, PARTIAL_REMOVE, pending->track, 0, NULL, 0);
+    g_mutex_unlock(journal->lock);
+    g_free(pending->location);
+    g_free(pending);
+}
@@ -0,0 +1,71 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "checksum.h"
+
+#include <glib.h>
+
+// The journal lives next to the tracks as <discid>.journal and says how far
+// a rip of that disc got, so a rip that died halfway can pick up where it
+// left off. Records are only ever appended, one per line, and synced to disk
+// before we move on; a line cut short by a crash is simply ignored.
+//
+// Audio of a track that isn't done yet goes to "<discid> - <track>.partial".
+// Every so often that gets synced, and the journal notes how many of the
+// track's sectors are safely in it. That all happens on a thread of the
+// journal's own, so the drive never waits on the disk for it; if the disk
+// falls too far behind, the rest of the track just isn't saved.
+
+typedef struct _RippitJournal RippitJournal;
+
+RippitJournal *rippit_journal_open(const gchar *discID, GError **error);
+void rippit_journal_free(RippitJournal *journal);
+// Forgets everything, for when the disc has to be ripped again from the
+// start whatever happened last time
+void rippit_journal_reset(RippitJournal *journal);
+// Once the rip is complete there's nothing left to resume, so the journal
+// and any partial files go. Nothing more gets recorded after this.
+void rippit_journal_remove(RippitJournal *journal);
+
+// Only if the file it was written to is still there. If so, that's where
+// and what it was checksummed as, either of which can be NULL.
+gboolean rippit_journal_track_done(RippitJournal *journal, gint track, RippitTrackChecksum *sum, gchar **location);
+// Sectors of the track that can be read back out of its partial file
+gint64 rippit_journal_track_progress(RippitJournal *journal, gint track);
+// Loads the partial file of a track, as far as the journal vouches for it
+gboolean rippit_journal_read_partial(RippitJournal *journal, gint track, gchar **contents, gsize *length);
+
+// Starts saving the audio of a track, keeping the first `sectors` sectors
+// of whatever was saved of it before
+void rippit_journal_begin_partial(RippitJournal *journal, gint track, gint64 sectors);
+void rippit_journal_write_partial(RippitJournal *journal, const guint8 *data, gsize length);
+
+// The track has been read in full. It only counts as done once the file at
+// location has been completely written, which may be a while if it's sitting
+// in the spool.
+void rippit_journal_track_read(RippitJournal *journal, gint track, const gchar *location, const RippitTrackChecksum *sum);
+void rippit_journal_track_written(RippitJournal *journal, const gchar *location);
+// For a track written under one name and then moved to another, which is
+// where it gets looked for on a resume
+void rippit_journal_track_moved(RippitJournal *journal, const gchar *location, const gchar *newLocation);
+
+#endif // JOURNAL_H
@@ -0,0 +1,603 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "library.h"
+#include "util.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "RIPLIB1\n"
+// A new index has room for this many discs before it has to grow; it
+// doubles whenever it gets half full, so probes stay short
+#define INITIAL_SLOTS 4096
+// How much of library.dat to read for a record at first. A disc with
+// dozens of tracks under long names still fits.
+#define RECORD_READ 4096
+
+typedef struct {
+    gchar magic[8];
+    guint64 slots;
+    guint64 used;
+    // How far into library.dat the index has got
+    guint64 indexed;
+} IndexHeader;
+
+// A hash of 0 is an empty slot. Only the hash gets compared while probing;
+// the key itself is checked against the record once the hashes match.
+typedef struct {
+    guint64 hash;
+    guint64 offset;
+} IndexSlot;
+
+struct _RippitLibrary {
+    gchar *dataName;
+    gchar *indexName;
+    gchar *lockName;
+    int dataFd;
+    int lockFd;
+    IndexHeader *index;
+    gsize indexSize;
+    // Which file is mapped, so we can tell when someone's grown it
+    dev_t indexDev;
+    ino_t indexIno;
+};
+
+#define SLOTS(index) ((IndexSlot*)((index) + 1))
+
+// 64 bit FNV-1a
+static guint64 hashKey(const gchar *key)
+{
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+
+    for (; *key; key++) {
+        hash ^= (guchar)*key;
+        hash *= G_GUINT64_CONSTANT(1099511628211);
+    }
+    return hash ? hash : 1;
+}
+
+static gsize indexSize(guint64 slots)
+{
+    return sizeof(IndexHeader) + slots * sizeof(IndexSlot);
+}
+
+static void unmapIndex(RippitLibrary *library)
+{
+    if (library->index) {
+        munmap(library->index, library->indexSize);
+        library->index = NULL;
+    }
+}
+
+static gboolean mapIndex(RippitLibrary *library)
+{
+    struct stat info;
+    IndexHeader *index;
+    int fd;
+
+    unmapIndex(library);
+    fd = open(library->indexName, O_RDWR);
+    if (fd < 0)
+        return FALSE;
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t)sizeof(IndexHeader)) {
+        close(fd);
+        return FALSE;
+    }
+    index = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index == MAP_FAILED)
+        return FALSE;
+
+    if (memcmp(index->magic, INDEX_MAGIC, sizeof(index->magic)) != 0 ||
+        index->slots == 0 || (index->slots & (index->slots - 1)) != 0 ||
+        indexSize(index->slots) != (gsize)info.st_size) {
+        GST_WARNING("%s isn't an index we know, it'll be rebuilt", library->indexName);
+        munmap(index, info.st_size);
+        return FALSE;
+    }
+    library->index = index;
+    library->indexSize = info.st_size;
+    library->indexDev = info.st_dev;
+    library->indexIno = info.st_ino;
+    return TRUE;
+}
+
+// Another process may have swapped in a bigger index since we last looked
+static gboolean refreshIndex(RippitLibrary *library)
+{
+    struct stat info;
+
+    if (library->index && g_stat(library->indexName, &info) == 0 &&
+        info.st_dev == library->indexDev && info.st_ino == library->indexIno)
+        return TRUE;
+    return mapIndex(library);
+}
+
+static void insertSlot(IndexHeader *index, guint64 hash, guint64 offset)
+{
+    IndexSlot *slots = SLOTS(index);
+    guint64 i = hash & (index->slots - 1);
+
+    while (slots[i].hash != 0)
+        i = (i + 1) & (index->slots - 1);
+    // Offset first, so nobody looking at the same time finds the hash
+    // pointing at nothing
+    slots[i].offset = offset;
+    __sync_synchronize();
+    slots[i].hash = hash;
+    index->used++;
+}
+
+// Writes out a new index with the given number of slots and whatever the
+// old one had in it, and swaps it in. With the lock held.
+static gboolean createIndex(RippitLibrary *library, guint64 slots, GError **error)
+{
+    gchar *tempName = g_strconcat(library->indexName, ".new", NULL);
+    IndexHeader *index;
+    gsize size = indexSize(slots);
+    int fd;
+    guint64 i;
+
+    fd = open(tempName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not create %s: %s", tempName, g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        g_free(tempName);
+        return FALSE;
+    }
+    index = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (index == MAP_FAILED) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not map %s: %s", tempName, g_strerror(errno));
+        close(fd);
+        g_unlink(tempName);
+        g_free(tempName);
+        return FALSE;
+    }
+
+    memcpy(index->magic, INDEX_MAGIC, sizeof(index->magic));
+    index->slots = slots;
+    if (library->index) {
+        for (i = 0; i < library->index->slots; i++) {
+            IndexSlot *slot = &SLOTS(library->index)[i];
+            if (slot->hash != 0)
+                insertSlot(index, slot->hash, slot->offset);
+        }
+        index->indexed = library->index->indexed;
+    }
+    munmap(index, size);
+    fsync(fd);
+    close(fd);
+
+    if (g_rename(tempName, library->indexName) < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not replace %s: %s", library->indexName, g_strerror(errno));
+        g_unlink(tempName);
+        g_free(tempName);
+        return FALSE;
+    }
+    g_free(tempName);
+    if (!mapIndex(library)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not map %s", library->indexName);
+        return FALSE;
+    }
+    GST_DEBUG("%s now has %ld slots", library->indexName, (long)slots);
+    return TRUE;
+}
+
+static RippitLibraryEntry *parseRecord(const gchar *record)
+{
+    gchar **lines = g_strsplit(record, "\n", 0);
+    RippitLibraryEntry *entry = NULL;
+    gint64 ripped;
+    int start;
+    int i;
+
+    if (lines[0] && sscanf(lines[0], "disc %" G_GINT64_FORMAT " %n", &ripped, &start) == 1) {
+        gchar *key = g_strcompress(lines[0] + start);
+        entry = rippit_library_entry_new(key);
+        entry->ripped = ripped;
+        g_free(key);
+        for (i = 1; lines[i]; i++) {
+            RippitTrackChecksum sum;
+            unsigned int crc, arV1, arV2;
+            gchar *location;
+            int track;
+
+            if (sscanf(lines[i], "track %d %x %x %x %n", &track, &crc, &arV1, &arV2, &start) != 4)
+                continue;
+            memset(&sum, 0, sizeof(sum));
+            sum.crc = crc;
+            sum.arV1 = arV1;
+            sum.arV2 = arV2;
+            location = g_strcompress(lines[i] + start);
+            rippit_library_entry_add_track(entry, track, location, &sum);
+            g_free(location);
+        }
+    }
+    g_strfreev(lines);
+    return entry;
+}
+
+// The record starting at offset, or NULL if there isn't a whole one there
+static RippitLibraryEntry *readRecord(RippitLibrary *library, guint64 offset)
+{
+    gsize size = RECORD_READ;
+
+    for (;;) {
+        gchar *buffer = g_malloc(size + 1);
+        ssize_t length = pread(library->dataFd, buffer, size, offset);
+        gchar *end;
+
+        if (length <= 0) {
+            g_free(buffer);
+            return NULL;
+        }
+        buffer[length] = '\0';
+        end = strstr(buffer, "\nend\n");
+        if (end) {
+            RippitLibraryEntry *entry;
+            *end = '\0';
+            entry = parseRecord(buffer);
+            g_free(buffer);
+            return entry;
+        }
+        g_free(buffer);
+        if ((gsize)length < size)
+            return NULL;
+        size *= 4;
+    }
+}
+
+// Probes for the key. Returns its entry and slot if it's there, and
+// otherwise NULL and the empty slot it would go in.
+static RippitLibraryEntry *findEntry(RippitLibrary *library, const gchar *key, IndexSlot **found)
+{
+    IndexSlot *slots = SLOTS(library->index);
+    guint64 mask = library->index->slots - 1;
+    guint64 hash = hashKey(key);
+    guint64 i;
+
+    for (i = hash & mask; slots[i].hash != 0; i = (i + 1) & mask) {
+        if (slots[i].hash == hash) {
+            RippitLibraryEntry *entry;
+            __sync_synchronize();
+            entry = readRecord(library, slots[i].offset);
+            if (entry && strcmp(entry->key, key) == 0) {
+                if (found)
+                    *found = &slots[i];
+                return entry;
+            }
+            if (entry)
+                rippit_library_entry_free(entry);
+        }
+    }
+    if (found)
+        *found = &slots[i];
+    return NULL;
+}
+
+// With the lock held
+static gboolean indexKey(RippitLibrary *library, const gchar *key, guint64 offset, GError **error)
+{
+    RippitLibraryEntry *old;
+    IndexSlot *slot;
+
+    if ((library->index->used + 1) * 2 > library->index->slots &&
+        !createIndex(library, library->index->slots * 2, error))
+        return FALSE;
+
+    old = findEntry(library, key, &slot);
+    if (old) {
+        // Swapping the offset is a single store, so lookups see one record
+        // or the other
+        slot->offset = offset;
+        rippit_library_entry_free(old);
+    } else {
+        insertSlot(library->index, hashKey(key), offset);
+    }
+    return TRUE;
+}
+
+// Indexes anything added to library.dat that the index doesn't know about
+// yet, which is everything if the index has just been made. A record cut
+// short by a crash gets cut off. With the lock held.
+static gboolean catchUp(RippitLibrary *library, GError **error)
+{
+    struct stat info;
+    gchar *contents;
+    gsize length;
+    gsize pos = 0;
+    ssize_t got;
+
+    if (fstat(library->dataFd, &info) < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not read %s: %s", library->dataName, g_strerror(errno));
+        return FALSE;
+    }
+    if (library->index->indexed > (guint64)info.st_size) {
+        // library.dat isn't what this index was made from
+        GST_WARNING("%s is shorter than its index says, rebuilding it", library->dataName);
+        unmapIndex(library);
+        if (!createIndex(library, INITIAL_SLOTS, error))
+            return FALSE;
+    }
+    if (library->index->indexed == (guint64)info.st_size)
+        return TRUE;
+
+    length = info.st_size - library->index->indexed;
+    contents = g_malloc(length + 1);
+    got = pread(library->dataFd, contents, length, library->index->indexed);
+    if (got != (ssize_t)length) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not read %s: %s", library->dataName, g_strerror(errno));
+        g_free(contents);
+        return FALSE;
+    }
+    contents[length] = '\0';
+
+    while (pos < length) {
+        gchar *end = strstr(contents + pos, "\nend\n");
+        gchar *key;
+        gint64 ripped;
+        int start;
+
+        if (!end) {
+            GST_WARNING("Cutting a half written record off the end of %s", library->dataName);
+            if (ftruncate(library->dataFd, library->index->indexed + pos) < 0) {
+                g_set_error(error, RIPPIT_ERROR, 0, "Could not trim %s: %s", library->dataName, g_strerror(errno));
+                g_free(contents);
+                return FALSE;
+            }
+            break;
+        }
+        *strchr(contents + pos, '\n') = '\0';
+        if (sscanf(contents + pos, "disc %" G_GINT64_FORMAT " %n", &ripped, &start) == 1) {
+            key = g_strcompress(contents + pos + start);
+            if (!indexKey(library, key, library->index->indexed + pos, error)) {
+                g_free(key);
+                g_free(contents);
+                return FALSE;
+            }
+            g_free(key);
+        } else {
+            GST_WARNING("Skipping a record in %s that doesn't start right", library->dataName);
+        }
+        pos = end - contents + strlen("\nend\n");
+    }
+    library->index->indexed += pos;
+    g_free(contents);
+    return TRUE;
+}
+
+static gboolean lockLibrary(RippitLibrary *library, int operation, GError **error)
+{
+    while (flock(library->lockFd, operation) < 0) {
+        if (errno != EINTR) {
+            g_set_error(error, RIPPIT_ERROR, 0, "Could not lock %s: %s", library->lockName, g_strerror(errno));
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Makes sure there's an index and it's up to date. With the lock held.
+static gboolean prepareIndex(RippitLibrary *library, GError **error)
+{
+    if (!refreshIndex(library) && !createIndex(library, INITIAL_SLOTS, error))
+        return FALSE;
+    return catchUp(library, error);
+}
+
+RippitLibrary *rippit_library_open(const gchar *dir, GError **error)
+{
+    RippitLibrary *library = g_new0(RippitLibrary, 1);
+    gboolean ok;
+
+    library->dataName = g_build_filename(dir, "library.dat", NULL);
+    library->indexName = g_build_filename(dir, "library.idx", NULL);
+    library->lockName = g_build_filename(dir, "library.lock", NULL);
+    library->dataFd = -1;
+    library->lockFd = -1;
+
+    if (g_mkdir_with_parents(dir, 0755) < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not create %s: %s", dir, g_strerror(errno));
+        rippit_library_close(library);
+        return NULL;
+    }
+    library->dataFd = open(library->dataName, O_RDWR | O_APPEND | O_CREAT, 0644);
+    library->lockFd = open(library->lockName, O_RDWR | O_CREAT, 0644);
+    if (library->dataFd < 0 || library->lockFd < 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not open the library in %s: %s", dir, g_strerror(errno));
+        rippit_library_close(library);
+        return NULL;
+    }
+
+    if (!lockLibrary(library, LOCK_EX, error)) {
+        rippit_library_close(library);
+        return NULL;
+    }
+    ok = prepareIndex(library, error);
+    lockLibrary(library, LOCK_UN, NULL);
+    if (!ok) {
+        rippit_library_close(library);
+        return NULL;
+    }
+    GST_DEBUG("Library in %s has %ld discs", dir, (long)library->index->used);
+    return library;
+}
+
+void rippit_library_close(RippitLibrary *library)
+{
+    unmapIndex(library);
+    if (library->dataFd >= 0)
+        close(library->dataFd);
+    if (library->lockFd >= 0)
+        close(library->lockFd);
+    g_free(library->dataName);
+    g_free(library->indexName);
+    g_free(library->lockName);
+    g_free(library);
+}
+
+RippitLibraryEntry *rippit_library_lookup(RippitLibrary *library, const gchar *key)
+{
+    if (!refreshIndex(library))
+        return NULL;
+    return findEntry(library, key, NULL);
+}
+
+static GString *formatRecord(RippitLibraryEntry *entry)
+{
+    GString *record = g_string_new(NULL);
+    gchar *escaped = g_strescape(entry->key, NULL);
+    guint i;
+
+    g_string_append_printf(record, "disc %" G_GINT64_FORMAT " %s\n", entry->ripped, escaped);
+    g_free(escaped);
+    for (i = 0; i < entry->tracks->len; i++) {
+        RippitLibraryTrack *track = &g_array_index(entry->tracks, RippitLibraryTrack, i);
+        escaped = g_strescape(track->location, NULL);
+        g_string_append_printf(record, "track %d %08x %08x %08x %s\n", track->track, track->crc, track->arV1, track->arV2, escaped);
+        g_free(escaped);
+    }
+    g_string_append(record, "end\n");
+    return record;
+}
+
+gboolean rippit_library_add(RippitLibrary *library, RippitLibraryEntry *entry, GError **error)
+{
+    RippitLibraryEntry *old;
+    GString *record;
+    struct stat info;
+    gboolean ok;
+    guint i;
+
+    if (!lockLibrary(library, LOCK_EX, error))
+        return FALSE;
+    ok = prepareIndex(library, error);
+
+    if (ok) {
+        old = findEntry(library, entry->key, NULL);
+        if (old) {
+            for (i = 0; i < old->tracks->len; i++) {
+                RippitLibraryTrack *track = &g_array_index(old->tracks, RippitLibraryTrack, i);
+                RippitTrackChecksum sum;
+                if (rippit_library_entry_find_track(entry, track->track))
+                    continue;
+                memset(&sum, 0, sizeof(sum));
+                sum.crc = track->crc;
+                sum.arV1 = track->arV1;
+                sum.arV2 = track->arV2;
+                rippit_library_entry_add_track(entry, track->track, track->location, &sum);
+            }
+            rippit_library_entry_free(old);
+        }
+        entry->ripped = time(NULL);
+
+        // Nobody else appends while we've got the lock, so the end of the
+        // file now is where the record goes
+        record = formatRecord(entry);
+        ok = fstat(library->dataFd, &info) == 0 && rippit_write_all(library->dataFd, record->str, record->len, -1) && fdatasync(library->dataFd) == 0;
+        if (!ok) {
+            g_set_error(error, RIPPIT_ERROR, 0, "Could not write to %s: %s", library->dataName, g_strerror(errno));
+            if (ftruncate(library->dataFd, library->index->indexed) < 0)
+                GST_WARNING("Could not trim %s", library->dataName);
+        } else {
+            ok = indexKey(library, entry->key, info.st_size, error);
+            if (ok)
+                library->index->indexed = info.st_size + record->len;
+        }
+        g_string_free(record, TRUE);
+    }
+
+    lockLibrary(library, LOCK_UN, NULL);
+    return ok;
+}
+
+RippitLibraryEntry *rippit_library_entry_new(const gchar *key)
+{
+    RippitLibraryEntry *entry = g_new0(RippitLibraryEntry, 1);
+    entry->key = g_strdup(key);
+    entry->tracks = g_array_new(FALSE, FALSE, sizeof(RippitLibraryTrack));
+    return entry;
+}
+
+void rippit_library_entry_free(RippitLibraryEntry *entry)
+{
+    guint i;
+
+    for (i = 0; i < entry->tracks->len; i++)
+        g_free(g_array_index(entry->tracks, RippitLibraryTrack, i).location);
+    g_array_free(entry->tracks, TRUE);
+    g_free(entry->key);
+    g_free(entry);
+}
+
+void rippit_library_entry_add_track(RippitLibraryEntry *entry, gint track, const gchar *location, const RippitTrackChecksum *sum)
+{
+    RippitLibraryTrack added;
+    guint i;
+
+    memset(&added, 0, sizeof(added));
+    added.track = track;
+    if (g_path_is_absolute(location)) {
+        added.location = g_strdup(location);
+    } else {
+        gchar *dir = g_get_current_dir();
+        added.location = g_build_filename(dir, location, NULL);
+        g_free(dir);
+    }
+    if (sum) {
+        added.crc = sum->crc;
+        added.arV1 = sum->arV1;
+        added.arV2 = sum->arV2;
+    }
+
+    for (i = 0; i < entry->tracks->len; i++) {
+        RippitLibraryTrack *cur = &g_array_index(entry->tracks, RippitLibraryTrack, i);
+        if (cur->track == track) {
+            g_free(cur->location);
+            *cur = added;
+            return;
+        }
+        if (cur->track > track)
+            break;
+    }
+    g_array_insert_val(entry->tracks, i, added);
+}
+
+const RippitLibraryTrack *rippit_library_entry_find_track(RippitLibraryEntry *entry, gint track)
+{
+    guint i;
+
+    for (i = 0; i < entry->tracks->len; i++) {
+        RippitLibraryTrack *cur = &g_array_index(entry->tracks, RippitLibraryTrack, i);
+        if (cur->track == track)
+            return cur;
+    }
+    return NULL;
+}
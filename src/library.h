@@ -0,0 +1,78 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "checksum.h"
+
+#include <glib.h>
+
+// The library remembers every disc that's been ripped all the way, so the
+// same disc going in again can be spotted straight away. CDs go by their
+// MusicBrainz disc ID and DVDs by their title and a hash of their IFOs.
+//
+// It's a directory with two files in it. library.dat has the discs in it,
+// one record after another, only ever appended to. library.idx is a hash
+// table pointing into it, mapped into memory, so a lookup is a probe or
+// two and a read of the one record. The index can always be rebuilt from
+// library.dat, and is whenever it's missing or behind.
+//
+// Any number of processes can share a library; adding to it takes a lock.
+// A RippitLibrary itself is only for one thread at a time.
+
+typedef struct _RippitLibrary RippitLibrary;
+
+typedef struct {
+    gint track;
+    // Always absolute
+    gchar *location;
+    // Of the audio as it came off the disc; 0 for DVDs
+    guint32 crc;
+    guint32 arV1;
+    guint32 arV2;
+} RippitLibraryTrack;
+
+typedef struct {
+    gchar *key;
+    // When it was added, in seconds since the epoch
+    gint64 ripped;
+    // RippitLibraryTrack, in track order
+    GArray *tracks;
+} RippitLibraryEntry;
+
+// The directory gets created if it isn't there
+RippitLibrary *rippit_library_open(const gchar *dir, GError **error);
+void rippit_library_close(RippitLibrary *library);
+
+// NULL if the library hasn't got it
+RippitLibraryEntry *rippit_library_lookup(RippitLibrary *library, const gchar *key);
+// Replaces whatever the library had under the entry's key. Tracks it had
+// that aren't in the new entry are kept, so a rip that only did the tracks
+// missed last time still adds up to the whole disc.
+gboolean rippit_library_add(RippitLibrary *library, RippitLibraryEntry *entry, GError **error);
+
+RippitLibraryEntry *rippit_library_entry_new(const gchar *key);
+void rippit_library_entry_free(RippitLibraryEntry *entry);
+// Replaces the track if the entry already has it. sum can be NULL.
+void rippit_library_entry_add_track(RippitLibraryEntry *entry, gint track, const gchar *location, const RippitTrackChecksum *sum);
+// NULL if it isn't there
+const RippitLibraryTrack *rippit_library_entry_find_track(RippitLibraryEntry *entry, gint track);
+
+#endif // LIBRARY_H
@@ -0,0 +1,174 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef LIBRIPPIT_H
+#define LIBRIPPIT_H
+
+#include <glib.h>
+
+// librippit: everything rippit does to a disc, as a job that can be run
+// alongside as many others as you like in the one process. Jobs keep all
+// their state to themselves and run on the default main loop, so that has
+// to be running for anything to happen; every callback comes from it.
+// gst_init() has to have been called first.
+
+typedef struct _RippitJob RippitJob;
+
+typedef struct {
+    // Rip the disc even if it can't be looked up
+    gboolean forceRip;
+    // Skip tracks that stall instead of waiting on them forever
+    gboolean ignoreStall;
+    // Only rip this track, or -1 for all of them
+    gint singleTrack;
+    // Read CDs ahead of the encoder, encoding finished tracks in parallel
+    gboolean spool;
+    // Megabytes the spool can hold
+    gint spoolSize;
+    // Tracks or titles encoded at once; 0 for one per core
+    gint encoderCount;
+    // Split each spooled track's FLAC encode over every core. Turns the
+    // spool on.
+    gboolean parallelFlac;
+    gboolean continuous;
+    gboolean adaptive;
+    gboolean image;
+    gboolean copyDVD;
+    // Cut each copied DVD title up and encode the pieces on every core at
+    // once. Turns copyDVD on; does nothing with remux.
+    gboolean splitTitles;
+    gboolean remux;
+    // Speed the drive up and down as the disc reads clean or doesn't
+    gboolean autoSpeed;
+    // Seconds without progress before a track counts as stalled
+    gint stallTimeout;
+    // Megabytes each output file can have waiting in memory to be written,
+    // by a thread of its own, so slow or networked disks don't hold up
+    // the drive. Files are written under a temporary name and only moved
+    // into place once they're complete. 0 writes them directly.
+    gint writeBuffer;
+    // Any of these can be NULL
+    const gchar *metadataCache;
+    const gchar *musicbrainzServer;
+    const gchar *faultTrace;
+    // Where to write a trace of where the pipeline spends its time, for
+    // chrome://tracing; a readable summary goes next to it, with .txt on
+    // the end
+    const gchar *profile;
+    // A directory to remember finished discs in. Discs it already has are
+    // skipped.
+    const gchar *library;
+    // Read one track of a CD the library already has, and only skip the
+    // disc if it matches
+    gboolean spotCheck;
+} RippitJobOptions;
+
+typedef struct {
+    gint track;
+    gint trackCount;
+    // Of the current track, or the whole disc when it's read in one go
+    gint percent;
+    gboolean done;
+} RippitJobProgress;
+
+// Running totals, kept by pad probes as the data goes past, so they cost
+// next to nothing to read as often as you like. They're read without a
+// lock and can be a buffer behind.
+typedef struct {
+    gint track;
+    gint trackCount;
+    // 2352 for CDs, 2048 for DVDs
+    gint sectorSize;
+    // Read off the disc for the current track, and how big it is, or 0
+    // if that isn't known
+    guint64 trackBytes;
+    guint64 trackSize;
+    // Everything read so far, re-reads included, and what's still to go
+    // (0 if that isn't known)
+    guint64 bytesRead;
+    guint64 bytesLeft;
+    // What's gone into the encoders. For DVDs, what they've written out,
+    // and nothing with --copy-dvd.
+    guint64 bytesEncoded;
+    // Reads the drive had to try again, and sectors that couldn't be read
+    guint retries;
+    guint errorSectors;
+    // Milliseconds from rippit_job_new() to the first sector coming off
+    // the disc, or 0 until it has
+    guint firstSectorMs;
+    // Track changes so far, and the milliseconds from one track's last
+    // sector to the next one's first, in all and at worst
+    guint transitions;
+    guint transitionMs;
+    guint transitionMaxMs;
+    // With a write buffer: bytes waiting for the disk, the most there have
+    // been, and how many times and for how long the pipeline had to wait
+    // on it anyway
+    guint64 writePending;
+    guint64 writePeak;
+    guint writeStalls;
+    guint writeStallMs;
+    gboolean done;
+} RippitJobStats;
+
+// Something worth telling whoever's watching, like "Ripping to ..."
+typedef void (*RippitJobMessageFunc)(RippitJob *job, const gchar *message, gpointer data);
+// A track or title has started
+typedef void (*RippitJobProgressFunc)(RippitJob *job, const RippitJobProgress *progress, gpointer data);
+// Everything's been read and encoded, or given up on. FALSE if the job
+// failed or was cancelled.
+typedef void (*RippitJobDoneFunc)(RippitJob *job, gboolean success, gpointer data);
+
+typedef struct {
+    RippitJobMessageFunc message;
+    RippitJobProgressFunc progress;
+    RippitJobDoneFunc done;
+} RippitJobCallbacks;
+
+// Sets up the debug category and rippitimagesrc. rippit_job_new() calls it
+// too, so there's only a need to when using those before any jobs.
+void rippit_init();
+
+void rippit_job_options_init(RippitJobOptions *options);
+
+// device can be a drive, a CD image, an ISO or a VIDEO_TS directory, or
+// NULL for the default drive. The options are copied. NULL if they don't
+// make sense together.
+RippitJob *rippit_job_new(const gchar *device, const RippitJobOptions *options, GError **error);
+// Only once the job is done, or before it's started, and not from inside
+// one of its own callbacks
+void rippit_job_free(RippitJob *job);
+void rippit_job_set_callbacks(RippitJob *job, const RippitJobCallbacks *callbacks, gpointer data);
+
+// Finds out what's in the drive and gets going. FALSE, with nothing more
+// to come from the job, if there's nothing there to rip.
+gboolean rippit_job_start(RippitJob *job, GError **error);
+// Stops reading. Tracks already read still get finished, and then the job
+// is done.
+void rippit_job_cancel(RippitJob *job);
+
+void rippit_job_get_progress(RippitJob *job, RippitJobProgress *progress);
+void rippit_job_get_stats(RippitJob *job, RippitJobStats *stats);
+// The sectors that couldn't be read, from the from'th on, in the order
+// they turned up. Free with g_free().
+gint *rippit_job_get_error_sectors(RippitJob *job, guint from, guint *count);
+const gchar *rippit_job_get_device(RippitJob *job);
+const gchar *rippit_job_get_disc_id(RippitJob *job);
+
+#endif // LIBRIPPIT_H
@@ -0,0 +1,329 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "media.h"
+#include "util.h"
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/cdrom.h>
+
+// Tried in order when there's no device to go on
+static const gchar *defaultDevices[] = {"/dev/cdrom", "/dev/dvd", "/dev/sr0", NULL};
+
+// A drive that's just had its tray shut takes a few seconds to spin up
+#define READY_TIMEOUT (15 * GST_SECOND)
+#define READY_POLL (G_USEC_PER_SEC / 4)
+
+static gchar *cachePath()
+{
+    return g_build_filename(g_get_user_cache_dir(), "rippit", "drives", NULL);
+}
+
+static gchar *sysfsString(const gchar *block, const gchar *attribute)
+{
+    gchar *path = g_build_filename("/sys/block", block, "device", attribute, NULL);
+    gchar *contents = NULL;
+
+    g_file_get_contents(path, &contents, NULL, NULL);
+    g_free(path);
+    return contents ? g_strstrip(contents) : NULL;
+}
+
+// sr0 for /dev/cdrom, through however many links there are
+static gchar *blockName(const gchar *device)
+{
+    char *real = realpath(device, NULL);
+    gchar *name;
+
+    if (!real)
+        return NULL;
+    name = g_path_get_basename(real);
+    free(real);
+    return name;
+}
+
+static gchar *driveName(const gchar *block)
+{
+    gchar *vendor = sysfsString(block, "vendor");
+    gchar *model = sysfsString(block, "model");
+    gchar *revision = sysfsString(block, "rev");
+    gchar *name = NULL;
+
+    if (vendor && model)
+        name = g_strdup_printf("%s %s %s", vendor, model, revision ? revision : "");
+    g_free(vendor);
+    g_free(model);
+    g_free(revision);
+    return name ? g_strchomp(name) : NULL;
+}
+
+// The cache has a group for each of /dev's names for drives, which only
+// counts if the same drive is still behind it
+static gboolean loadDrive(RippitDrive *drive, const gchar *block)
+{
+    GKeyFile *file = g_key_file_new();
+    gchar *path = cachePath();
+    gchar *name = NULL;
+    gboolean found = FALSE;
+
+    if (g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, NULL))
+        name = g_key_file_get_string(file, block, "name", NULL);
+    if (name && g_str_equal(name, drive->name) && g_key_file_has_key(file, block, "capabilities", NULL)) {
+        drive->capabilities = g_key_file_get_integer(file, block, "capabilities", NULL);
+        found = TRUE;
+    }
+    g_free(name);
+    g_free(path);
+    g_key_file_free(file);
+    return found;
+}
+
+static void saveDrive(const RippitDrive *drive, const gchar *block)
+{
+    GKeyFile *file = g_key_file_new();
+    gchar *path = cachePath();
+    gchar *dir = g_path_get_dirname(path);
+    GError *error = NULL;
+    gchar *contents;
+    gsize length;
+
+    g_key_file_load_from_file(file, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    g_key_file_set_string(file, block, "name", drive->name);
+    g_key_file_set_integer(file, block, "capabilities", drive->capabilities);
+    contents = g_key_file_to_data(file, &length, NULL);
+
+    g_mkdir_with_parents(dir, 0755);
+    if (!g_file_set_contents(path, contents, length, &error)) {
+        GST_WARNING("Could not save what %s can do: %s", drive->name, error->message);
+        g_error_free(error);
+    }
+    g_free(contents);
+    g_free(dir);
+    g_free(path);
+    g_key_file_free(file);
+}
+
+static RippitDrive *readDrive(int fd, const gchar *device)
+{
+    RippitDrive *drive = g_new0(RippitDrive, 1);
+    gchar *block = blockName(device);
+    int capabilities;
+
+    drive->name = block ? driveName(block) : NULL;
+    if (drive->name && loadDrive(drive, block)) {
+        GST_DEBUG("%s (%s) is in the cache", device, drive->name);
+        g_free(block);
+        return drive;
+    }
+
+    capabilities = ioctl(fd, CDROM_GET_CAPABILITY, 0);
+    drive->capabilities = capabilities < 0 ? 0 : capabilities;
+    if (!drive->name)
+        drive->name = g_strdup(device);
+    else
+        saveDrive(drive, block);
+    GST_DEBUG("%s (%s) can do %#x", device, drive->name, drive->capabilities);
+    g_free(block);
+    return drive;
+}
+
+static void freeDrive(RippitDrive *drive)
+{
+    g_free(drive->name);
+    g_free(drive);
+}
+
+static gint driveStatus(int fd)
+{
+    GstClockTime until = gst_util_get_timestamp() + READY_TIMEOUT;
+    gint status = ioctl(fd, CDROM_DRIVE_STATUS, CDSL_CURRENT);
+
+    while (status == CDS_DRIVE_NOT_READY && gst_util_get_timestamp() < until) {
+        g_usleep(READY_POLL);
+        status = ioctl(fd, CDROM_DRIVE_STATUS, CDSL_CURRENT);
+    }
+    return status;
+}
+
+// Only the audio tracks, which is all cdparanoiasrc counts
+static gboolean readToc(RippitMedia *media, int fd)
+{
+    struct cdrom_tochdr header;
+    struct cdrom_tocentry leadout;
+    GArray *starts;
+    gint track;
+
+    if (ioctl(fd, CDROMREADTOCHDR, &header) < 0)
+        return FALSE;
+
+    starts = g_array_new(FALSE, FALSE, sizeof(gint64));
+    for (track = header.cdth_trk0; track <= header.cdth_trk1; track++) {
+        struct cdrom_tocentry entry;
+        gint64 start;
+
+        memset(&entry, 0, sizeof(entry));
+        entry.cdte_track = track;
+        entry.cdte_format = CDROM_LBA;
+        if (ioctl(fd, CDROMREADTOCENTRY, &entry) < 0) {
+            g_array_free(starts, TRUE);
+            return FALSE;
+        }
+        if (entry.cdte_ctrl & CDROM_DATA_TRACK)
+            continue;
+        start = entry.cdte_addr.lba;
+        g_array_append_val(starts, start);
+    }
+
+    media->trackCount = starts->len;
+    media->trackStarts = (gint64*)g_array_free(starts, FALSE);
+
+    memset(&leadout, 0, sizeof(leadout));
+    leadout.cdte_track = CDROM_LEADOUT;
+    leadout.cdte_format = CDROM_LBA;
+    if (ioctl(fd, CDROMREADTOCENTRY, &leadout) == 0)
+        media->leadout = leadout.cdte_addr.lba;
+    return media->trackCount > 0;
+}
+
+static gboolean readDVD(RippitMedia *media, GError **error)
+{
+    media->dvd = rippit_dvd_read_info(media->device, error);
+    if (!media->dvd)
+        return FALSE;
+    media->type = RIPPIT_MEDIA_DVD;
+    return TRUE;
+}
+
+static gboolean probeImage(const gchar *device)
+{
+    gboolean ret = TRUE;
+    GstElement *probe = gst_element_factory_make("rippitimagesrc", NULL);
+    if (!probe)
+        return FALSE;
+    g_object_set(G_OBJECT(probe), "device", device, NULL);
+    if (gst_element_set_state(probe, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE)
+        ret = FALSE;
+    gst_element_set_state(probe, GST_STATE_NULL);
+    gst_object_unref(probe);
+    return ret;
+}
+
+static gboolean probeDrive(RippitMedia *media, GError **error)
+{
+    int fd = rippit_open_drive(media->device, error);
+    gint status;
+
+    if (fd < 0)
+        return FALSE;
+
+    media->drive = readDrive(fd, media->device);
+    status = driveStatus(fd);
+    if (status != CDS_DISC_OK) {
+        g_set_error(error, RIPPIT_ERROR, 0, "There's no disc in %s", media->device);
+        close(fd);
+        return FALSE;
+    }
+
+    switch (ioctl(fd, CDROM_DISC_STATUS, 0)) {
+        case CDS_AUDIO:
+        case CDS_MIXED:
+            media->type = RIPPIT_MEDIA_CD;
+            if (!readToc(media, fd)) {
+                g_set_error(error, RIPPIT_ERROR, 0, "Could not read the table of contents of %s", media->device);
+                close(fd);
+                return FALSE;
+            }
+            close(fd);
+            return TRUE;
+        case CDS_NO_INFO:
+        case CDS_DATA_1:
+        case CDS_DATA_2:
+        case CDS_XA_2_1:
+        case CDS_XA_2_2:
+            break;
+        default:
+            g_set_error(error, RIPPIT_ERROR, 0, "Could not tell what's in %s", media->device);
+            close(fd);
+            return FALSE;
+    }
+    close(fd);
+
+    // Looking for a VIDEO_TS on a data CD means combing through all of it
+    if (media->drive->capabilities && !(media->drive->capabilities & CDC_DVD)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "The disc in %s has no audio, and the drive can't read DVDs", media->device);
+        return FALSE;
+    }
+    return readDVD(media, error);
+}
+
+static const gchar *defaultDevice()
+{
+    gint i;
+    for (i = 0; defaultDevices[i]; i++) {
+        if (g_file_test(defaultDevices[i], G_FILE_TEST_EXISTS))
+            return defaultDevices[i];
+    }
+    return defaultDevices[0];
+}
+
+RippitMedia *rippit_media_probe(const gchar *device, GError **error)
+{
+    RippitMedia *media = g_new0(RippitMedia, 1);
+    GstClockTime start = gst_util_get_timestamp();
+    gboolean found;
+
+    media->device = g_strdup(device ? device : defaultDevice());
+
+    // dvdreadsrc reads ISO files and VIDEO_TS directories by itself, so
+    // only CD images need a source of their own
+    if (g_file_test(media->device, G_FILE_TEST_IS_REGULAR) && probeImage(media->device)) {
+        media->type = RIPPIT_MEDIA_CD_IMAGE;
+        found = TRUE;
+    } else if (g_file_test(media->device, G_FILE_TEST_IS_REGULAR | G_FILE_TEST_IS_DIR)) {
+        found = readDVD(media, error);
+    } else {
+        found = probeDrive(media, error);
+    }
+
+    if (!found) {
+        rippit_media_free(media);
+        return NULL;
+    }
+    GST_INFO("Probed %s in %.1fms", media->device, (gdouble)(gst_util_get_timestamp() - start) / GST_MSECOND);
+    return media;
+}
+
+void rippit_media_free(RippitMedia *media)
+{
+    if (media->drive)
+        freeDrive(media->drive);
+    if (media->dvd)
+        rippit_dvd_info_free(media->dvd);
+    g_free(media->trackStarts);
+    g_free(media->device);
+    g_free(media);
+}
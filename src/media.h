@@ -0,0 +1,71 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef MEDIA_H
+#define MEDIA_H
+
+#include <glib.h>
+#include "dvd.h"
+
+// Works out what's in the drive before any pipeline gets built, from a
+// single open of it: an audio CD's table of contents comes straight out of
+// the kernel, and a DVD's name, IFO hash and titles out of one DVDOpen.
+// The pipeline then gets built for what's there, instead of trying each
+// source element on the drive in turn until one of them manages to start.
+//
+// What the drive itself can do doesn't change from one disc to the next,
+// so that's kept in ~/.cache/rippit/drives and only looked up the first
+// time a drive is seen.
+
+typedef enum {
+    RIPPIT_MEDIA_CD,
+    RIPPIT_MEDIA_CD_IMAGE,
+    RIPPIT_MEDIA_DVD
+} RippitMediaType;
+
+typedef struct {
+    // Vendor, model and firmware revision, as the kernel has them
+    gchar *name;
+    // CDC_* from linux/cdrom.h
+    gint capabilities;
+} RippitDrive;
+
+typedef struct {
+    RippitMediaType type;
+    // What was probed, which is one of the usual names for the drive if
+    // there wasn't a device to begin with
+    gchar *device;
+    // NULL for images and VIDEO_TS directories
+    RippitDrive *drive;
+    // Audio CDs in a drive: the audio tracks, and the sector each starts
+    // on, counted the way cdparanoiasrc counts them. trackCount is 0 for
+    // images, which get asked once they're open.
+    gint trackCount;
+    gint64 *trackStarts;
+    gint64 leadout;
+    // DVDs only
+    RippitDvdInfo *dvd;
+} RippitMedia;
+
+// device can be NULL for the first drive there is. NULL if there's
+// nothing in it that can be ripped.
+RippitMedia *rippit_media_probe(const gchar *device, GError **error);
+void rippit_media_free(RippitMedia *media);
+
+#endif // MEDIA_H
@@ -0,0 +1,309 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "metadata.h"
+
+#include <musicbrainz3/mb_c.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    gchar *cacheDir;
+    gchar *server;
+    gchar *discID;
+    RippitDiscInfo *info;
+    RippitDiscInfoFunc func;
+    gpointer data;
+} LookupJob;
+
+typedef struct {
+    gchar *from;
+    gchar *to;
+    GstTagList *tags;
+    gboolean success;
+    RippitRetagFunc func;
+    gpointer data;
+} RetagJob;
+
+void rippit_disc_info_free(RippitDiscInfo *info)
+{
+    if (!info)
+        return;
+    g_free(info->discID);
+    g_free(info->album);
+    g_free(info->artist);
+    g_strfreev(info->titles);
+    // artists may have holes in it, so g_strfreev won't do
+    if (info->artists) {
+        int i;
+        for (i = 0; i < info->trackCount; i++)
+            g_free(info->artists[i]);
+        g_free(info->artists);
+    }
+    g_free(info);
+}
+
+const gchar *rippit_disc_info_track_artist(RippitDiscInfo *info, gint track)
+{
+    if (track >= 1 && track <= info->trackCount && info->artists[track-1])
+        return info->artists[track-1];
+    return info->artist;
+}
+
+const gchar *rippit_disc_info_track_title(RippitDiscInfo *info, gint track)
+{
+    if (track >= 1 && track <= info->trackCount)
+        return info->titles[track-1];
+    return "Unknown";
+}
+
+gchar *rippit_metadata_default_cache()
+{
+    return g_build_filename(g_get_user_cache_dir(), "rippit", "discs", NULL);
+}
+
+static gchar *cachePath(const gchar *cacheDir, const gchar *discID)
+{
+    gchar *name = g_strdup_printf("%s.disc", discID);
+    gchar *path = g_build_filename(cacheDir, name, NULL);
+    g_free(name);
+    return path;
+}
+
+RippitDiscInfo *rippit_disc_info_load(const gchar *cacheDir, const gchar *discID)
+{
+    RippitDiscInfo *info;
+    GKeyFile *file = g_key_file_new();
+    gchar *path = cachePath(cacheDir, discID);
+    int i;
+
+    if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, NULL)) {
+        g_key_file_free(file);
+        g_free(path);
+        return NULL;
+    }
+    g_free(path);
+
+    info = g_new0(RippitDiscInfo, 1);
+    info->discID = g_strdup(discID);
+    info->album = g_key_file_get_string(file, "disc", "album", NULL);
+    info->artist = g_key_file_get_string(file, "disc", "artist", NULL);
+    info->trackCount = g_key_file_get_integer(file, "disc", "tracks", NULL);
+    info->titles = g_new0(gchar*, info->trackCount+1);
+    info->artists = g_new0(gchar*, info->trackCount+1);
+    for (i = 0; i < info->trackCount; i++) {
+        gchar *group = g_strdup_printf("track %d", i+1);
+        info->titles[i] = g_key_file_get_string(file, group, "title", NULL);
+        info->artists[i] = g_key_file_get_string(file, group, "artist", NULL);
+        if (!info->titles[i])
+            info->titles[i] = g_strdup_printf("Track %d", i+1);
+        g_free(group);
+    }
+    g_key_file_free(file);
+
+    if (!info->album || !info->artist) {
+        GST_WARNING("Ignoring incomplete cache entry for %s", discID);
+        rippit_disc_info_free(info);
+        return NULL;
+    }
+    GST_DEBUG("Found %s in the metadata cache", discID);
+    return info;
+}
+
+gboolean rippit_disc_info_save(const gchar *cacheDir, RippitDiscInfo *info, GError **error)
+{
+    GKeyFile *file = g_key_file_new();
+    gchar *path;
+    gchar *contents;
+    gsize length;
+    gboolean ret;
+    int i;
+
+    g_key_file_set_string(file, "disc", "album", info->album);
+    g_key_file_set_string(file, "disc", "artist", info->artist);
+    g_key_file_set_integer(file, "disc", "tracks", info->trackCount);
+    for (i = 0; i < info->trackCount; i++) {
+        gchar *group = g_strdup_printf("track %d", i+1);
+        g_key_file_set_string(file, group, "title", info->titles[i]);
+        if (info->artists[i])
+            g_key_file_set_string(file, group, "artist", info->artists[i]);
+        g_free(group);
+    }
+
+    contents = g_key_file_to_data(file, &length, NULL);
+    g_key_file_free(file);
+
+    g_mkdir_with_parents(cacheDir, 0755);
+    path = cachePath(cacheDir, info->discID);
+    ret = g_file_set_contents(path, contents, length, error);
+    g_free(path);
+    g_free(contents);
+    return ret;
+}
+
+RippitDiscInfo *rippit_disc_info_lookup(const gchar *server, const gchar *discID)
+{
+    RippitDiscInfo *info = NULL;
+    gchar name[256];
+    int releases;
+    int i;
+
+    MbWebService svc = mb_webservice_new();
+    if (server) {
+        gchar **hostPort = g_strsplit(server, ":", 2);
+        mb_webservice_set_host(svc, hostPort[0]);
+        if (hostPort[1])
+            mb_webservice_set_port(svc, atoi(hostPort[1]));
+        g_strfreev(hostPort);
+    }
+    MbQuery q = mb_query_new(svc, "rippit-" RIPPIT_VERSION_STRING);
+    MbReleaseFilter filter = mb_release_filter_disc_id(mb_release_filter_new(), discID);
+    MbResultList results = mb_query_get_releases(q, filter);
+    releases = results ? mb_result_list_get_size(results) : 0;
+    GST_DEBUG("Got %d results", releases);
+
+    if (releases > 0) {
+        MbRelease release = mb_result_list_get_release(results, 0);
+        MbArtist albumArtist = mb_release_get_artist(release);
+
+        info = g_new0(RippitDiscInfo, 1);
+        info->discID = g_strdup(discID);
+        mb_release_get_title(release, name, sizeof(name));
+        info->album = g_strdup(name);
+        mb_artist_get_name(albumArtist, name, sizeof(name));
+        info->artist = g_strdup(name);
+        info->trackCount = mb_release_get_num_tracks(release);
+        info->titles = g_new0(gchar*, info->trackCount+1);
+        info->artists = g_new0(gchar*, info->trackCount+1);
+        for (i = 0; i < info->trackCount; i++) {
+            MbTrack track = mb_release_get_track(release, i);
+            MbArtist artist = mb_track_get_artist(track);
+            mb_track_get_title(track, name, sizeof(name));
+            info->titles[i] = g_strdup(name);
+            if (artist) {
+                mb_artist_get_name(artist, name, sizeof(name));
+                info->artists[i] = g_strdup(name);
+            }
+        }
+    }
+
+    if (results)
+        mb_result_list_free(results);
+    mb_release_filter_free(filter);
+    mb_query_free(q);
+    mb_webservice_free(svc);
+    return info;
+}
+
+static gboolean lookupDone_cb(gpointer data)
+{
+    LookupJob *job = data;
+    job->func(job->info, job->data);
+    g_free(job->cacheDir);
+    g_free(job->server);
+    g_free(job->discID);
+    g_free(job);
+    return FALSE;
+}
+
+static gpointer lookupThread(gpointer data)
+{
+    LookupJob *job = data;
+    GError *error = NULL;
+
+    job->info = rippit_disc_info_lookup(job->server, job->discID);
+    if (job->info && !rippit_disc_info_save(job->cacheDir, job->info, &error)) {
+        GST_WARNING("Could not cache disc info for %s: %s", job->discID, error->message);
+        g_error_free(error);
+    }
+    g_idle_add(lookupDone_cb, job);
+    return NULL;
+}
+
+void rippit_disc_info_lookup_async(const gchar *cacheDir, const gchar *server, const gchar *discID, RippitDiscInfoFunc func, gpointer data)
+{
+    LookupJob *job = g_new0(LookupJob, 1);
+    job->cacheDir = g_strdup(cacheDir);
+    job->server = g_strdup(server);
+    job->discID = g_strdup(discID);
+    job->func = func;
+    job->data = data;
+    g_thread_create(lookupThread, job, FALSE, NULL);
+}
+
+static gboolean retagDone_cb(gpointer data)
+{
+    RetagJob *job = data;
+    if (job->func)
+        job->func(job->to, job->success, job->data);
+    g_free(job->from);
+    g_free(job->to);
+    gst_tag_list_free(job->tags);
+    g_free(job);
+    return FALSE;
+}
+
+static gpointer retagThread(gpointer data)
+{
+    RetagJob *job = data;
+    GstElement *pipe = gst_pipeline_new(NULL);
+    GstElement *source = gst_element_factory_make("filesrc", NULL);
+    GstElement *tagger = gst_element_factory_make("flactag", NULL);
+    GstElement *output = gst_element_factory_make("filesink", NULL);
+    GstBus *bus;
+    GstMessage *msg;
+
+    g_object_set(G_OBJECT(source), "location", job->from, NULL);
+    g_object_set(G_OBJECT(output), "location", job->to, NULL);
+    gst_tag_setter_merge_tags(GST_TAG_SETTER(tagger), job->tags, GST_TAG_MERGE_REPLACE_ALL);
+
+    gst_bin_add_many(GST_BIN(pipe), source, tagger, output, NULL);
+    gst_element_link_many(source, tagger, output, NULL);
+    gst_element_set_state(pipe, GST_STATE_PLAYING);
+
+    bus = gst_pipeline_get_bus(GST_PIPELINE(pipe));
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    job->success = (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipe, GST_STATE_NULL);
+    gst_object_unref(pipe);
+
+    // Only throw away the original once the retagged copy is known good
+    if (job->success)
+        g_unlink(job->from);
+    else
+        g_unlink(job->to);
+
+    g_idle_add(retagDone_cb, job);
+    return NULL;
+}
+
+void rippit_retag_async(const gchar *from, const gchar *to, GstTagList *tags, RippitRetagFunc func, gpointer data)
+{
+    RetagJob *job = g_new0(RetagJob, 1);
+    job->from = g_strdup(from);
+    job->to = g_strdup(to);
+    job->tags = tags;
+    job->func = func;
+    job->data = data;
+    g_thread_create(retagThread, job, FALSE, NULL);
+}
@@ -0,0 +1,58 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <gst/gst.h>
+
+// What we know about a disc. Whether it came from MusicBrainz or the local
+// cache, it always looks the same.
+typedef struct {
+    gchar *discID;
+    gchar *album;
+    gchar *artist;
+    gint trackCount;
+    gchar **titles;
+    // Per-track artists, for compilations. NULL entries fall back to artist.
+    gchar **artists;
+} RippitDiscInfo;
+
+// info is NULL if the disc couldn't be found. Always called from the main loop.
+typedef void (*RippitDiscInfoFunc)(RippitDiscInfo *info, gpointer data);
+typedef void (*RippitRetagFunc)(const gchar *location, gboolean success, gpointer data);
+
+void rippit_disc_info_free(RippitDiscInfo *info);
+const gchar *rippit_disc_info_track_artist(RippitDiscInfo *info, gint track);
+const gchar *rippit_disc_info_track_title(RippitDiscInfo *info, gint track);
+
+gchar *rippit_metadata_default_cache();
+RippitDiscInfo *rippit_disc_info_load(const gchar *cacheDir, const gchar *discID);
+gboolean rippit_disc_info_save(const gchar *cacheDir, RippitDiscInfo *info, GError **error);
+
+// server may be NULL for musicbrainz.org, or "host[:port]" for anything else
+RippitDiscInfo *rippit_disc_info_lookup(const gchar *server, const gchar *discID);
+// Runs the lookup on its own thread, and caches whatever it finds
+void rippit_disc_info_lookup_async(const gchar *cacheDir, const gchar *server, const gchar *discID, RippitDiscInfoFunc func, gpointer data);
+
+// Rewrites the tags of a finished FLAC file into a new location, in the
+// background. Takes ownership of tags.
+void rippit_retag_async(const gchar *from, const gchar *to, GstTagList *tags, RippitRetagFunc func, gpointer data);
+
+#endif // METADATA_H
@@ -0,0 +1,520 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "profile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Past this many, buffers still get counted but don't go into the trace;
+// a DVD title can push a few hundred million of them
+#define MAX_TRACE_EVENTS 1000000
+// How often queue levels get looked at
+#define QUEUE_SAMPLE_MS 100
+// A queue taking this long to take a buffer was full
+#define STALL_THRESHOLD (GST_MSECOND)
+// Deeper than any pipeline we build
+#define MAX_DEPTH 32
+
+typedef struct {
+    const gchar *name;
+    guint64 buffers;
+    guint64 bytes;
+    // Working on buffers, not counting what was pushed downstream
+    GstClockTime busy;
+    GstClockTime maxBusy;
+    // Between buffers at the top of a thread
+    GstClockTime producing;
+    GstClockTime stalled;
+    guint stalls;
+    gboolean isQueue;
+    guint fillSamples;
+    gdouble fillTotal;
+    guint fullSamples;
+    guint emptySamples;
+} ElementStats;
+
+typedef struct {
+    const gchar *name;
+    const gchar *category;
+    guint tid;
+    GstClockTime start;
+    GstClockTime duration;
+} TraceEvent;
+
+typedef struct {
+    const gchar *name;
+    GstClockTime time;
+    guint buffers;
+    guint bytes;
+    gdouble fill;
+} QueueSample;
+
+struct _RippitProfile {
+    GMutex *lock;
+    GstClockTime start;
+    GstClockTime end;
+    // Element name -> ElementStats
+    GHashTable *elements;
+    GArray *events;
+    guint droppedEvents;
+    GArray *samples;
+    // tid -> name
+    GHashTable *threads;
+    // Queues, with a ref each, for sampling
+    GList *queues;
+    guint sampleSource;
+};
+
+typedef struct {
+    RippitProfile *profile;
+    GstPadChainFunction chain;
+    // Interned, like every name in here, so they outlive the elements
+    const gchar *element;
+    const gchar *producer;
+    gboolean isQueue;
+} PadInfo;
+
+typedef struct {
+    PadInfo *info;
+    GstClockTime start;
+    GstClockTime children;
+} Frame;
+
+typedef struct {
+    guint tid;
+    gint depth;
+    Frame frames[MAX_DEPTH];
+    // When the last buffer at the top of this thread was done with, and
+    // for which profile; threads get reused from one pipeline to the next
+    RippitProfile *profile;
+    GstClockTime lastEnd;
+} ThreadState;
+
+static GStaticPrivate threadKey = G_STATIC_PRIVATE_INIT;
+G_LOCK_DEFINE_STATIC(threadIds);
+static guint nextThreadId = 1;
+
+static GQuark padInfoQuark()
+{
+    static GQuark quark = 0;
+    if (!quark)
+        quark = g_quark_from_static_string("rippit-profile-pad");
+    return quark;
+}
+
+static ThreadState *threadState()
+{
+    ThreadState *thread = g_static_private_get(&threadKey);
+    if (!thread) {
+        thread = g_new0(ThreadState, 1);
+        G_LOCK(threadIds);
+        thread->tid = nextThreadId++;
+        G_UNLOCK(threadIds);
+        g_static_private_set(&threadKey, thread, g_free);
+    }
+    return thread;
+}
+
+// Called with the lock held
+static ElementStats *elementStats(RippitProfile *profile, const gchar *name)
+{
+    ElementStats *stats = g_hash_table_lookup(profile->elements, name);
+    if (!stats) {
+        stats = g_new0(ElementStats, 1);
+        stats->name = name;
+        g_hash_table_insert(profile->elements, (gpointer)name, stats);
+    }
+    return stats;
+}
+
+// Called with the lock held
+static void addEvent(RippitProfile *profile, const gchar *name, const gchar *category, guint tid, GstClockTime start, GstClockTime duration)
+{
+    TraceEvent event;
+
+    if (profile->events->len >= MAX_TRACE_EVENTS) {
+        profile->droppedEvents++;
+        return;
+    }
+    event.name = name;
+    event.category = category;
+    event.tid = tid;
+    event.start = start;
+    event.duration = duration;
+    g_array_append_val(profile->events, event);
+}
+
+// The element that feeds pad, looking through ghost pads
+static const gchar *findProducer(GstPad *pad)
+{
+    GstPad *peer = gst_pad_get_peer(pad);
+    const gchar *name = NULL;
+
+    while (peer && !name) {
+        GstObject *parent = gst_object_get_parent(GST_OBJECT(peer));
+        GstPad *next = NULL;
+
+        if (parent && GST_IS_GHOST_PAD(parent)) {
+            // The inside of a bin's sink pad; carry on from whatever feeds the bin
+            next = gst_pad_get_peer(GST_PAD(parent));
+        } else if (GST_IS_GHOST_PAD(peer)) {
+            // A bin's src pad; the element behind it inside the bin
+            next = gst_ghost_pad_get_target(GST_GHOST_PAD(peer));
+        } else if (parent && GST_IS_ELEMENT(parent)) {
+            name = g_intern_string(GST_OBJECT_NAME(parent));
+        }
+        if (parent)
+            gst_object_unref(parent);
+        gst_object_unref(peer);
+        peer = next;
+    }
+    if (peer)
+        gst_object_unref(peer);
+    return name ? name : g_intern_static_string("unknown");
+}
+
+static GstFlowReturn profiledChain(GstPad *pad, GstBuffer *buffer)
+{
+    PadInfo *info = g_object_get_qdata(G_OBJECT(pad), padInfoQuark());
+    RippitProfile *profile = info->profile;
+    ThreadState *thread = threadState();
+    guint size = GST_BUFFER_SIZE(buffer);
+    GstClockTime start;
+    GstClockTime end;
+    GstClockTime spent;
+    GstClockTime busy;
+    GstFlowReturn ret;
+    Frame *frame = NULL;
+    gboolean top = thread->depth == 0;
+
+    if (thread->profile != profile) {
+        thread->profile = profile;
+        thread->lastEnd = 0;
+    }
+    if (top && !info->producer) {
+        info->producer = findProducer(pad);
+        g_mutex_lock(profile->lock);
+        if (!g_hash_table_lookup(profile->threads, GUINT_TO_POINTER(thread->tid)))
+            g_hash_table_insert(profile->threads, GUINT_TO_POINTER(thread->tid), (gpointer)info->producer);
+        g_mutex_unlock(profile->lock);
+    }
+
+    start = gst_util_get_timestamp();
+    if (thread->depth < MAX_DEPTH) {
+        frame = &thread->frames[thread->depth];
+        frame->info = info;
+        frame->start = start;
+        frame->children = 0;
+    }
+    thread->depth++;
+    ret = info->chain(pad, buffer);
+    thread->depth--;
+    end = gst_util_get_timestamp();
+
+    spent = end - start;
+    busy = frame ? spent - MIN(spent, frame->children) : spent;
+    if (thread->depth > 0 && thread->depth <= MAX_DEPTH)
+        thread->frames[thread->depth-1].children += spent;
+
+    g_mutex_lock(profile->lock);
+    {
+        ElementStats *stats = elementStats(profile, info->element);
+        gboolean stall = info->isQueue && busy >= STALL_THRESHOLD;
+
+        stats->buffers++;
+        stats->bytes += size;
+        stats->busy += busy;
+        stats->maxBusy = MAX(stats->maxBusy, busy);
+        if (stall) {
+            stats->stalled += busy;
+            stats->stalls++;
+        }
+        addEvent(profile, info->element, stall ? "stall" : "buffer", thread->tid, start - profile->start, spent);
+
+        if (top && thread->lastEnd > 0) {
+            ElementStats *producer = elementStats(profile, info->producer);
+            producer->producing += start - thread->lastEnd;
+            addEvent(profile, info->producer, "produce", thread->tid, thread->lastEnd - profile->start, start - thread->lastEnd);
+        }
+    }
+    g_mutex_unlock(profile->lock);
+
+    if (top)
+        thread->lastEnd = end;
+    return ret;
+}
+
+static void watchPad(RippitProfile *profile, GstElement *element, GstPad *pad)
+{
+    PadInfo *info;
+
+    // Ghost pads only hand buffers on to the real ones, which get their
+    // own wrapper
+    if (!GST_PAD_IS_SINK(pad) || GST_IS_GHOST_PAD(pad) || !GST_PAD_CHAINFUNC(pad))
+        return;
+    if (g_object_get_qdata(G_OBJECT(pad), padInfoQuark()))
+        return;
+
+    info = g_new0(PadInfo, 1);
+    info->profile = profile;
+    info->chain = GST_PAD_CHAINFUNC(pad);
+    info->element = g_intern_string(GST_ELEMENT_NAME(element));
+    info->isQueue = g_object_class_find_property(G_OBJECT_GET_CLASS(element), "current-level-buffers") != NULL;
+    g_object_set_qdata_full(G_OBJECT(pad), padInfoQuark(), info, g_free);
+    gst_pad_set_chain_function(pad, profiledChain);
+}
+
+static void padAdded_cb(GstElement *element, GstPad *pad, gpointer data)
+{
+    watchPad(data, element, pad);
+}
+
+static void watchElement(RippitProfile *profile, GstElement *element);
+
+static void elementAdded_cb(GstBin *bin, GstElement *element, gpointer data)
+{
+    watchElement(data, element);
+}
+
+static void watchElement(RippitProfile *profile, GstElement *element)
+{
+    GList *cur;
+
+    if (GST_IS_BIN(element)) {
+        g_signal_connect(element, "element-added", G_CALLBACK(elementAdded_cb), profile);
+        GST_OBJECT_LOCK(element);
+        for (cur = GST_BIN_CHILDREN(element); cur; cur = cur->next)
+            watchElement(profile, cur->data);
+        GST_OBJECT_UNLOCK(element);
+        return;
+    }
+
+    g_signal_connect(element, "pad-added", G_CALLBACK(padAdded_cb), profile);
+    GST_OBJECT_LOCK(element);
+    for (cur = GST_ELEMENT_PADS(element); cur; cur = cur->next)
+        watchPad(profile, element, cur->data);
+    GST_OBJECT_UNLOCK(element);
+
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), "current-level-buffers")) {
+        g_mutex_lock(profile->lock);
+        profile->queues = g_list_prepend(profile->queues, gst_object_ref(element));
+        elementStats(profile, g_intern_string(GST_ELEMENT_NAME(element)))->isQueue = TRUE;
+        g_mutex_unlock(profile->lock);
+    }
+}
+
+static gdouble queueFill(guint64 level, guint64 max)
+{
+    return max > 0 ? (gdouble)level / max : 0;
+}
+
+static gboolean sampleQueues_cb(gpointer data)
+{
+    RippitProfile *profile = data;
+    GstClockTime now = gst_util_get_timestamp();
+    GList *cur;
+
+    g_mutex_lock(profile->lock);
+    for (cur = profile->queues; cur; cur = cur->next) {
+        GstElement *queue = cur->data;
+        guint buffers, bytes, maxBuffers, maxBytes;
+        guint64 time, maxTime;
+        ElementStats *stats;
+        QueueSample sample;
+
+        g_object_get(G_OBJECT(queue), "current-level-buffers", &buffers, "current-level-bytes", &bytes,
+                     "current-level-time", &time, "max-size-buffers", &maxBuffers,
+                     "max-size-bytes", &maxBytes, "max-size-time", &maxTime, NULL);
+        sample.name = g_intern_string(GST_ELEMENT_NAME(queue));
+        sample.time = now - profile->start;
+        sample.buffers = buffers;
+        sample.bytes = bytes;
+        // By whichever of its limits it's closest to
+        sample.fill = MAX(queueFill(buffers, maxBuffers), MAX(queueFill(bytes, maxBytes), queueFill(time, maxTime)));
+        sample.fill = MIN(sample.fill, 1.0);
+        if (profile->samples->len < MAX_TRACE_EVENTS)
+            g_array_append_val(profile->samples, sample);
+
+        stats = elementStats(profile, sample.name);
+        stats->fillSamples++;
+        stats->fillTotal += sample.fill;
+        if (sample.fill >= 0.99)
+            stats->fullSamples++;
+        if (buffers == 0)
+            stats->emptySamples++;
+    }
+    g_mutex_unlock(profile->lock);
+    return TRUE;
+}
+
+RippitProfile *rippit_profile_new()
+{
+    RippitProfile *profile = g_new0(RippitProfile, 1);
+    profile->lock = g_mutex_new();
+    profile->start = gst_util_get_timestamp();
+    profile->elements = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    profile->events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+    profile->samples = g_array_new(FALSE, FALSE, sizeof(QueueSample));
+    profile->threads = g_hash_table_new(g_direct_hash, g_direct_equal);
+    profile->sampleSource = g_timeout_add(QUEUE_SAMPLE_MS, sampleQueues_cb, profile);
+    return profile;
+}
+
+void rippit_profile_free(RippitProfile *profile)
+{
+    g_source_remove(profile->sampleSource);
+    g_list_foreach(profile->queues, (GFunc)gst_object_unref, NULL);
+    g_list_free(profile->queues);
+    g_hash_table_destroy(profile->elements);
+    g_hash_table_destroy(profile->threads);
+    g_array_free(profile->events, TRUE);
+    g_array_free(profile->samples, TRUE);
+    g_mutex_free(profile->lock);
+    g_free(profile);
+}
+
+void rippit_profile_watch(RippitProfile *profile, GstBin *bin)
+{
+    watchElement(profile, GST_ELEMENT(bin));
+}
+
+static void writeThreadName(gpointer key, gpointer value, gpointer data)
+{
+    fprintf(data, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+            GPOINTER_TO_UINT(key), (const gchar*)value);
+}
+
+static gboolean writeTrace(RippitProfile *profile, const gchar *path, GError **error)
+{
+    FILE *out = fopen(path, "w");
+    guint i;
+
+    if (!out) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not write %s: %s", path, g_strerror(errno));
+        return FALSE;
+    }
+
+    // Element names are GStreamer's, which never need escaping
+    fprintf(out, "{\"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"rippit\"}}");
+    g_hash_table_foreach(profile->threads, writeThreadName, out);
+    for (i = 0; i < profile->events->len; i++) {
+        TraceEvent *event = &g_array_index(profile->events, TraceEvent, i);
+        fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                event->name, event->category, event->tid,
+                (gdouble)event->start / GST_USECOND, (gdouble)event->duration / GST_USECOND);
+    }
+    for (i = 0; i < profile->samples->len; i++) {
+        QueueSample *sample = &g_array_index(profile->samples, QueueSample, i);
+        fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"fill %%\": %.1f, \"buffers\": %u, \"bytes\": %u}}",
+                sample->name, (gdouble)sample->time / GST_USECOND, sample->fill * 100, sample->buffers, sample->bytes);
+    }
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not write %s: %s", path, g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void collectStats(gpointer key, gpointer value, gpointer data)
+{
+    g_ptr_array_add(data, value);
+}
+
+static gint compareBusy(gconstpointer a, gconstpointer b)
+{
+    const ElementStats *x = *(ElementStats**)a;
+    const ElementStats *y = *(ElementStats**)b;
+    return x->busy < y->busy ? 1 : x->busy > y->busy ? -1 : 0;
+}
+
+static gboolean writeReport(RippitProfile *profile, const gchar *path, GError **error)
+{
+    GstClockTime wall = profile->end - profile->start;
+    GPtrArray *sorted = g_ptr_array_new();
+    GString *report = g_string_new("");
+    gboolean ret;
+    guint i;
+
+    g_hash_table_foreach(profile->elements, collectStats, sorted);
+    g_ptr_array_sort(sorted, compareBusy);
+
+    g_string_append_printf(report, "%.1fs of ripping\n\n", (gdouble)wall / GST_SECOND);
+    g_string_append_printf(report, "%-24s %10s %10s %8s %6s %9s %8s %10s %8s\n",
+                           "element", "buffers", "MB", "busy s", "busy%", "avg us", "max ms", "between s", "stalls");
+    for (i = 0; i < sorted->len; i++) {
+        ElementStats *stats = g_ptr_array_index(sorted, i);
+        g_string_append_printf(report, "%-24s %10" G_GUINT64_FORMAT " %10.1f %8.2f %5.1f%% %9.1f %8.2f %10.2f %8u\n",
+                               stats->name, stats->buffers, (gdouble)stats->bytes / (1024 * 1024),
+                               (gdouble)stats->busy / GST_SECOND, wall > 0 ? (gdouble)stats->busy * 100 / wall : 0,
+                               stats->buffers > 0 ? (gdouble)stats->busy / stats->buffers / GST_USECOND : 0,
+                               (gdouble)stats->maxBusy / GST_MSECOND, (gdouble)stats->producing / GST_SECOND, stats->stalls);
+    }
+
+    g_string_append(report, "\nbusy is time spent on buffers, not counting pushing them on; between is time at\n"
+                            "the top of a thread between buffers: reading, for a source, or waiting for data,\n"
+                            "for a queue. A stall is a queue that was full and held up the thread feeding it.\n");
+
+    g_string_append_printf(report, "\n%-24s %8s %8s %8s %10s\n", "queue", "avg fill", "full", "empty", "stalled s");
+    for (i = 0; i < sorted->len; i++) {
+        ElementStats *stats = g_ptr_array_index(sorted, i);
+        if (!stats->isQueue || stats->fillSamples == 0)
+            continue;
+        g_string_append_printf(report, "%-24s %7.0f%% %7.0f%% %7.0f%% %10.2f\n", stats->name,
+                               stats->fillTotal * 100 / stats->fillSamples,
+                               (gdouble)stats->fullSamples * 100 / stats->fillSamples,
+                               (gdouble)stats->emptySamples * 100 / stats->fillSamples,
+                               (gdouble)stats->stalled / GST_SECOND);
+    }
+
+    // Queues that are mostly full are waiting on what comes after them,
+    // so the busiest element is where the time's going
+    for (i = 0; i < sorted->len; i++) {
+        ElementStats *stats = g_ptr_array_index(sorted, i);
+        if (!stats->isQueue) {
+            g_string_append_printf(report, "\n%s was the busiest, %.0f%% of the time.\n", stats->name,
+                                   wall > 0 ? (gdouble)stats->busy * 100 / wall : 0);
+            break;
+        }
+    }
+    if (profile->droppedEvents > 0)
+        g_string_append_printf(report, "The trace only has the first %d buffers; %u more were only counted.\n",
+                               MAX_TRACE_EVENTS, profile->droppedEvents);
+
+    ret = g_file_set_contents(path, report->str, report->len, error);
+    g_string_free(report, TRUE);
+    g_ptr_array_free(sorted, TRUE);
+    return ret;
+}
+
+gboolean rippit_profile_write(RippitProfile *profile, const gchar *tracePath, const gchar *reportPath, GError **error)
+{
+    gboolean ret;
+
+    g_mutex_lock(profile->lock);
+    profile->end = gst_util_get_timestamp();
+    ret = writeTrace(profile, tracePath, error) && writeReport(profile, reportPath, error);
+    g_mutex_unlock(profile->lock);
+    return ret;
+}
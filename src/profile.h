@@ -0,0 +1,44 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <gst/gst.h>
+
+// --profile: where the time goes in a pipeline. Every sink pad's chain
+// function gets wrapped, so we know how long each element spent on each
+// buffer, not counting what it pushed on downstream. The time a thread
+// spends between buffers belongs to whatever's at the top of it: reading,
+// for a source, or waiting for data, for a queue. A queue taking a while to
+// accept a buffer means it was full and held everything upstream up, which
+// counts as a stall. Queue levels get sampled as well.
+//
+// It all ends up in a trace that chrome://tracing (or Perfetto) opens,
+// and a summary that's readable as it is.
+typedef struct _RippitProfile RippitProfile;
+
+RippitProfile *rippit_profile_new();
+// Only once the pipelines it watched are gone
+void rippit_profile_free(RippitProfile *profile);
+// Instruments everything in the bin, and whatever gets added to it later
+void rippit_profile_watch(RippitProfile *profile, GstBin *bin);
+gboolean rippit_profile_write(RippitProfile *profile, const gchar *tracePath, const gchar *reportPath, GError **error);
+
+#endif // PROFILE_H
@@ -0,0 +1,516 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+// Runs rippit's CD and DVD pipelines without a drive, so throughput can be
+// compared between builds. CDs come from a generated BIN/CUE image (or one
+// given with --cd) and get ripped by a RippitJob, just as rippit would,
+// DVDs from a generated program stream (or an ISO/VIDEO_TS given with
+// --dvd) through the same graph rippit builds. Results go out as JSON.
+
+#include "rippit.h"
+#include "librippit.h"
+#include "dvd.h"
+#include "flacwriter.h"
+#include "util.h"
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static gint trackCount = 8;
+static gint trackSeconds = 60;
+static gint dvdSeconds = 60;
+static gint dvdTitle = 1;
+static gchar *cdImage = 0;
+static gchar *dvdImage = 0;
+static gboolean remux = FALSE;
+static gboolean skipCD = FALSE;
+static gboolean skipDVD = FALSE;
+static gboolean skipFlac = FALSE;
+static gchar *outputFile = 0;
+static gchar *faultTrace = 0;
+static gboolean useSpool = FALSE;
+static gboolean continuous = FALSE;
+static gboolean parallelFlac = FALSE;
+static gboolean adaptive = FALSE;
+
+static GOptionEntry entries[] =
+{
+    { "tracks", 0, 0, G_OPTION_ARG_INT, &trackCount, "Tracks on the generated CD (default 8)", "count"},
+    { "track-seconds", 0, 0, G_OPTION_ARG_INT, &trackSeconds, "Length of each generated track (default 60)", "seconds"},
+    { "cd", 0, 0, G_OPTION_ARG_FILENAME, &cdImage, "Read this CD image instead of generating one", "cue"},
+    { "fault-trace", 0, 0, G_OPTION_ARG_FILENAME, &faultTrace, "Read the CD like a bad drive would, with the faults in this file", "file"},
+    { "spool", 0, 0, G_OPTION_ARG_NONE, &useSpool, "Rip the CD with --spool", NULL},
+    { "continuous", 0, 0, G_OPTION_ARG_NONE, &continuous, "Rip the CD with --continuous", NULL},
+    { "parallel-flac", 0, 0, G_OPTION_ARG_NONE, &parallelFlac, "Rip the CD with --parallel-flac", NULL},
+    { "adaptive", 0, 0, G_OPTION_ARG_NONE, &adaptive, "Rip the CD with --adaptive", NULL},
+    { "no-cd", 0, 0, G_OPTION_ARG_NONE, &skipCD, "Don't run the CD benchmark", NULL},
+    { "dvd", 0, 0, G_OPTION_ARG_FILENAME, &dvdImage, "Read this ISO or VIDEO_TS directory instead of generating a program stream", "path"},
+    { "title", 0, 0, G_OPTION_ARG_INT, &dvdTitle, "Title to rip with --dvd (default 1)", "title"},
+    { "dvd-seconds", 0, 0, G_OPTION_ARG_INT, &dvdSeconds, "Length of the generated program stream (default 60)", "seconds"},
+    { "remux", 0, 0, G_OPTION_ARG_NONE, &remux, "Benchmark --remux instead of encoding", NULL},
+    { "no-dvd", 0, 0, G_OPTION_ARG_NONE, &skipDVD, "Don't run the DVD benchmark", NULL},
+    { "no-flac", 0, 0, G_OPTION_ARG_NONE, &skipFlac, "Don't run the parallel FLAC benchmark", NULL},
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &outputFile, "Write the results here instead of stdout", "file"},
+    {NULL}
+};
+
+// Filled in from the streaming threads. The main thread only looks at it
+// once EOS has made it to the bus, which is after they're done.
+typedef struct {
+    GstClockTime firstByte;
+    guint64 bytes;
+} BenchStats;
+
+static gint64 processCpuTime()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * GST_SECOND +
+           (gint64)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * GST_USECOND;
+}
+
+// Linux keeps a high water mark of the RSS, which can be reset so each
+// benchmark gets its own. If the reset doesn't work, it's the peak since
+// we started.
+static void resetPeakRss()
+{
+    g_file_set_contents("/proc/self/clear_refs", "5", 1, NULL);
+}
+
+static gint64 peakRss()
+{
+    gchar *status = NULL;
+    gchar *line;
+    gint64 kb = -1;
+
+    if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL))
+        return -1;
+    line = strstr(status, "VmHWM:");
+    if (line)
+        sscanf(line, "VmHWM: %" G_GINT64_FORMAT, &kb);
+    g_free(status);
+    return kb;
+}
+
+static gdouble toMs(GstClockTime time)
+{
+    return (gdouble)time / GST_MSECOND;
+}
+
+static gboolean sourceBuffer_probe(GstPad *pad, GstBuffer *buffer, gpointer data)
+{
+    BenchStats *stats = data;
+    stats->bytes += GST_BUFFER_SIZE(buffer);
+    return TRUE;
+}
+
+static gboolean sinkBuffer_probe(GstPad *pad, GstBuffer *buffer, gpointer data)
+{
+    BenchStats *stats = data;
+    if (stats->firstByte == 0)
+        stats->firstByte = gst_util_get_timestamp();
+    return TRUE;
+}
+
+static void addProbe(GstElement *element, const gchar *padName, GCallback callback, BenchStats *stats)
+{
+    GstPad *pad = gst_element_get_static_pad(element, padName);
+    gst_pad_add_buffer_probe(pad, callback, stats);
+    gst_object_unref(pad);
+}
+
+// Plays pipe to the end. FALSE, with the error in the JSON, if it didn't
+// get there.
+static gboolean runToEnd(GstElement *pipe, GString *json)
+{
+    GstBus *bus = gst_element_get_bus(pipe);
+    GstMessage *msg;
+    gboolean success = TRUE;
+
+    gst_element_set_state(pipe, GST_STATE_PLAYING);
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        GError *error = NULL;
+        gst_message_parse_error(msg, &error, NULL);
+        g_string_append(json, "\"error\": ");
+        rippit_json_append_string(json, error->message);
+        g_string_append(json, ", ");
+        g_error_free(error);
+        success = FALSE;
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    return success;
+}
+
+// Noise over a sawtooth, so flacenc has about as much work to do as with
+// real music, and the same work every run
+static gchar *writeCDImage(const gchar *dir)
+{
+    gchar *bin = g_build_filename(dir, "bench.bin", NULL);
+    gchar *cue = g_build_filename(dir, "bench.cue", NULL);
+    GString *sheet = g_string_new("FILE \"bench.bin\" BINARY\n");
+    gint sectorsPerTrack = trackSeconds * 75;
+    gint16 sector[CD_FRAMESIZE_RAW / 2];
+    guint32 seed = 2352;
+    FILE *out = fopen(bin, "wb");
+    gint track, i, j;
+
+    for (track = 0; track < trackCount; track++) {
+        gint start = track * sectorsPerTrack;
+        g_string_append_printf(sheet, "  TRACK %02d AUDIO\n    INDEX 01 %02d:%02d:%02d\n",
+                               track + 1, start / 75 / 60, start / 75 % 60, start % 75);
+        for (i = 0; out && i < sectorsPerTrack; i++) {
+            for (j = 0; j < CD_FRAMESIZE_RAW / 2; j++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                sector[j] = GINT16_TO_LE((gint16)(((i * 588 + j / 2) * (track + 3) & 0x3fff) - 0x2000 + (seed & 0x3ff)));
+            }
+            fwrite(sector, sizeof(sector), 1, out);
+        }
+    }
+
+    if (!out || fclose(out) != 0 || !g_file_set_contents(cue, sheet->str, -1, NULL)) {
+        g_free(cue);
+        cue = NULL;
+    }
+    g_string_free(sheet, TRUE);
+    g_free(bin);
+    return cue;
+}
+
+static void jobDone_cb(RippitJob *job, gboolean success, gpointer data)
+{
+    g_main_loop_quit(data);
+}
+
+// A whole RippitJob on the image, the same one rippit would run on a drive,
+// with the spool, journal and track changes and all. It writes its tracks
+// and journal into dir, which is where rippit would put them.
+static void benchCD(const gchar *cue, const gchar *dir, GString *json)
+{
+    RippitJobOptions options;
+    RippitJobCallbacks callbacks = {0};
+    RippitJobStats stats;
+    RippitJob *job;
+    GMainLoop *loop;
+    GError *error = NULL;
+    gchar *cwd = g_get_current_dir();
+    // Relative to where we started, not to dir
+    gchar *device = g_path_is_absolute(cue) ? g_strdup(cue) : g_build_filename(cwd, cue, NULL);
+    GstClockTime start, elapsed;
+    gint64 cpuStart;
+    gboolean success = FALSE;
+
+    rippit_job_options_init(&options);
+    // Nothing to look up, and nothing to wait on the network for
+    options.forceRip = TRUE;
+    options.faultTrace = faultTrace;
+    options.spool = useSpool;
+    options.continuous = continuous;
+    options.parallelFlac = parallelFlac;
+    options.adaptive = adaptive;
+
+    g_string_append(json, "\"cd\": {");
+    job = rippit_job_new(device, &options, &error);
+    if (!job || g_chdir(dir) < 0) {
+        g_string_append(json, "\"skipped\": ");
+        rippit_json_append_string(json, error ? error->message : "could not get into the temporary directory");
+        g_string_append(json, "}");
+        if (error)
+            g_error_free(error);
+        if (job)
+            rippit_job_free(job);
+        g_free(device);
+        g_free(cwd);
+        return;
+    }
+    g_string_append(json, "\"source\": ");
+    rippit_json_append_string(json, cdImage ? cdImage : "synthetic");
+    g_string_append_printf(json, ", \"spool\": %s, \"continuous\": %s, \"parallel_flac\": %s, \"adaptive\": %s, ",
+                           useSpool ? "true" : "false", continuous ? "true" : "false",
+                           parallelFlac ? "true" : "false", adaptive ? "true" : "false");
+
+    loop = g_main_loop_new(NULL, FALSE);
+    callbacks.done = jobDone_cb;
+    rippit_job_set_callbacks(job, &callbacks, loop);
+
+    resetPeakRss();
+    cpuStart = processCpuTime();
+    start = gst_util_get_timestamp();
+    if (rippit_job_start(job, &error)) {
+        g_main_loop_run(loop);
+        success = TRUE;
+    } else {
+        g_string_append(json, "\"error\": ");
+        rippit_json_append_string(json, error->message);
+        g_string_append(json, ", ");
+        g_error_free(error);
+    }
+    elapsed = gst_util_get_timestamp() - start;
+    rippit_job_get_stats(job, &stats);
+
+    g_string_append_printf(json, "\"success\": %s, ", success ? "true" : "false");
+    g_string_append_printf(json, "\"tracks\": %d, ", stats.trackCount);
+    g_string_append_printf(json, "\"sectors\": %" G_GUINT64_FORMAT ", ", stats.bytesRead / CD_FRAMESIZE_RAW);
+    g_string_append_printf(json, "\"seconds\": %.3f, ", (gdouble)elapsed / GST_SECOND);
+    g_string_append_printf(json, "\"sectors_per_sec\": %.1f, ", stats.bytesRead / CD_FRAMESIZE_RAW / ((gdouble)elapsed / GST_SECOND));
+    // The encoders run on threads of their own, so it's the whole process's
+    g_string_append_printf(json, "\"encoder_cpu_s\": %.3f, ", (gdouble)(processCpuTime() - cpuStart) / GST_SECOND);
+    g_string_append_printf(json, "\"transition_latency_ms\": {\"mean\": %.3f, \"max\": %u}, ",
+                           stats.transitions ? (gdouble)stats.transitionMs / stats.transitions : 0, stats.transitionMaxMs);
+    g_string_append_printf(json, "\"first_sector_ms\": %u, ", stats.firstSectorMs);
+    g_string_append_printf(json, "\"retries\": %u, \"error_sectors\": %u, ", stats.retries, stats.errorSectors);
+    g_string_append_printf(json, "\"peak_rss_kb\": %" G_GINT64_FORMAT "}", peakRss());
+
+    rippit_job_free(job);
+    g_main_loop_unref(loop);
+    if (g_chdir(cwd) < 0)
+        g_warning("Could not get back to %s", cwd);
+    g_free(device);
+    g_free(cwd);
+}
+
+// Seconds to write the whole of data through a RippitFlacWriter, or -1
+static gdouble writeFlac(const gchar *location, const gchar *data, gsize length, gint threads)
+{
+    RippitFlacWriter *writer = rippit_flac_writer_new(location, NULL, threads, NULL);
+    GstClockTime start = gst_util_get_timestamp();
+    gboolean ok = writer != NULL;
+    gsize offset;
+
+    // A sector at a time, the way the spool hands it over
+    for (offset = 0; ok && offset < length; offset += CD_FRAMESIZE_RAW)
+        ok = rippit_flac_writer_write(writer, (const guint8*)data + offset, MIN(CD_FRAMESIZE_RAW, length - offset));
+    ok = ok && rippit_flac_writer_finish(writer, NULL);
+    if (writer)
+        rippit_flac_writer_free(writer);
+    g_unlink(location);
+    return ok ? (gdouble)(gst_util_get_timestamp() - start) / GST_SECOND : -1;
+}
+
+// The generated disc as one long track through --parallel-flac's encoder,
+// on one core and then on all of them, to see how well it scales
+static void benchFlac(const gchar *dir, GString *json)
+{
+    gchar *bin = g_build_filename(dir, "bench.bin", NULL);
+    gchar *location = g_build_filename(dir, "bench.flac", NULL);
+    gint cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    gdouble single, parallel;
+    gchar *data;
+    gsize length;
+
+    g_string_append(json, "\"flac\": {");
+    if (!g_file_get_contents(bin, &data, &length, NULL)) {
+        g_string_append(json, "\"skipped\": \"could not read the CD image\"}");
+        g_free(bin);
+        g_free(location);
+        return;
+    }
+
+    resetPeakRss();
+    single = writeFlac(location, data, length, 1);
+    parallel = writeFlac(location, data, length, cpus);
+    if (single > 0 && parallel > 0) {
+        g_string_append_printf(json, "\"mb\": %.1f, ", (gdouble)length / (1024 * 1024));
+        g_string_append_printf(json, "\"threads\": %d, ", cpus);
+        g_string_append_printf(json, "\"single_mb_per_sec\": %.1f, ", length / single / (1024 * 1024));
+        g_string_append_printf(json, "\"parallel_mb_per_sec\": %.1f, ", length / parallel / (1024 * 1024));
+        g_string_append_printf(json, "\"speedup\": %.2f, ", single / parallel);
+        g_string_append_printf(json, "\"peak_rss_kb\": %" G_GINT64_FORMAT "}", peakRss());
+    } else {
+        g_string_append(json, "\"skipped\": \"could not write the FLAC\"}");
+    }
+    g_free(data);
+    g_free(bin);
+    g_free(location);
+}
+
+// MPEG-2 and MP2 in a program stream, which dvddemux takes just like a VOB
+static gchar *writeProgramStream(const gchar *dir)
+{
+    gchar *location = g_build_filename(dir, "bench.mpg", NULL);
+    gchar *description = g_strdup_printf(
+        "videotestsrc pattern=snow num-buffers=%d ! video/x-raw-yuv,width=720,height=480,framerate=30000/1001 ! "
+        "ffenc_mpeg2video bitrate=6000000 ! mpegpsmux name=mux ! filesink location=\"%s\" "
+        "audiotestsrc num-buffers=%d samplesperbuffer=1152 ! audio/x-raw-int,rate=48000,channels=2 ! ffenc_mp2 ! mux.",
+        dvdSeconds * 30, location, dvdSeconds * 48000 / 1152);
+    GstElement *pipe = gst_parse_launch(description, NULL);
+    GString *ignored = g_string_new(NULL);
+
+    if (!pipe || !runToEnd(pipe, ignored)) {
+        g_free(location);
+        location = NULL;
+    }
+    if (pipe) {
+        gst_element_set_state(pipe, GST_STATE_NULL);
+        gst_object_unref(pipe);
+    }
+    g_string_free(ignored, TRUE);
+    g_free(description);
+    return location;
+}
+
+// x264 and friends run on threads of their own, so the encoder's CPU time
+// is the whole process's. Reading a file costs next to nothing next to it.
+static void benchDVD(const gchar *stream, GString *json)
+{
+    BenchStats stats = {0};
+    GstElement *pipe = gst_pipeline_new(NULL);
+    GstElement *source;
+    GstElement *output;
+    GstClockTime start, elapsed;
+    gint64 cpuStart;
+
+    g_string_append(json, "\"dvd\": {");
+    if (dvdImage) {
+        source = gst_element_factory_make("dvdreadsrc", NULL);
+        if (source)
+            g_object_set(G_OBJECT(source), "device", dvdImage, "title", dvdTitle, NULL);
+    } else {
+        source = gst_element_factory_make("filesrc", NULL);
+        g_object_set(G_OBJECT(source), "location", stream, NULL);
+    }
+    if (source)
+        gst_bin_add(GST_BIN(pipe), source);
+    output = source ? (remux ? rippit_dvd_remux_add : rippit_dvd_encoder_add)(pipe, source) : NULL;
+    if (!output) {
+        g_string_append(json, "\"skipped\": \"missing DVD elements\"}");
+        gst_object_unref(pipe);
+        return;
+    }
+    g_string_append(json, "\"source\": ");
+    rippit_json_append_string(json, dvdImage ? dvdImage : "synthetic");
+    g_string_append_printf(json, ", \"mode\": \"%s\", ", remux ? "remux" : "encode");
+
+    addProbe(source, "src", G_CALLBACK(sourceBuffer_probe), &stats);
+    addProbe(output, "sink", G_CALLBACK(sinkBuffer_probe), &stats);
+
+    resetPeakRss();
+    cpuStart = processCpuTime();
+    start = gst_util_get_timestamp();
+    runToEnd(pipe, json);
+    elapsed = gst_util_get_timestamp() - start;
+    gst_element_set_state(pipe, GST_STATE_NULL);
+
+    g_string_append_printf(json, "\"sectors\": %" G_GUINT64_FORMAT ", ", stats.bytes / 2048);
+    g_string_append_printf(json, "\"seconds\": %.3f, ", (gdouble)elapsed / GST_SECOND);
+    g_string_append_printf(json, "\"sectors_per_sec\": %.1f, ", stats.bytes / 2048 / ((gdouble)elapsed / GST_SECOND));
+    g_string_append_printf(json, "\"encoder_cpu_s\": %.3f, ", (gdouble)(processCpuTime() - cpuStart) / GST_SECOND);
+    g_string_append_printf(json, "\"time_to_first_byte_ms\": %.3f, ", stats.firstByte ? toMs(stats.firstByte - start) : -1);
+    g_string_append_printf(json, "\"peak_rss_kb\": %" G_GINT64_FORMAT "}", peakRss());
+
+    gst_object_unref(pipe);
+}
+
+static void removeDir(const gchar *dir)
+{
+    GDir *contents = g_dir_open(dir, 0, NULL);
+    const gchar *name;
+
+    while (contents && (name = g_dir_read_name(contents))) {
+        gchar *path = g_build_filename(dir, name, NULL);
+        g_unlink(path);
+        g_free(path);
+    }
+    if (contents)
+        g_dir_close(contents);
+    g_rmdir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    GError *error = NULL;
+    GOptionContext *context;
+    GString *json = g_string_new("{");
+    gchar *dir;
+
+    g_thread_init(NULL);
+
+    context = g_option_context_new("- benchmark rippit without a drive");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_print("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(context);
+    rippit_init();
+
+    dir = g_build_filename(g_get_tmp_dir(), "rippit-bench-XXXXXX", NULL);
+    if (!g_mkdtemp(dir)) {
+        g_print("Could not make a temporary directory\n");
+        return 1;
+    }
+
+    g_string_append(json, "\"rippit_version\": \"" RIPPIT_VERSION_STRING "\", ");
+    g_string_append_printf(json, "\"timestamp\": %ld, ", (long)time(NULL));
+    g_string_append_printf(json, "\"cpus\": %ld", sysconf(_SC_NPROCESSORS_ONLN));
+
+    if (!skipCD) {
+        gchar *cue = cdImage ? g_strdup(cdImage) : writeCDImage(dir);
+        g_string_append(json, ", ");
+        if (cue)
+            benchCD(cue, dir, json);
+        else
+            g_string_append(json, "\"cd\": {\"skipped\": \"could not write the CD image\"}");
+        g_free(cue);
+    }
+
+    if (!skipFlac) {
+        gchar *bin = g_build_filename(dir, "bench.bin", NULL);
+        g_string_append(json, ", ");
+        // It's only worth anything on the same audio every run
+        if (!g_file_test(bin, G_FILE_TEST_EXISTS))
+            g_free(writeCDImage(dir));
+        benchFlac(dir, json);
+        g_free(bin);
+    }
+
+    if (!skipDVD) {
+        gchar *stream = dvdImage ? NULL : writeProgramStream(dir);
+        g_string_append(json, ", ");
+        if (stream || dvdImage)
+            benchDVD(stream, json);
+        else
+            g_string_append(json, "\"dvd\": {\"skipped\": \"could not make a program stream\"}");
+        g_free(stream);
+    }
+    g_string_append(json, "}\n");
+
+    removeDir(dir);
+    g_free(dir);
+
+    if (outputFile) {
+        if (!g_file_set_contents(outputFile, json->str, -1, &error)) {
+            g_print("%s\n", error->message);
+            return 1;
+        }
+    } else {
+        fputs(json->str, stdout);
+    }
+    g_string_free(json, TRUE);
+    return 0;
+}
@@ -21,10 +21,13 @@
 #include <gst/gstinfo.h>
 #include "rippitversion.h"
 
-GST_DEBUG_CATEGORY_STATIC(rippit);
+GST_DEBUG_CATEGORY_EXTERN(rippit);
 #define GST_CAT_DEFAULT rippit
 
 #define RIPPIT_ERROR rippit_error_quark ()
 #define RIPPIT_ERROR_PARAMS 1
 
+// Bytes of audio in one CD sector
+#define CD_FRAMESIZE_RAW 2352
+
 GQuark rippit_error_quark();
@@ -0,0 +1,179 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "speedcontrol.h"
+#include "util.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/cdrom.h>
+
+// The speeds drives actually have, slowest first; 0 is flat out
+static const gint speeds[] = {1, 2, 4, 8, 12, 16, 24, 32, 40, 48, 0};
+#define SPEED_COUNT G_N_ELEMENTS(speeds)
+
+// Retries in a second before it's worth slowing down
+#define RETRY_LIMIT 4
+// Clean seconds before trying a step faster
+#define CLEAN_SECONDS 10
+// Seconds at the faster speed before deciding whether it was worth it
+#define PROBE_SECONDS 3
+// How much faster it has to be to count
+#define PROBE_GAIN 1.05
+
+struct _RippitSpeedControl {
+    int fd;
+    gchar *device;
+    gint level;
+    // The fastest level that's been worth it
+    gint ceiling;
+    volatile gint errors;
+    volatile gint retries;
+    guint64 lastBytes;
+    guint clean;
+    // Sectors a second at each level, smoothed out
+    gdouble rates[SPEED_COUNT];
+    // Stepped up from here, and waiting to see whether it helped
+    gint probeFrom;
+};
+
+static gboolean setSpeed(RippitSpeedControl *control, gint level)
+{
+    if (ioctl(control->fd, CDROM_SELECT_SPEED, speeds[level]) != 0) {
+        GST_WARNING("Could not set %s to %dx: %s", control->device, speeds[level], g_strerror(errno));
+        return FALSE;
+    }
+    control->level = level;
+    control->clean = 0;
+    return TRUE;
+}
+
+static gint takeCount(volatile gint *count)
+{
+    gint value = g_atomic_int_get(count);
+    g_atomic_int_add(count, -value);
+    return value;
+}
+
+RippitSpeedControl *rippit_speed_control_new(const gchar *device, GError **error)
+{
+    RippitSpeedControl *control;
+    int fd = rippit_open_drive(device, error);
+
+    if (fd < 0)
+        return NULL;
+    control = g_new0(RippitSpeedControl, 1);
+    control->fd = fd;
+    control->device = g_strdup(device);
+    control->ceiling = SPEED_COUNT - 1;
+    control->probeFrom = -1;
+    // Some drives start out slower than they can go
+    if (!setSpeed(control, SPEED_COUNT - 1)) {
+        g_set_error(error, RIPPIT_ERROR, 0, "%s doesn't let its speed be set", device);
+        rippit_speed_control_free(control);
+        return NULL;
+    }
+    return control;
+}
+
+void rippit_speed_control_free(RippitSpeedControl *control)
+{
+    close(control->fd);
+    g_free(control->device);
+    g_free(control);
+}
+
+void rippit_speed_control_error(RippitSpeedControl *control)
+{
+    g_atomic_int_inc(&control->errors);
+}
+
+void rippit_speed_control_retry(RippitSpeedControl *control)
+{
+    g_atomic_int_inc(&control->retries);
+}
+
+gint rippit_speed_control_get_speed(RippitSpeedControl *control)
+{
+    return speeds[control->level];
+}
+
+gboolean rippit_speed_control_update(RippitSpeedControl *control, guint64 bytesRead, gchar **reason)
+{
+    gint errors = takeCount(&control->errors);
+    gint retries = takeCount(&control->retries);
+    gdouble rate = (gdouble)(bytesRead - control->lastBytes) / CD_FRAMESIZE_RAW;
+    gint level = control->level;
+
+    control->lastBytes = bytesRead;
+
+    if (errors > 0 && level > 0) {
+        // Something got lost; back right off
+        control->probeFrom = -1;
+        if (setSpeed(control, MAX(0, level - 2))) {
+            *reason = g_strdup_printf("%d sectors couldn't be read", errors);
+            return TRUE;
+        }
+        return FALSE;
+    }
+    if (retries >= RETRY_LIMIT && level > 0) {
+        control->probeFrom = -1;
+        if (setSpeed(control, level - 1)) {
+            *reason = g_strdup_printf("%d retries in a second", retries);
+            return TRUE;
+        }
+        return FALSE;
+    }
+    // Nothing read means the drive's spinning up or between tracks; no
+    // telling how fast it is
+    if (rate <= 0 || errors > 0 || retries > 0) {
+        control->clean = 0;
+        return FALSE;
+    }
+
+    control->clean++;
+    control->rates[level] = control->rates[level] > 0 ? (control->rates[level] * 3 + rate) / 4 : rate;
+
+    if (control->probeFrom >= 0 && control->clean >= PROBE_SECONDS) {
+        gint from = control->probeFrom;
+        control->probeFrom = -1;
+        if (control->rates[level] < control->rates[from] * PROBE_GAIN) {
+            // The drive, or the disc, can't go any faster than that anyway
+            control->ceiling = from;
+            if (setSpeed(control, from)) {
+                *reason = g_strdup_printf("%.0f sectors a second either way", control->rates[from]);
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+
+    if (control->clean >= CLEAN_SECONDS && level < control->ceiling) {
+        if (setSpeed(control, level + 1)) {
+            control->probeFrom = level;
+            *reason = g_strdup_printf("clean for %d seconds", CLEAN_SECONDS);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
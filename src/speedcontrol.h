@@ -0,0 +1,48 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef SPEEDCONTROL_H
+#define SPEEDCONTROL_H
+
+#include <glib.h>
+
+// --auto-speed: keeps the drive as fast as it'll go without errors. It
+// starts at full speed, backs off as soon as reads start going wrong, and
+// works its way back up once they've been clean for a while. If going up a
+// step doesn't actually read any faster, it goes back down and stays there.
+//
+// The speed gets set on the drive straight away, on a descriptor of our
+// own, rather than waiting for cdparanoiasrc to open it again.
+typedef struct _RippitSpeedControl RippitSpeedControl;
+
+RippitSpeedControl *rippit_speed_control_new(const gchar *device, GError **error);
+void rippit_speed_control_free(RippitSpeedControl *control);
+
+// Both of these are fine from any thread. An error is a sector that
+// couldn't be read, a retry one that could after another go.
+void rippit_speed_control_error(RippitSpeedControl *control);
+void rippit_speed_control_retry(RippitSpeedControl *control);
+
+// Every second or so, with everything read so far. TRUE if that changed
+// the speed, with the reason why, which is the caller's to free.
+gboolean rippit_speed_control_update(RippitSpeedControl *control, guint64 bytesRead, gchar **reason);
+// In multiples of 150KB/s, or 0 for as fast as it goes
+gint rippit_speed_control_get_speed(RippitSpeedControl *control);
+
+#endif // SPEEDCONTROL_H
@@ -0,0 +1,396 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "spool.h"
+#include "flacwriter.h"
+
+#include <gst/app/gstappsrc.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <string.h>
+
+struct _RippitSpool {
+    GMutex *lock;
+    GCond *cond;
+    guint64 bytes;
+    // Of bytes, what's in held tracks, which no encoder can take yet
+    guint64 heldBytes;
+    guint64 budget;
+    guint64 encoded;
+    guint pending;
+    GThreadPool *encoders;
+    RippitSpoolDoneFunc done;
+    gpointer doneData;
+    RippitProfile *profile;
+    gboolean parallelFlac;
+    guint64 writeBuffer;
+    RippitWriteStats *writeStats;
+};
+
+struct _RippitSpoolTrack {
+    RippitSpool *spool;
+    // The buffers from the source are kept as-is, so spooling never copies
+    GQueue buffers;
+    guint64 bytes;
+    gboolean closed;
+    gboolean held;
+    // Handed to the encoders, which only happens once it isn't held
+    gboolean queued;
+    gboolean abandoned;
+    gboolean success;
+    gchar *location;
+    GstTagList *tags;
+};
+
+static gboolean trackDone_cb(gpointer data)
+{
+    RippitSpoolTrack *track = data;
+    RippitSpool *spool = track->spool;
+
+    g_mutex_lock(spool->lock);
+    spool->pending--;
+    g_mutex_unlock(spool->lock);
+
+    if (spool->done)
+        spool->done(spool, track->location, track->success, spool->doneData);
+
+    g_free(track->location);
+    if (track->tags)
+        gst_tag_list_free(track->tags);
+    g_free(track);
+    return FALSE;
+}
+
+// Blocks until the track has data or has been closed; NULL means the end.
+static GstBuffer *popBuffer(RippitSpoolTrack *track)
+{
+    RippitSpool *spool = track->spool;
+    GstBuffer *buffer;
+
+    g_mutex_lock(spool->lock);
+    while (track->held || (g_queue_is_empty(&track->buffers) && !track->closed))
+        g_cond_wait(spool->cond, spool->lock);
+    buffer = g_queue_pop_head(&track->buffers);
+    if (buffer) {
+        spool->bytes -= GST_BUFFER_SIZE(buffer);
+        track->bytes -= GST_BUFFER_SIZE(buffer);
+        spool->encoded += GST_BUFFER_SIZE(buffer);
+        g_cond_broadcast(spool->cond);
+    }
+    g_mutex_unlock(spool->lock);
+    return buffer;
+}
+
+// Straight from the spool into a FLAC file, with the track spread over
+// every core rather than run through flacenc on one
+static void writeTrack(RippitSpoolTrack *track)
+{
+    GError *error = NULL;
+    RippitFlacWriter *writer = rippit_flac_writer_new(track->location, track->tags, 0, &error);
+    gboolean ok = writer != NULL;
+    GstBuffer *buffer;
+
+    GST_DEBUG("Encoding %s in parallel", track->location);
+    while ((buffer = popBuffer(track))) {
+        ok = ok && rippit_flac_writer_write(writer, GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer));
+        gst_buffer_unref(buffer);
+    }
+    if (ok && !rippit_flac_writer_finish(writer, &error))
+        ok = FALSE;
+    if (error) {
+        GST_WARNING("%s", error->message);
+        g_error_free(error);
+    }
+    if (writer)
+        rippit_flac_writer_free(writer);
+    track->success = ok;
+}
+
+// Only half of it made it, so nobody should think it's the track
+static void dropAbandoned(RippitSpoolTrack *track)
+{
+    if (!track->abandoned)
+        return;
+    GST_DEBUG("Abandoned %s", track->location);
+    g_unlink(track->location);
+    track->success = FALSE;
+}
+
+static void encodeTrack(gpointer data, gpointer user_data)
+{
+    RippitSpoolTrack *track = data;
+    GstElement *pipe;
+    GstElement *source;
+    GstElement *encoder;
+    GstElement *tagger;
+    GstElement *output;
+    GstCaps *caps;
+    GstBus *bus;
+    GstMessage *msg;
+    GstBuffer *buffer;
+
+    if (track->spool->parallelFlac) {
+        writeTrack(track);
+        dropAbandoned(track);
+        g_idle_add(trackDone_cb, track);
+        return;
+    }
+
+    GST_DEBUG("Encoding %s", track->location);
+    pipe = gst_pipeline_new(NULL);
+    source = gst_element_factory_make("appsrc", NULL);
+    encoder = gst_element_factory_make("flacenc", NULL);
+    tagger = gst_element_factory_make("flactag", NULL);
+    output = rippit_write_sink_make(track->spool->writeBuffer, track->spool->writeStats);
+    caps = gst_caps_from_string(RIPPIT_SPOOL_CAPS);
+
+    // Block in push_buffer rather than letting appsrc queue up the whole track
+    g_object_set(G_OBJECT(source), "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE, NULL);
+    gst_caps_unref(caps);
+    g_object_set(G_OBJECT(output), "location", track->location, NULL);
+    if (track->tags)
+        gst_tag_setter_merge_tags(GST_TAG_SETTER(tagger), track->tags, GST_TAG_MERGE_REPLACE_ALL);
+
+    gst_bin_add_many(GST_BIN(pipe), source, encoder, tagger, output, NULL);
+    gst_element_link_many(source, encoder, tagger, output, NULL);
+    if (track->spool->profile)
+        rippit_profile_watch(track->spool->profile, GST_BIN(pipe));
+    gst_element_set_state(pipe, GST_STATE_PLAYING);
+
+    while ((buffer = popBuffer(track))) {
+        if (gst_app_src_push_buffer(GST_APP_SRC(source), buffer) != GST_FLOW_OK)
+            break;
+    }
+    // Drain anything left over if the encoder bailed out early
+    while ((buffer = popBuffer(track)))
+        gst_buffer_unref(buffer);
+    gst_app_src_end_of_stream(GST_APP_SRC(source));
+
+    bus = gst_pipeline_get_bus(GST_PIPELINE(pipe));
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    track->success = (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipe, GST_STATE_NULL);
+    gst_object_unref(pipe);
+
+    dropAbandoned(track);
+    g_idle_add(trackDone_cb, track);
+}
+
+RippitSpool *rippit_spool_new(guint64 budget, gint workers, RippitSpoolDoneFunc done, gpointer data)
+{
+    RippitSpool *spool = g_new0(RippitSpool, 1);
+
+    if (workers < 1)
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+
+    spool->lock = g_mutex_new();
+    spool->cond = g_cond_new();
+    spool->budget = budget;
+    spool->done = done;
+    spool->doneData = data;
+    spool->encoders = g_thread_pool_new(encodeTrack, spool, workers, FALSE, NULL);
+    GST_DEBUG("Spooling up to %" G_GUINT64_FORMAT " bytes for %d encoders", budget, workers);
+    return spool;
+}
+
+void rippit_spool_free(RippitSpool *spool)
+{
+    g_thread_pool_free(spool->encoders, FALSE, TRUE);
+    g_mutex_free(spool->lock);
+    g_cond_free(spool->cond);
+    g_free(spool);
+}
+
+guint rippit_spool_pending(RippitSpool *spool)
+{
+    guint pending;
+    g_mutex_lock(spool->lock);
+    pending = spool->pending;
+    g_mutex_unlock(spool->lock);
+    return pending;
+}
+
+guint64 rippit_spool_encoded(RippitSpool *spool)
+{
+    guint64 encoded;
+    g_mutex_lock(spool->lock);
+    encoded = spool->encoded;
+    g_mutex_unlock(spool->lock);
+    return encoded;
+}
+
+void rippit_spool_set_profile(RippitSpool *spool, RippitProfile *profile)
+{
+    spool->profile = profile;
+}
+
+void rippit_spool_set_parallel_flac(RippitSpool *spool, gboolean parallel)
+{
+    spool->parallelFlac = parallel;
+}
+
+void rippit_spool_set_write_buffer(RippitSpool *spool, guint64 maxBytes, RippitWriteStats *stats)
+{
+    spool->writeBuffer = maxBytes;
+    spool->writeStats = stats;
+}
+
+// With the spool locked. A held track would only sit on an encoder thread
+// that other tracks could be using, so it waits until it's released.
+static void startEncoding(RippitSpoolTrack *track)
+{
+    if (track->queued || track->held)
+        return;
+    track->queued = TRUE;
+    g_thread_pool_push(track->spool->encoders, track, NULL);
+}
+
+RippitSpoolTrack *rippit_spool_add_track(RippitSpool *spool, const gchar *location, GstTagList *tags)
+{
+    RippitSpoolTrack *track = g_new0(RippitSpoolTrack, 1);
+    track->spool = spool;
+    track->location = g_strdup(location);
+    track->tags = tags;
+    g_queue_init(&track->buffers);
+
+    g_mutex_lock(spool->lock);
+    spool->pending++;
+    g_mutex_unlock(spool->lock);
+    return track;
+}
+
+void rippit_spool_track_push(RippitSpoolTrack *track, GstBuffer *buffer)
+{
+    RippitSpool *spool = track->spool;
+
+    g_mutex_lock(spool->lock);
+    // Held audio counts too, but only wait while there's something the
+    // encoders can take off our hands, or a full spool of held tracks
+    // would hang us. The same goes for one oversized buffer.
+    while (spool->bytes > spool->heldBytes && spool->bytes + GST_BUFFER_SIZE(buffer) > spool->budget)
+        g_cond_wait(spool->cond, spool->lock);
+    spool->bytes += GST_BUFFER_SIZE(buffer);
+    track->bytes += GST_BUFFER_SIZE(buffer);
+    if (track->held)
+        spool->heldBytes += GST_BUFFER_SIZE(buffer);
+    g_queue_push_tail(&track->buffers, buffer);
+    startEncoding(track);
+    g_cond_broadcast(spool->cond);
+    g_mutex_unlock(spool->lock);
+}
+
+void rippit_spool_track_close(RippitSpoolTrack *track)
+{
+    RippitSpool *spool = track->spool;
+
+    g_mutex_lock(spool->lock);
+    track->closed = TRUE;
+    startEncoding(track);
+    g_cond_broadcast(spool->cond);
+    g_mutex_unlock(spool->lock);
+}
+
+void rippit_spool_track_abandon(RippitSpoolTrack *track)
+{
+    RippitSpool *spool = track->spool;
+    GstBuffer *buffer;
+
+    g_mutex_lock(spool->lock);
+    while ((buffer = g_queue_pop_head(&track->buffers))) {
+        spool->bytes -= GST_BUFFER_SIZE(buffer);
+        gst_buffer_unref(buffer);
+    }
+    if (track->held)
+        spool->heldBytes -= track->bytes;
+    track->bytes = 0;
+    track->abandoned = TRUE;
+    track->closed = TRUE;
+    track->held = FALSE;
+    // It still has to go past an encoder to be reported
+    startEncoding(track);
+    g_cond_broadcast(spool->cond);
+    g_mutex_unlock(spool->lock);
+}
+
+void rippit_spool_track_hold(RippitSpoolTrack *track)
+{
+    g_mutex_lock(track->spool->lock);
+    if (!track->held)
+        track->spool->heldBytes += track->bytes;
+    track->held = TRUE;
+    g_mutex_unlock(track->spool->lock);
+}
+
+void rippit_spool_track_release(RippitSpoolTrack *track)
+{
+    RippitSpool *spool = track->spool;
+
+    g_mutex_lock(spool->lock);
+    if (track->held)
+        spool->heldBytes -= track->bytes;
+    track->held = FALSE;
+    startEncoding(track);
+    g_cond_broadcast(spool->cond);
+    g_mutex_unlock(spool->lock);
+}
+
+void rippit_spool_track_splice(RippitSpoolTrack *track, guint64 offset, GstBuffer *buffer)
+{
+    RippitSpool *spool = track->spool;
+    guint64 start = 0;
+    GList *cur;
+
+    g_mutex_lock(spool->lock);
+    for (cur = track->buffers.head; cur; cur = cur->next) {
+        GstBuffer *spooled = cur->data;
+        guint64 end = start + GST_BUFFER_SIZE(spooled);
+        guint64 from = MAX(start, offset);
+        guint64 to = MIN(end, offset + GST_BUFFER_SIZE(buffer));
+
+        if (from < to) {
+            // Always a copy: buffers from rippitimagesrc point straight into
+            // a read-only mapping, and gst_buffer_make_writable() only goes
+            // by the refcount
+            GstBuffer *copy = gst_buffer_copy(spooled);
+            gst_buffer_unref(spooled);
+            spooled = copy;
+            cur->data = spooled;
+            memcpy(GST_BUFFER_DATA(spooled) + (from - start), GST_BUFFER_DATA(buffer) + (from - offset), to - from);
+        }
+        if (end >= offset + GST_BUFFER_SIZE(buffer))
+            break;
+        start = end;
+    }
+    g_mutex_unlock(spool->lock);
+    gst_buffer_unref(buffer);
+}
+
+void rippit_spool_track_foreach(RippitSpoolTrack *track, GFunc func, gpointer data)
+{
+    g_mutex_lock(track->spool->lock);
+    g_queue_foreach(&track->buffers, func, data);
+    g_mutex_unlock(track->spool->lock);
+}
@@ -0,0 +1,76 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <gst/gst.h>
+#include "profile.h"
+#include "writesink.h"
+
+// The spool sits between the drive and the encoders. Drives push raw CDDA
+// into it as fast as they can read, and a pool of worker threads (one per
+// core) pulls each track back out and runs it through its own encoder
+// pipeline. The spool holds at most `budget` bytes; only once it is full
+// does a drive have to wait on an encoder.
+
+#define RIPPIT_SPOOL_CAPS "audio/x-raw-int, endianness=(int)1234, signed=(boolean)true, width=(int)16, depth=(int)16, rate=(int)44100, channels=(int)2"
+
+typedef struct _RippitSpool RippitSpool;
+typedef struct _RippitSpoolTrack RippitSpoolTrack;
+
+// Called from the main loop whenever a track has been completely encoded
+typedef void (*RippitSpoolDoneFunc)(RippitSpool *spool, const gchar *location, gboolean success, gpointer data);
+
+RippitSpool *rippit_spool_new(guint64 budget, gint workers, RippitSpoolDoneFunc done, gpointer data);
+void rippit_spool_free(RippitSpool *spool);
+guint rippit_spool_pending(RippitSpool *spool);
+// Bytes of audio handed to the encoders so far
+guint64 rippit_spool_encoded(RippitSpool *spool);
+// Encoders started from now on get profiled too
+void rippit_spool_set_profile(RippitSpool *spool, RippitProfile *profile);
+// Tracks added from now on get written by a RippitFlacWriter, each one
+// spread over every core, instead of going through flacenc. There's no
+// pipeline for the profile to watch then.
+void rippit_spool_set_parallel_flac(RippitSpool *spool, gboolean parallel);
+// Tracks added from now on get written through a rippitwritesink holding
+// up to maxBytes, counted in stats, unless maxBytes is 0. RippitFlacWriter
+// always writes under a temporary name.
+void rippit_spool_set_write_buffer(RippitSpool *spool, guint64 maxBytes, RippitWriteStats *stats);
+
+// Takes ownership of tags, which may be NULL
+RippitSpoolTrack *rippit_spool_add_track(RippitSpool *spool, const gchar *location, GstTagList *tags);
+void rippit_spool_track_push(RippitSpoolTrack *track, GstBuffer *buffer);
+void rippit_spool_track_close(RippitSpoolTrack *track);
+// Gives up on the track: whatever hasn't been encoded yet is thrown away,
+// anything already written of it is deleted, and it's reported as failed
+void rippit_spool_track_abandon(RippitSpoolTrack *track);
+
+// A held track is kept away from the encoders until it's released, so parts
+// of it can still be replaced, and doesn't tie up an encoder thread while
+// it waits. Its audio counts against the budget, but only makes the drive
+// wait while there's other audio the encoders can get on with.
+void rippit_spool_track_hold(RippitSpoolTrack *track);
+void rippit_spool_track_release(RippitSpoolTrack *track);
+// Overwrites the audio at the given byte offset into the track. Takes
+// ownership of buffer.
+void rippit_spool_track_splice(RippitSpoolTrack *track, guint64 offset, GstBuffer *buffer);
+void rippit_spool_track_foreach(RippitSpoolTrack *track, GFunc func, gpointer data);
+
+#endif // SPOOL_H
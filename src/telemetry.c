@@ -0,0 +1,253 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "telemetry.h"
+#include "util.h"
+
+#include <gst/gst.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define TELEMETRY_INTERVAL_MS 1000
+// Lines waiting for a slow reader; past this they're dropped
+#define TELEMETRY_BACKLOG (64 * 1024)
+// Keeps a line short enough to go out in one write even on a badly
+// scratched disc; the rest wait for the next one
+#define MAX_ERROR_SECTORS 64
+
+struct _RippitTelemetry {
+    int fd;
+    gboolean isSocket;
+    GString *pending;
+    guint dropped;
+    GList *jobs;
+};
+
+typedef struct {
+    RippitJob *job;
+    GstClockTime lastTime;
+    guint64 lastRead;
+    guint64 lastEncoded;
+    // Bytes a second, smoothed out a bit for the ETA
+    gdouble readRate;
+    guint errorsSent;
+} Sample;
+
+static void flush(RippitTelemetry *telemetry)
+{
+    ssize_t written;
+
+    if (telemetry->fd < 0 || telemetry->pending->len == 0)
+        return;
+    if (telemetry->isSocket) {
+        written = send(telemetry->fd, telemetry->pending->str, telemetry->pending->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    } else {
+        // Making it non-blocking would do the same to everything sharing
+        // it, our own stdout included. A writable pipe has room for
+        // PIPE_BUF, so that much never waits.
+        struct pollfd ready = { telemetry->fd, POLLOUT, 0 };
+        if (poll(&ready, 1, 0) <= 0)
+            return;
+        written = write(telemetry->fd, telemetry->pending->str, MIN(telemetry->pending->len, PIPE_BUF));
+    }
+
+    if (written > 0) {
+        g_string_erase(telemetry->pending, 0, written);
+    } else if (written < 0 && errno != EAGAIN && errno != EINTR) {
+        g_warning("Telemetry stopped: %s", g_strerror(errno));
+        close(telemetry->fd);
+        telemetry->fd = -1;
+    }
+}
+
+static void sendLine(RippitTelemetry *telemetry, GString *line)
+{
+    if (telemetry->pending->len + line->len > TELEMETRY_BACKLOG) {
+        telemetry->dropped++;
+        return;
+    }
+    g_string_append_len(telemetry->pending, line->str, line->len);
+    g_string_append_c(telemetry->pending, '\n');
+    flush(telemetry);
+}
+
+static void sendSample(RippitTelemetry *telemetry, Sample *sample)
+{
+    RippitJobStats stats;
+    GstClockTime now = gst_util_get_timestamp();
+    gdouble elapsed = (gdouble)(now - sample->lastTime) / GST_SECOND;
+    gdouble encodeRate = 0;
+    gdouble readRate = 0;
+    GTimeVal time;
+    GString *line;
+    gint *errors;
+    guint count;
+    guint i;
+
+    rippit_job_get_stats(sample->job, &stats);
+    if (elapsed > 0) {
+        readRate = (stats.bytesRead - sample->lastRead) / elapsed;
+        encodeRate = (stats.bytesEncoded - sample->lastEncoded) / elapsed;
+        sample->readRate = sample->readRate > 0 ? (sample->readRate * 3 + readRate) / 4 : readRate;
+    }
+    sample->lastTime = now;
+    sample->lastRead = stats.bytesRead;
+    sample->lastEncoded = stats.bytesEncoded;
+
+    g_get_current_time(&time);
+    line = g_string_new("{");
+    g_string_append_printf(line, "\"time\": %ld.%03ld, ", (long)time.tv_sec, (long)time.tv_usec / 1000);
+    g_string_append(line, "\"device\": ");
+    rippit_json_append_string(line, rippit_job_get_device(sample->job));
+    g_string_append(line, ", \"disc\": ");
+    rippit_json_append_string(line, rippit_job_get_disc_id(sample->job));
+    g_string_append_printf(line, ", \"track\": %d, \"tracks\": %d", stats.track, stats.trackCount);
+    g_string_append_printf(line, ", \"track_bytes\": %" G_GUINT64_FORMAT ", \"track_size\": %" G_GUINT64_FORMAT,
+                           stats.trackBytes, stats.trackSize);
+    g_string_append_printf(line, ", \"bytes_read\": %" G_GUINT64_FORMAT ", \"bytes_left\": %" G_GUINT64_FORMAT,
+                           stats.bytesRead, stats.bytesLeft);
+    g_string_append_printf(line, ", \"sectors_per_sec\": %.1f, \"encoder_bytes_per_sec\": %.0f",
+                           readRate / stats.sectorSize, encodeRate);
+    g_string_append_printf(line, ", \"retries\": %u, \"error_sectors\": %u", stats.retries, stats.errorSectors);
+    g_string_append_printf(line, ", \"first_sector_ms\": %u", stats.firstSectorMs);
+    g_string_append_printf(line, ", \"write_pending\": %" G_GUINT64_FORMAT ", \"write_peak\": %" G_GUINT64_FORMAT,
+                           stats.writePending, stats.writePeak);
+    g_string_append_printf(line, ", \"write_stalls\": %u, \"write_stall_ms\": %u", stats.writeStalls, stats.writeStallMs);
+
+    // Only the ones that haven't been sent yet
+    errors = rippit_job_get_error_sectors(sample->job, sample->errorsSent, &count);
+    count = MIN(count, MAX_ERROR_SECTORS);
+    g_string_append(line, ", \"new_error_sectors\": [");
+    for (i = 0; i < count; i++)
+        g_string_append_printf(line, "%s%d", i > 0 ? ", " : "", errors[i]);
+    g_string_append(line, "]");
+    sample->errorsSent += count;
+    g_free(errors);
+
+    if (stats.bytesLeft > 0 && sample->readRate > 0)
+        g_string_append_printf(line, ", \"eta_s\": %.0f", stats.bytesLeft / sample->readRate);
+    else
+        g_string_append(line, ", \"eta_s\": null");
+    g_string_append_printf(line, ", \"dropped_lines\": %u", telemetry->dropped);
+    g_string_append_printf(line, ", \"done\": %s}", stats.done ? "true" : "false");
+
+    sendLine(telemetry, line);
+    g_string_free(line, TRUE);
+}
+
+static gboolean tick_cb(gpointer data)
+{
+    RippitTelemetry *telemetry = data;
+    GList *cur;
+
+    flush(telemetry);
+    for (cur = telemetry->jobs; cur; cur = cur->next)
+        sendSample(telemetry, cur->data);
+    return telemetry->fd >= 0;
+}
+
+static int connectSocket(const gchar *path, GError **error)
+{
+    struct sockaddr_un address;
+    int fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "Telemetry socket path is too long: %s", path);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not connect to %s: %s", path, g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+RippitTelemetry *rippit_telemetry_open(const gchar *destination, GError **error)
+{
+    RippitTelemetry *telemetry;
+    gboolean isSocket = !g_str_has_prefix(destination, "fd:");
+    struct stat info;
+    int fd;
+
+    if (isSocket) {
+        fd = connectSocket(destination, error);
+    } else {
+        fd = atoi(destination + 3);
+        if (fcntl(fd, F_GETFL) < 0) {
+            g_set_error(error, RIPPIT_ERROR, RIPPIT_ERROR_PARAMS, "Nothing open on %s", destination);
+            fd = -1;
+        }
+    }
+    if (fd < 0)
+        return NULL;
+    // fd:N can be a socket too
+    if (!isSocket && fstat(fd, &info) == 0 && S_ISSOCK(info.st_mode))
+        isSocket = TRUE;
+
+    // A reader that's gone away shouldn't take the rip with it, and one
+    // that's slow shouldn't hold it up (see flush())
+    signal(SIGPIPE, SIG_IGN);
+
+    telemetry = g_new0(RippitTelemetry, 1);
+    telemetry->fd = fd;
+    telemetry->isSocket = isSocket;
+    telemetry->pending = g_string_new("");
+    g_timeout_add(TELEMETRY_INTERVAL_MS, tick_cb, telemetry);
+    return telemetry;
+}
+
+void rippit_telemetry_add_job(RippitTelemetry *telemetry, RippitJob *job)
+{
+    Sample *sample = g_new0(Sample, 1);
+    sample->job = job;
+    sample->lastTime = gst_util_get_timestamp();
+    telemetry->jobs = g_list_append(telemetry->jobs, sample);
+}
+
+void rippit_telemetry_remove_job(RippitTelemetry *telemetry, RippitJob *job)
+{
+    GList *cur;
+
+    for (cur = telemetry->jobs; cur; cur = cur->next) {
+        Sample *sample = cur->data;
+        if (sample->job != job)
+            continue;
+        sendSample(telemetry, sample);
+        telemetry->jobs = g_list_delete_link(telemetry->jobs, cur);
+        g_free(sample);
+        return;
+    }
+}
@@ -0,0 +1,39 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "librippit.h"
+
+// --telemetry: a JSON object per job, once a second, one per line, for
+// dashboards that watch a lot of drives at once. Everything in them comes
+// from rippit_job_get_stats(), so nothing ever has to ask a pipeline
+// anything. If whoever's reading falls behind, lines get dropped rather
+// than holding the rip up.
+typedef struct _RippitTelemetry RippitTelemetry;
+
+// destination is fd:N for a descriptor that's already open, or the path of
+// a UNIX socket that's listening for us
+RippitTelemetry *rippit_telemetry_open(const gchar *destination, GError **error);
+void rippit_telemetry_add_job(RippitTelemetry *telemetry, RippitJob *job);
+// Sends the job's last line, with "done": true
+void rippit_telemetry_remove_job(RippitTelemetry *telemetry, RippitJob *job);
+
+#endif // TELEMETRY_H
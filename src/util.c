@@ -0,0 +1,87 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "util.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+gboolean rippit_write_all(int fd, const void *data, gsize length, gint64 offset)
+{
+    const guint8 *next = data;
+
+    while (length > 0) {
+        ssize_t written = offset < 0 ? write(fd, next, length) : pwrite(fd, next, length, offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return FALSE;
+        next += written;
+        length -= written;
+        if (offset >= 0)
+            offset += written;
+    }
+    return TRUE;
+}
+
+gchar *rippit_part_name(const gchar *location)
+{
+    gchar *dir = g_path_get_dirname(location);
+    gchar *base = g_path_get_basename(location);
+    gchar *name = g_strdup_printf(".%s.part", base);
+    gchar *part = g_build_filename(dir, name, NULL);
+
+    g_free(name);
+    g_free(base);
+    g_free(dir);
+    return part;
+}
+
+int rippit_open_drive(const gchar *device, GError **error)
+{
+    // O_NONBLOCK so it doesn't wait for the tray
+    int fd = g_open(device, O_RDONLY | O_NONBLOCK, 0);
+
+    if (fd < 0)
+        g_set_error(error, RIPPIT_ERROR, 0, "Could not open %s: %s", device, g_strerror(errno));
+    return fd;
+}
+
+void rippit_json_append_string(GString *json, const gchar *value)
+{
+    const gchar *c;
+
+    if (!value) {
+        g_string_append(json, "null");
+        return;
+    }
+    g_string_append_c(json, '"');
+    for (c = value; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            g_string_append_printf(json, "\\%c", *c);
+        else if ((guchar)*c < 0x20)
+            g_string_append_printf(json, "\\u%04x", *c);
+        else
+            g_string_append_c(json, *c);
+    }
+    g_string_append_c(json, '"');
+}
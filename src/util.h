@@ -0,0 +1,42 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <glib.h>
+
+// Bits and pieces more than one part of rippit needs.
+
+// The whole of data, however many goes it takes. At offset, or wherever
+// the file is if offset is negative. FALSE with errno set if it couldn't.
+gboolean rippit_write_all(int fd, const void *data, gsize length, gint64 offset);
+
+// Where a file gets written until it's complete: .name.part next to it,
+// so moving it into place is a rename on the same filesystem
+gchar *rippit_part_name(const gchar *location);
+
+// Opens a drive to ask it things, with or without a disc in it. -1 if it
+// couldn't be opened.
+int rippit_open_drive(const gchar *device, GError **error);
+
+// value as a JSON string, or null if it's NULL
+void rippit_json_append_string(GString *json, const gchar *value);
+
+#endif // UTIL_H
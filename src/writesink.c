@@ -0,0 +1,504 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "rippit.h"
+#include "writesink.h"
+#include "util.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Big enough that NFS sends it in a few full sized WRITEs
+#define CHUNK_SIZE (1024 * 1024)
+#define CHUNK_ALIGN 4096
+#define DEFAULT_MAX_BYTES (16 * CHUNK_SIZE)
+
+struct _WriteChunk {
+    guint64 offset;
+    guint8 *data;
+    gsize length;
+};
+
+enum {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_MAX_BYTES
+};
+
+static GstStaticPadTemplate sinkTemplate = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+GST_BOILERPLATE(RippitWriteSink, rippit_write_sink, GstBaseSink, GST_TYPE_BASE_SINK);
+
+RippitWriteStats *rippit_write_stats_new()
+{
+    RippitWriteStats *stats = g_new0(RippitWriteStats, 1);
+    stats->lock = g_mutex_new();
+    return stats;
+}
+
+void rippit_write_stats_free(RippitWriteStats *stats)
+{
+    g_mutex_free(stats->lock);
+    g_free(stats);
+}
+
+void rippit_write_stats_get(RippitWriteStats *stats, RippitWriteStats *copy)
+{
+    g_mutex_lock(stats->lock);
+    *copy = *stats;
+    g_mutex_unlock(stats->lock);
+    copy->lock = NULL;
+}
+
+static gpointer writeLoop(gpointer data)
+{
+    RippitWriteSink *sink = data;
+
+    g_mutex_lock(sink->lock);
+    while (TRUE) {
+        WriteChunk *chunk;
+        gint error = 0;
+
+        while (g_queue_is_empty(&sink->queue) && !sink->quit)
+            g_cond_wait(sink->cond, sink->lock);
+        if (g_queue_is_empty(&sink->queue))
+            break;
+
+        chunk = g_queue_pop_head(&sink->queue);
+        sink->writing = TRUE;
+        g_mutex_unlock(sink->lock);
+
+        // After a failure there's no point, but the chunks still have to
+        // go back so nothing waits on them
+        if (sink->writeError == 0 && !rippit_write_all(sink->fd, chunk->data, chunk->length, chunk->offset))
+            error = errno;
+
+        g_mutex_lock(sink->stats->lock);
+        sink->stats->pending -= chunk->length;
+        if (error == 0)
+            sink->stats->written += chunk->length;
+        g_mutex_unlock(sink->stats->lock);
+
+        g_mutex_lock(sink->lock);
+        if (error != 0 && sink->writeError == 0)
+            sink->writeError = error;
+        sink->writing = FALSE;
+        sink->busy--;
+        g_queue_push_tail(&sink->spare, chunk);
+        g_cond_broadcast(sink->cond);
+    }
+    g_mutex_unlock(sink->lock);
+    return NULL;
+}
+
+// NULL if the sink's being unlocked. Blocks while the sink's holding all
+// it's allowed to, which is the only time the pipeline ever waits on the
+// disk.
+static WriteChunk *takeChunk(RippitWriteSink *sink)
+{
+    WriteChunk *chunk = NULL;
+    GstClockTime stallStart = 0;
+
+    g_mutex_lock(sink->lock);
+    while (sink->busy >= sink->maxChunks && !sink->unlocked && sink->writeError == 0) {
+        if (stallStart == 0)
+            stallStart = gst_util_get_timestamp();
+        g_cond_wait(sink->cond, sink->lock);
+    }
+    if (!sink->unlocked && sink->writeError == 0) {
+        chunk = g_queue_pop_head(&sink->spare);
+        sink->busy++;
+    }
+    g_mutex_unlock(sink->lock);
+
+    if (stallStart > 0) {
+        g_mutex_lock(sink->stats->lock);
+        sink->stats->stalls++;
+        sink->stats->stallTime += gst_util_get_timestamp() - stallStart;
+        g_mutex_unlock(sink->stats->lock);
+    }
+
+    if (chunk || sink->unlocked || sink->writeError)
+        return chunk;
+
+    chunk = g_new0(WriteChunk, 1);
+    if (posix_memalign((void**)&chunk->data, CHUNK_ALIGN, CHUNK_SIZE) != 0)
+        g_error("Out of memory for a %d byte write buffer", CHUNK_SIZE);
+    return chunk;
+}
+
+static void queueChunk(RippitWriteSink *sink)
+{
+    WriteChunk *chunk = sink->current;
+
+    sink->current = NULL;
+    if (chunk->length == 0) {
+        g_mutex_lock(sink->lock);
+        sink->busy--;
+        g_queue_push_tail(&sink->spare, chunk);
+        g_cond_broadcast(sink->cond);
+        g_mutex_unlock(sink->lock);
+        return;
+    }
+
+    g_mutex_lock(sink->stats->lock);
+    sink->stats->pending += chunk->length;
+    sink->stats->peak = MAX(sink->stats->peak, sink->stats->pending);
+    g_mutex_unlock(sink->stats->lock);
+
+    g_mutex_lock(sink->lock);
+    g_queue_push_tail(&sink->queue, chunk);
+    g_cond_broadcast(sink->cond);
+    g_mutex_unlock(sink->lock);
+}
+
+static void freeChunk(gpointer data, gpointer user_data)
+{
+    WriteChunk *chunk = data;
+    free(chunk->data);
+    g_free(chunk);
+}
+
+static gboolean writeError(RippitWriteSink *sink)
+{
+    if (sink->writeError == 0)
+        return FALSE;
+    GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, (NULL), ("Could not write to %s: %s", sink->partLocation, g_strerror(sink->writeError)));
+    return TRUE;
+}
+
+static gboolean rippit_write_sink_start(GstBaseSink *basesink)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(basesink);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    if (!sink->location) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND, (NULL), ("No file name given"));
+        return FALSE;
+    }
+    // /dev/null and the like don't get renamed, or truncated
+    if (g_file_test(sink->location, G_FILE_TEST_EXISTS) && !g_file_test(sink->location, G_FILE_TEST_IS_REGULAR)) {
+        sink->partLocation = g_strdup(sink->location);
+        flags = O_WRONLY;
+    } else {
+        sink->partLocation = rippit_part_name(sink->location);
+    }
+
+    sink->fd = g_open(sink->partLocation, flags, 0644);
+    if (sink->fd < 0) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, OPEN_WRITE, (NULL), ("Could not create %s: %s", sink->partLocation, g_strerror(errno)));
+        g_free(sink->partLocation);
+        sink->partLocation = NULL;
+        return FALSE;
+    }
+
+    sink->maxChunks = MAX(sink->maxBytes / CHUNK_SIZE, 2);
+    sink->position = 0;
+    sink->writeError = 0;
+    sink->quit = FALSE;
+    sink->writer = g_thread_create(writeLoop, sink, TRUE, NULL);
+    return TRUE;
+}
+
+// Everything that's been queued is on its way to the disk, or was lost
+static void stopWriter(RippitWriteSink *sink)
+{
+    g_mutex_lock(sink->lock);
+    sink->quit = TRUE;
+    g_cond_broadcast(sink->cond);
+    g_mutex_unlock(sink->lock);
+    g_thread_join(sink->writer);
+    sink->writer = NULL;
+}
+
+static gboolean finish(RippitWriteSink *sink)
+{
+    gboolean direct = g_str_equal(sink->partLocation, sink->location);
+
+    if (sink->current)
+        queueChunk(sink);
+    stopWriter(sink);
+    if (writeError(sink))
+        return FALSE;
+
+    // The one sync, once everything's there
+    if (!direct && fdatasync(sink->fd) < 0) {
+        sink->writeError = errno;
+        writeError(sink);
+        return FALSE;
+    }
+    close(sink->fd);
+    sink->fd = -1;
+
+    if (!direct && g_rename(sink->partLocation, sink->location) < 0) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, (NULL), ("Could not move %s into place: %s", sink->location, g_strerror(errno)));
+        return FALSE;
+    }
+    GST_DEBUG("Finished %s", sink->location);
+    return TRUE;
+}
+
+static gboolean rippit_write_sink_stop(GstBaseSink *basesink)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(basesink);
+
+    if (sink->writer) {
+        if (sink->current)
+            queueChunk(sink);
+        stopWriter(sink);
+    }
+    // Stopped without an EOS, so whatever's there is only part of it
+    if (sink->fd >= 0) {
+        close(sink->fd);
+        sink->fd = -1;
+        if (!g_str_equal(sink->partLocation, sink->location))
+            g_unlink(sink->partLocation);
+    }
+    g_free(sink->partLocation);
+    sink->partLocation = NULL;
+
+    g_queue_foreach(&sink->spare, freeChunk, NULL);
+    g_queue_clear(&sink->spare);
+    sink->busy = 0;
+    return TRUE;
+}
+
+static GstFlowReturn rippit_write_sink_render(GstBaseSink *basesink, GstBuffer *buffer)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(basesink);
+    const guint8 *data = GST_BUFFER_DATA(buffer);
+    gsize size = GST_BUFFER_SIZE(buffer);
+
+    while (size > 0) {
+        gsize length;
+
+        if (!sink->current) {
+            sink->current = takeChunk(sink);
+            if (!sink->current)
+                return writeError(sink) ? GST_FLOW_ERROR : GST_FLOW_WRONG_STATE;
+            sink->current->offset = sink->position;
+            sink->current->length = 0;
+        }
+
+        length = MIN(size, CHUNK_SIZE - sink->current->length);
+        memcpy(sink->current->data + sink->current->length, data, length);
+        sink->current->length += length;
+        sink->position += length;
+        data += length;
+        size -= length;
+
+        if (sink->current->length == CHUNK_SIZE)
+            queueChunk(sink);
+    }
+    return GST_FLOW_OK;
+}
+
+static gboolean rippit_write_sink_event(GstBaseSink *basesink, GstEvent *event)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(basesink);
+
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_NEWSEGMENT: {
+            GstFormat format;
+            gint64 start;
+
+            gst_event_parse_new_segment(event, NULL, NULL, &format, &start, NULL, NULL);
+            if (format == GST_FORMAT_BYTES && start >= 0 && (guint64)start != sink->position) {
+                // What's been filled so far goes where it was meant to
+                if (sink->current)
+                    queueChunk(sink);
+                sink->position = start;
+            }
+            break;
+        }
+        case GST_EVENT_EOS:
+            return finish(sink);
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+static gboolean rippit_write_sink_unlock(GstBaseSink *basesink)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(basesink);
+
+    g_mutex_lock(sink->lock);
+    sink->unlocked = TRUE;
+    g_cond_broadcast(sink->cond);
+    g_mutex_unlock(sink->lock);
+    return TRUE;
+}
+
+static gboolean rippit_write_sink_unlock_stop(GstBaseSink *basesink)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(basesink);
+
+    g_mutex_lock(sink->lock);
+    sink->unlocked = FALSE;
+    g_mutex_unlock(sink->lock);
+    return TRUE;
+}
+
+static void rippit_write_sink_base_init(gpointer g_class)
+{
+    GstElementClass *elementClass = GST_ELEMENT_CLASS(g_class);
+
+    gst_element_class_set_details_simple(elementClass, "Write-behind file sink", "Sink/File",
+        "Writes to a file from a thread of its own, and moves it into place when it's done", "Rippit");
+    gst_element_class_add_pad_template(elementClass, gst_static_pad_template_get(&sinkTemplate));
+}
+
+static void rippit_write_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_free(sink->location);
+            sink->location = g_value_dup_string(value);
+            break;
+        case PROP_MAX_BYTES:
+            sink->maxBytes = g_value_get_uint64(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void rippit_write_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, sink->location);
+            break;
+        case PROP_MAX_BYTES:
+            g_value_set_uint64(value, sink->maxBytes);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void rippit_write_sink_finalize(GObject *object)
+{
+    RippitWriteSink *sink = RIPPIT_WRITE_SINK(object);
+
+    g_free(sink->location);
+    g_mutex_free(sink->lock);
+    g_cond_free(sink->cond);
+    rippit_write_stats_free(sink->ownStats);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void rippit_write_sink_class_init(RippitWriteSinkClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstBaseSinkClass *baseClass = GST_BASE_SINK_CLASS(klass);
+
+    objectClass->set_property = rippit_write_sink_set_property;
+    objectClass->get_property = rippit_write_sink_get_property;
+    objectClass->finalize = rippit_write_sink_finalize;
+    baseClass->start = rippit_write_sink_start;
+    baseClass->stop = rippit_write_sink_stop;
+    baseClass->render = rippit_write_sink_render;
+    baseClass->event = rippit_write_sink_event;
+    baseClass->unlock = rippit_write_sink_unlock;
+    baseClass->unlock_stop = rippit_write_sink_unlock_stop;
+
+    // Same as filesink's, so either one will do
+    g_object_class_install_property(objectClass, PROP_LOCATION,
+        g_param_spec_string("location", "File Location", "Location of the file to write",
+                            NULL, G_PARAM_READWRITE));
+    g_object_class_install_property(objectClass, PROP_MAX_BYTES,
+        g_param_spec_uint64("max-bytes", "Max bytes", "Memory to hold writes in before the pipeline waits for the disk",
+                            2 * CHUNK_SIZE, G_MAXUINT64, DEFAULT_MAX_BYTES, G_PARAM_READWRITE));
+}
+
+static void rippit_write_sink_init(RippitWriteSink *sink, RippitWriteSinkClass *klass)
+{
+    sink->fd = -1;
+    sink->maxBytes = DEFAULT_MAX_BYTES;
+    sink->lock = g_mutex_new();
+    sink->cond = g_cond_new();
+    g_queue_init(&sink->queue);
+    g_queue_init(&sink->spare);
+    sink->ownStats = rippit_write_stats_new();
+    sink->stats = sink->ownStats;
+    // Writing to a file doesn't wait on the clock
+    gst_base_sink_set_sync(GST_BASE_SINK(sink), FALSE);
+}
+
+void rippit_write_sink_share_stats(RippitWriteSink *sink, RippitWriteStats *stats)
+{
+    sink->stats = stats;
+}
+
+GstElement *rippit_write_sink_make(guint64 maxBytes, RippitWriteStats *stats)
+{
+    GstElement *sink;
+
+    if (maxBytes == 0)
+        return gst_element_factory_make("filesink", NULL);
+    sink = gst_element_factory_make("rippitwritesink", NULL);
+    g_object_set(G_OBJECT(sink), "max-bytes", maxBytes, NULL);
+    if (stats)
+        rippit_write_sink_share_stats(RIPPIT_WRITE_SINK(sink), stats);
+    return sink;
+}
+
+GstElement *rippit_write_sink_replace(GstElement *filesink, guint64 maxBytes, RippitWriteStats *stats)
+{
+    GstBin *bin = GST_BIN(GST_ELEMENT_PARENT(filesink));
+    GstElement *sink;
+    GstPad *sinkpad;
+    GstPad *peer;
+    gchar *location = NULL;
+
+    if (maxBytes == 0)
+        return filesink;
+
+    g_object_get(G_OBJECT(filesink), "location", &location, NULL);
+    sinkpad = gst_element_get_static_pad(filesink, "sink");
+    peer = gst_pad_get_peer(sinkpad);
+    gst_pad_unlink(peer, sinkpad);
+    gst_object_unref(sinkpad);
+    gst_bin_remove(bin, filesink);
+
+    sink = rippit_write_sink_make(maxBytes, stats);
+    g_object_set(G_OBJECT(sink), "location", location, NULL);
+    gst_bin_add(bin, sink);
+    sinkpad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_link(peer, sinkpad);
+    gst_object_unref(sinkpad);
+    gst_object_unref(peer);
+    g_free(location);
+    return sink;
+}
+
+gboolean rippit_write_sink_register()
+{
+    return gst_element_register(NULL, "rippitwritesink", GST_RANK_NONE, RIPPIT_TYPE_WRITE_SINK);
+}
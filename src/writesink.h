@@ -0,0 +1,114 @@
+// rippit - A no-nonsense program to rip multimedia
+//
+// Copyright (C) 2011 Trever Fischer <tdfischer@fedoraproject.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef WRITESINK_H
+#define WRITESINK_H
+
+#include <gst/base/gstbasesink.h>
+
+// A filesink for storage that's slow, or far away. Buffers get copied into
+// big page aligned chunks, and a thread of the sink's own writes the
+// chunks out, so the pipeline only waits on the disk once there's more
+// waiting to be written than the sink is allowed to hold. Seeks, which
+// muxers and flacenc make to fill in their headers, just start a new
+// chunk at the new offset.
+//
+// The file is written as .name.part next to where it's going, and only
+// synced and renamed into place at EOS, so a crash never leaves half a
+// file under the real name. Without an EOS, the part file is deleted.
+// A location that exists but isn't a regular file, like /dev/null, is
+// written to directly.
+
+#define RIPPIT_TYPE_WRITE_SINK (rippit_write_sink_get_type())
+#define RIPPIT_WRITE_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), RIPPIT_TYPE_WRITE_SINK, RippitWriteSink))
+
+// How far behind the disk is, summed over every sink sharing it. Safe to
+// read from any thread with rippit_write_stats_get().
+typedef struct {
+    GMutex *lock;
+    // Bytes in memory waiting to be written, and the most there have been
+    guint64 pending;
+    guint64 peak;
+    guint64 written;
+    // Times the pipeline had to wait for the disk, and for how long
+    guint stalls;
+    GstClockTime stallTime;
+} RippitWriteStats;
+
+RippitWriteStats *rippit_write_stats_new();
+void rippit_write_stats_free(RippitWriteStats *stats);
+// A copy, taken under the lock
+void rippit_write_stats_get(RippitWriteStats *stats, RippitWriteStats *copy);
+
+typedef struct _WriteChunk WriteChunk;
+
+typedef struct {
+    GstBaseSink parent;
+
+    gchar *location;
+    // Where it goes until it's finished, or location itself
+    gchar *partLocation;
+    int fd;
+    // "max-bytes": memory for chunks, written or waiting
+    guint64 maxBytes;
+    guint maxChunks;
+
+    // The chunk being filled, and where the next byte goes in the file
+    WriteChunk *current;
+    guint64 position;
+
+    GThread *writer;
+    GMutex *lock;
+    GCond *cond;
+    // WriteChunk, oldest first, waiting for the writer
+    GQueue queue;
+    // Written ones, to be filled again
+    GQueue spare;
+    // Chunks that aren't spare: being filled, waiting or being written
+    guint busy;
+    gboolean writing;
+    gboolean quit;
+    gboolean unlocked;
+    // The first write that failed, or 0
+    gint writeError;
+
+    RippitWriteStats *stats;
+    // Used when there's nobody to share with
+    RippitWriteStats *ownStats;
+} RippitWriteSink;
+
+typedef struct {
+    GstBaseSinkClass parent_class;
+} RippitWriteSinkClass;
+
+GType rippit_write_sink_get_type();
+// Makes "rippitwritesink" available to gst_element_factory_make()
+gboolean rippit_write_sink_register();
+// Counts this sink's backpressure in stats as well, which has to outlive
+// it. Before it starts.
+void rippit_write_sink_share_stats(RippitWriteSink *sink, RippitWriteStats *stats);
+
+// A "rippitwritesink" holding up to maxBytes, counted in stats if that
+// isn't NULL, or a plain filesink if maxBytes is 0
+GstElement *rippit_write_sink_make(guint64 maxBytes, RippitWriteStats *stats);
+// Swaps filesink, linked up in its bin, for one of those, location and all.
+// Returns whichever one is there now.
+GstElement *rippit_write_sink_replace(GstElement *filesink, guint64 maxBytes, RippitWriteStats *stats);
+
+#endif // WRITESINK_H